@@ -0,0 +1,72 @@
+#ifndef TSG_BASE_ALLOCATION_COUNTER_HPP
+#define TSG_BASE_ALLOCATION_COUNTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+namespace tsg {
+
+struct AllocationCounts {
+    uint64_t allocations{0};
+    uint64_t deallocations{0};
+    uint64_t bytes{0};
+};
+
+// Test-mode allocator behind TSG_ALLOC / TSG_FREE when built with TSG_COUNT_ALLOCATIONS: malloc and
+// free, counted per thread. Other heap users (e.g. a replaced global operator new) may report to
+// the same counters with on_allocate() and on_deallocate().
+class AllocationCounter {
+  public:
+    static void *allocate(size_t count) {
+        on_allocate(count);
+        return malloc(count);
+    }
+
+    static void deallocate(void *target) {
+        if (target != nullptr) {
+            on_deallocate();
+        }
+        free(target);
+    }
+
+    static void on_allocate(size_t count) {
+        AllocationCounts &counts = thread_counts();
+        counts.allocations++;
+        counts.bytes += count;
+    }
+
+    static void on_deallocate() { thread_counts().deallocations++; }
+
+    static AllocationCounts get_counts() { return thread_counts(); }
+
+  private:
+    static AllocationCounts &thread_counts() {
+        thread_local AllocationCounts counts;
+        return counts;
+    }
+};
+
+// Allocations made by the current thread since the scope was entered
+class AllocationScope {
+  public:
+    AllocationScope() : m_start(AllocationCounter::get_counts()) {}
+
+    AllocationCounts get_counts() const {
+        AllocationCounts now = AllocationCounter::get_counts();
+        AllocationCounts counts;
+        counts.allocations = now.allocations - m_start.allocations;
+        counts.deallocations = now.deallocations - m_start.deallocations;
+        counts.bytes = now.bytes - m_start.bytes;
+        return counts;
+    }
+
+    uint64_t allocations() const { return get_counts().allocations; }
+
+  private:
+    AllocationCounts m_start;
+};
+
+} // namespace tsg
+
+#endif // TSG_BASE_ALLOCATION_COUNTER_HPP
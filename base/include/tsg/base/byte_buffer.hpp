@@ -66,12 +66,7 @@ class ByteBuffer {
 
     constexpr void append(ByteBuffer &&bb) { append(bb.data(), bb.size()); }
 
-    constexpr void push_back(const ReferenceT v) {
-        resize(size() + 1);
-        at(size() - 1) = v;
-    }
-
-    constexpr void push_back(ReferenceT &v) {
+    constexpr void push_back(const ValueT v) {
         resize(size() + 1);
         at(size() - 1) = v;
     }
@@ -1,6 +1,11 @@
 #ifndef TSG_BASE_MEMORY_HPP
 #define TSG_BASE_MEMORY_HPP
 
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 // clang-format off
 
 /// Helper macros for file-line-function reporting on memory operations
@@ -15,6 +20,14 @@
 #define TSG_FREE(target, count)             mmgr_deallocator(TSG_FL_LN_FN, mmgr_alloc_free, target)
 #define TSG_FREE2(target, count, f, l, fn)  mmgr_deallocator(f, l, fn, mmgr_alloc_free, target)
 
+#elif defined(TSG_COUNT_ALLOCATIONS)
+#include "allocation_counter.hpp"
+
+#define TSG_ALLOC(count)                    tsg::AllocationCounter::allocate(count)
+#define TSG_ALLOC2(count, f, l, fn)         tsg::AllocationCounter::allocate(count)
+#define TSG_FREE(target, count)             tsg::AllocationCounter::deallocate(target)
+#define TSG_FREE2(target, count, f, l, fn)  tsg::AllocationCounter::deallocate(target)
+
 #else
 
 #define TSG_ALLOC(count)                    operator new[](count)
@@ -85,6 +85,7 @@
 
 #ifndef	_WIN32 // LAG
 #include <unistd.h>
+#define	_unlink unlink
 #endif
 
 #include <tsg/base/mmgr/mmgr.h>
@@ -467,7 +468,7 @@ static	void	wipeWithPattern(sAllocUnit *allocUnit, unsigned long pattern, const
 		long	*lptr = reinterpret_cast<long *>(reinterpret_cast<char *>(allocUnit->reportedAddress) + originalReportedSize);
 		int	length = static_cast<int>(allocUnit->reportedSize - originalReportedSize);
 		int	i;
-		for (i = 0; i < (length >> 2); i++, lptr++)
+		for (i = 0; i < (length / static_cast<int>(sizeof(long))); i++, lptr++) // long is 8 bytes on LP64
 		{
 			*lptr = pattern;
 		}
@@ -476,9 +477,9 @@ static	void	wipeWithPattern(sAllocUnit *allocUnit, unsigned long pattern, const
 
 		unsigned int	shiftCount = 0;
 		char		*cptr = reinterpret_cast<char *>(lptr);
-		for (i = 0; i < (length & 0x3); i++, cptr++, shiftCount += 8)
+		for (i = 0; i < (length % static_cast<int>(sizeof(long))); i++, cptr++, shiftCount += 8)
 		{
-			*cptr = static_cast<char>((pattern & (0xff << shiftCount)) >> shiftCount);
+			*cptr = static_cast<char>((pattern >> shiftCount) & 0xff);
 		}
 	}
 
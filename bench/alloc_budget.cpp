@@ -0,0 +1,205 @@
+// tsg_alloc_budget - checks the heap allocations of the hot paths against their budgets, exiting with
+// a failure when one is exceeded. Built with TSG_COUNT_ALLOCATIONS, TSG_ALLOC / TSG_FREE and the
+// global operator new / delete of this program both report to the AllocationCounter.
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+
+#include <tsg/base/allocation_counter.hpp>
+#include <tsg/base/hex.hpp>
+#include <tsg/smartcard/apdu_builder.hpp>
+#include <tsg/smartcard/atr.hpp>
+#include <tsg/smartcard/command_apdu.hpp>
+#include <tsg/smartcard/memory_terminal.hpp>
+#include <tsg/smartcard/response_apdu.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+#include "bench.hpp"
+
+#ifndef TSG_COUNT_ALLOCATIONS
+#error "tsg_alloc_budget requires TSG_COUNT_ALLOCATIONS"
+#endif
+
+void *operator new(size_t count) {
+    tsg::AllocationCounter::on_allocate(count);
+    void *target = malloc(count == 0 ? 1 : count);
+    if (target == nullptr) {
+        throw std::bad_alloc();
+    }
+    return target;
+}
+
+void *operator new[](size_t count) { return operator new(count); }
+
+void *operator new(size_t count, const std::nothrow_t &) noexcept {
+    tsg::AllocationCounter::on_allocate(count);
+    return malloc(count == 0 ? 1 : count);
+}
+
+void *operator new[](size_t count, const std::nothrow_t &tag) noexcept { return operator new(count, tag); }
+
+void operator delete(void *target) noexcept {
+    if (target != nullptr) {
+        tsg::AllocationCounter::on_deallocate();
+    }
+    free(target);
+}
+
+void operator delete[](void *target) noexcept { operator delete(target); }
+
+void operator delete(void *target, size_t) noexcept { operator delete(target); }
+
+void operator delete[](void *target, size_t) noexcept { operator delete(target); }
+
+using namespace tsg::smartcard;
+
+namespace {
+
+constexpr const char *k_terminal_name = "Memory Terminal";
+constexpr uint16_t k_file_id = 0x0101;
+constexpr uint8_t k_aid[] = {0xA0, 0x00, 0x00, 0x03, 0x08, 0x00, 0x00, 0x10, 0x00};
+constexpr uint8_t k_pin[] = {0x31, 0x32, 0x33, 0x34, 0xFF, 0xFF, 0xFF, 0xFF};
+constexpr uint32_t k_warm_up_runs = 8;
+constexpr uint32_t k_measured_runs = 64;
+
+struct Budget {
+    const char *name;
+    // Allocations allowed per run, once warmed up
+    uint64_t allocations;
+    std::function<void()> run;
+};
+
+} // namespace
+
+int main() {
+    std::vector<uint8_t> content(1024);
+    for (size_t index = 0; index < content.size(); index++) {
+        content[index] = (uint8_t)index;
+    }
+
+    // T=0 so that a SELECT returning its FCI goes through 61xx and GET RESPONSE
+    MemoryTerminalConfig config;
+    config.protocol = CardConnection::com_protocol_t_0;
+    MemoryTerminal terminal(config);
+    terminal.add_application(k_aid, sizeof(k_aid));
+    terminal.add_file(k_file_id, 0x01, content.data(), content.size());
+
+    SmartCardProvider provider;
+    provider.initialize();
+    provider.add_virtual_terminal(k_terminal_name, &terminal);
+    provider.refresh();
+
+    CardConnection connection = provider.create_card_connection(k_terminal_name);
+    if (!connection.is_valid() || connection.connect() != 0) {
+        fprintf(stderr, "ERROR - alloc budget: cannot connect to the memory terminal\n");
+        return 1;
+    }
+    connection.set_apdu_trace_enabled(false);
+
+    ATR atr = {0x3B, 0x8E, 0x80, 0x01, 0x80, 0x31, 0x80, 0x73, 0xBE, 0x21, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+               0x00, 0x00};
+    uint8_t hex_bytes[64] = {};
+    char hex_text[2 * sizeof(hex_bytes) + 1] = {};
+    tsg::hex::hex_string_of(hex_bytes, sizeof(hex_bytes), hex_text, sizeof(hex_text) - 1);
+    uint8_t response[k_max_rapdu_length];
+
+    const Budget budgets[] = {
+        {"command_apdu/data_le", 1,
+         []() {
+             uint8_t aid[sizeof(k_aid)] = {};
+             CommandAPDU capdu(0x00, apdu::ins_select, 0x04, 0x00, aid, sizeof(aid), 0x00);
+             tsg::bench::do_not_optimize(capdu.data());
+         }},
+        {"command_apdu/typed", 0,
+         []() {
+             auto capdu = apdu::select_df_name(k_aid);
+             tsg::bench::do_not_optimize(capdu);
+         }},
+        {"response_apdu/parse", 0,
+         [&response]() {
+             ResponseAPDU rapdu(response, 34);
+             tsg::bench::do_not_optimize(rapdu.sw_is(0x90, 0x00));
+         }},
+        {"atr/compact_tlv", 0,
+         [&atr]() {
+             bool extended = atr.supports_extended_length();
+             tsg::bench::do_not_optimize(extended);
+         }},
+        {"hex/hex_string_of", 0,
+         [&hex_bytes, &hex_text]() {
+             tsg::hex::hex_string_of(hex_bytes, sizeof(hex_bytes), hex_text, sizeof(hex_text) - 1);
+             tsg::bench::do_not_optimize(hex_text);
+         }},
+        {"hex/byte_array_of", 0,
+         [&hex_bytes, &hex_text]() {
+             tsg::hex::byte_array_of(hex_text, hex_bytes, sizeof(hex_bytes));
+             tsg::bench::do_not_optimize(hex_bytes);
+         }},
+        {"transmit/get_response_chaining", 0,
+         [&connection]() {
+             ResponseAPDU rapdu = connection.transmit(apdu::select_df_name(k_aid));
+             tsg::bench::do_not_optimize(rapdu);
+         }},
+        {"transmit/verify", 0,
+         [&connection]() {
+             ResponseAPDU rapdu = connection.transmit(apdu::verify(0x81, k_pin));
+             tsg::bench::do_not_optimize(rapdu);
+         }},
+        {"transmit/read_binary", 0,
+         [&connection]() {
+             connection.transmit(apdu::select_file_id(k_file_id));
+             ResponseAPDU rapdu = connection.transmit(apdu::read_binary(0, 128));
+             tsg::bench::do_not_optimize(rapdu);
+         }},
+        {"transmit/read_cache_hit", 0,
+         [&connection]() {
+             connection.set_read_cache_enabled(true);
+             ResponseAPDU rapdu = connection.transmit(apdu::read_binary(0, 128));
+             tsg::bench::do_not_optimize(rapdu);
+         }},
+        {"transmit/in_place", 0,
+         [&connection, &response]() {
+             auto capdu = apdu::read_binary(0, 256);
+             size_t response_size = sizeof(response);
+             connection.transmit(capdu.data(), capdu.size(), response, response_size);
+             tsg::bench::do_not_optimize(response);
+         }},
+        {"apdu_metrics/snapshot", 0,
+         [&connection]() {
+             APDUMetricsSnapshot snapshot = connection.get_apdu_metrics();
+             tsg::bench::do_not_optimize(snapshot);
+         }},
+    };
+
+    int failures = 0;
+    printf("%-34s %10s %10s %12s\n", "path", "budget", "allocs/run", "bytes/run");
+    for (auto &budget : budgets) {
+        for (uint32_t run = 0; run < k_warm_up_runs; run++) {
+            budget.run();
+        }
+
+        tsg::AllocationScope scope;
+        for (uint32_t run = 0; run < k_measured_runs; run++) {
+            budget.run();
+        }
+        tsg::AllocationCounts counts = scope.get_counts();
+
+        double allocations = (double)counts.allocations / k_measured_runs;
+        bool failed = counts.allocations > budget.allocations * k_measured_runs;
+        failures += failed ? 1 : 0;
+        printf("%-34s %10llu %10.2f %12.1f%s\n", budget.name, (unsigned long long)budget.allocations, allocations,
+               (double)counts.bytes / k_measured_runs, failed ? "  OVER BUDGET" : "");
+    }
+
+    connection.disconnect();
+    provider.destroy_card_connection(connection);
+    provider.cleanup();
+
+    if (failures > 0) {
+        fprintf(stderr, "ERROR - alloc budget: %d path(s) over budget\n", failures);
+        return 1;
+    }
+    return 0;
+}
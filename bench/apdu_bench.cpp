@@ -0,0 +1,206 @@
+// APDU value types and end-to-end transmit against the in-memory terminal
+
+#include <vector>
+
+#include <tsg/smartcard/apdu_builder.hpp>
+#include <tsg/smartcard/apdu_metrics.hpp>
+#include <tsg/smartcard/apdu_trace.hpp>
+#include <tsg/smartcard/atr.hpp>
+#include <tsg/smartcard/command_apdu.hpp>
+#include <tsg/smartcard/memory_terminal.hpp>
+#include <tsg/smartcard/response_apdu.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+#include "bench.hpp"
+
+using namespace tsg::smartcard;
+
+namespace tsg {
+namespace bench {
+
+namespace {
+
+constexpr const char *k_terminal_name = "Memory Terminal";
+constexpr const char *k_trace_path = "tsg_bench.trace";
+constexpr uint16_t k_file_id = 0x0101;
+constexpr uint8_t k_aid[] = {0xA0, 0x00, 0x00, 0x03, 0x08, 0x00, 0x00, 0x10, 0x00};
+constexpr uint8_t k_pin[] = {0x31, 0x32, 0x33, 0x34, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// Provider, terminal and connection shared by the transmit benchmarks, set up on first use
+struct TransmitFixture {
+    TransmitFixture() {
+        std::vector<uint8_t> content(1024);
+        for (size_t index = 0; index < content.size(); index++) {
+            content[index] = (uint8_t)index;
+        }
+        terminal.add_application(k_aid, sizeof(k_aid));
+        terminal.add_file(k_file_id, 0x01, content.data(), content.size());
+
+        provider.initialize();
+        provider.add_virtual_terminal(k_terminal_name, &terminal);
+        provider.refresh();
+
+        connection = provider.create_card_connection(k_terminal_name);
+        connection.connect();
+        connection.set_apdu_trace_enabled(false);
+        connection.transmit(apdu::select_df_name(k_aid));
+        connection.transmit(apdu::select_file_id(k_file_id));
+    }
+
+    ~TransmitFixture() {
+        connection.disconnect();
+        provider.destroy_card_connection(connection);
+        provider.cleanup();
+    }
+
+    MemoryTerminal terminal;
+    SmartCardProvider provider;
+    CardConnection connection;
+};
+
+TransmitFixture &transmit_fixture() {
+    static TransmitFixture fixture;
+    return fixture;
+}
+
+} // namespace
+
+void register_apdu_benchmarks(BenchSuite &suite) {
+    suite.add("atr/copy", [](uint64_t iterations) {
+        ATR atr = {0x3B, 0xDB, 0x96, 0x00, 0x80, 0xB1, 0xFE, 0x45, 0x1F, 0x83, 0x00, 0x31,
+                   0xC0, 0x64, 0xC7, 0xFC, 0x10, 0x00, 0x01, 0x90, 0x00, 0x74};
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ATR copy(atr);
+            do_not_optimize(copy);
+        }
+    });
+
+    suite.add("response_apdu/copy_sw", [](uint64_t iterations) {
+        ResponseAPDU rapdu = {0x90, 0x00};
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ResponseAPDU copy(rapdu);
+            do_not_optimize(copy);
+        }
+    });
+
+    suite.add("response_apdu/copy_256", [](uint64_t iterations) {
+        std::vector<uint8_t> bytes(258, 0x5A);
+        ResponseAPDU rapdu(bytes.data(), bytes.size());
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ResponseAPDU copy(rapdu);
+            do_not_optimize(copy);
+        }
+    });
+
+    suite.add("command_apdu/header", [](uint64_t iterations) {
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            CommandAPDU capdu(0x00, 0x84, 0x00, 0x00);
+            do_not_optimize(capdu.data());
+        }
+    });
+
+    suite.add("command_apdu/data_le", [](uint64_t iterations) {
+        uint8_t aid[sizeof(k_aid)] = {};
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            CommandAPDU capdu(0x00, 0xA4, 0x04, 0x00, aid, sizeof(aid), 0x00);
+            do_not_optimize(capdu.data());
+        }
+    });
+
+    suite.add("command_apdu/typed_data_le", [](uint64_t iterations) {
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            auto capdu = apdu::select_df_name(k_aid);
+            do_not_optimize(capdu);
+        }
+    });
+
+    suite.add("apdu_metrics/record", [](uint64_t iterations) {
+        static APDUMetrics metrics;
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            metrics.record_round_trip(13, 2);
+            metrics.record_command(apdu::ins_verify, 20000 + (iteration & 0xFFF) * 100, 0, 0, false);
+        }
+        do_not_optimize(metrics);
+    });
+
+    suite.add("apdu_metrics/snapshot", [](uint64_t iterations) {
+        CardConnection &connection = transmit_fixture().connection;
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            APDUMetricsSnapshot snapshot = connection.get_apdu_metrics();
+            do_not_optimize(snapshot);
+        }
+    });
+
+    suite.add("transmit/verify", [](uint64_t iterations) {
+        CardConnection &connection = transmit_fixture().connection;
+        auto capdu = apdu::verify(0x81, k_pin);
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ResponseAPDU rapdu = connection.transmit(capdu);
+            do_not_optimize(rapdu);
+        }
+    });
+
+    suite.add("transmit/read_binary_256", [](uint64_t iterations) {
+        CardConnection &connection = transmit_fixture().connection;
+        connection.set_read_cache_enabled(false);
+        auto capdu = apdu::read_binary(0, 256);
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ResponseAPDU rapdu = connection.transmit(capdu);
+            do_not_optimize(rapdu);
+        }
+    });
+
+    suite.add("transmit/read_binary_256_cached", [](uint64_t iterations) {
+        CardConnection &connection = transmit_fixture().connection;
+        connection.set_read_cache_enabled(true);
+        auto capdu = apdu::read_binary(0, 256);
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ResponseAPDU rapdu = connection.transmit(capdu);
+            do_not_optimize(rapdu);
+        }
+        connection.set_read_cache_enabled(false);
+    });
+
+    suite.add("transmit/read_binary_256_recorded", [](uint64_t iterations) {
+        CardConnection &connection = transmit_fixture().connection;
+        connection.start_recording(k_trace_path);
+        auto capdu = apdu::read_binary(0, 256);
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ResponseAPDU rapdu = connection.transmit(capdu);
+            do_not_optimize(rapdu);
+        }
+        connection.stop_recording();
+    });
+
+    // Per record, over the trace left by the previous benchmark
+    suite.add("trace/scan", [](uint64_t iterations) {
+        TraceReader reader;
+        if (reader.open(k_trace_path) != 0) {
+            return;
+        }
+        TraceRecord record;
+        uint64_t scanned = 0;
+        while (scanned < iterations) {
+            if (!reader.next(record)) {
+                reader.rewind();
+                continue;
+            }
+            do_not_optimize(record.rapdu_size);
+            scanned++;
+        }
+    });
+
+    suite.add("transmit/raw_read_binary_256", [](uint64_t iterations) {
+        CardConnection &connection = transmit_fixture().connection;
+        auto capdu = apdu::read_binary(0, 256);
+        uint8_t response[258];
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            size_t response_size = sizeof(response);
+            connection.transmit(capdu.data(), capdu.size(), response, response_size);
+            do_not_optimize(response);
+        }
+    });
+}
+
+} // namespace bench
+} // namespace tsg
@@ -0,0 +1,99 @@
+// Base containers and hex codecs
+
+#include <tsg/base/byte_buffer.hpp>
+#include <tsg/base/byte_heap_array.hpp>
+#include <tsg/base/hex.hpp>
+
+#include "bench.hpp"
+
+namespace tsg {
+namespace bench {
+
+namespace {
+
+constexpr size_t k_growth_count = 256;
+
+// byte_array_of walks at most 127 bytes (its position counter is a byte)
+constexpr size_t k_hex_bytes = 64;
+
+} // namespace
+
+void register_base_benchmarks(BenchSuite &suite) {
+    suite.add("byte_heap_array/push_back_256", [](uint64_t iterations) {
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ByteHeapArray array;
+            for (size_t index = 0; index < k_growth_count; index++) {
+                array.push_back((uint8_t)index);
+            }
+            do_not_optimize(array.data());
+        }
+    });
+
+    suite.add("byte_heap_array/append_16x16", [](uint64_t iterations) {
+        uint8_t chunk[16] = {};
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ByteHeapArray array;
+            for (size_t index = 0; index < k_growth_count / sizeof(chunk); index++) {
+                array.append(chunk, sizeof(chunk));
+            }
+            do_not_optimize(array.data());
+        }
+    });
+
+    suite.add("byte_heap_array/copy_256", [](uint64_t iterations) {
+        ByteHeapArray source(k_growth_count);
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ByteHeapArray copy(source);
+            do_not_optimize(copy.data());
+        }
+    });
+
+    suite.add("byte_buffer/push_back_256", [](uint64_t iterations) {
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ByteBuffer buffer;
+            for (size_t index = 0; index < k_growth_count; index++) {
+                uint8_t value = (uint8_t)index;
+                buffer.push_back(value);
+            }
+            do_not_optimize(buffer.data());
+        }
+    });
+
+    suite.add("byte_buffer/append_16x16", [](uint64_t iterations) {
+        uint8_t chunk[16] = {};
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            ByteBuffer buffer;
+            for (size_t index = 0; index < k_growth_count / sizeof(chunk); index++) {
+                buffer.append(chunk, sizeof(chunk));
+            }
+            do_not_optimize(buffer.data());
+        }
+    });
+
+    suite.add("hex/byte_array_of_64", [](uint64_t iterations) {
+        char text[k_hex_bytes * 2 + 1] = {};
+        for (size_t index = 0; index < k_hex_bytes * 2; index++) {
+            text[index] = hex::characters_upper_case[index % 16];
+        }
+        uint8_t bytes[k_hex_bytes];
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            hex::byte_array_of(text, bytes, sizeof(bytes));
+            do_not_optimize(bytes);
+        }
+    });
+
+    suite.add("hex/hex_string_of_64", [](uint64_t iterations) {
+        uint8_t bytes[k_hex_bytes];
+        for (size_t index = 0; index < sizeof(bytes); index++) {
+            bytes[index] = (uint8_t)(index * 37);
+        }
+        char text[k_hex_bytes * 2];
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            hex::hex_string_of(bytes, sizeof(bytes), text, sizeof(text), true);
+            do_not_optimize(text);
+        }
+    });
+}
+
+} // namespace bench
+} // namespace tsg
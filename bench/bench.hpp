@@ -0,0 +1,159 @@
+#ifndef TSG_BENCH_BENCH_HPP
+#define TSG_BENCH_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef TSG_BENCH_MMGR_MODE
+#define TSG_BENCH_MMGR_MODE "unknown"
+#endif
+
+namespace tsg {
+namespace bench {
+
+// Keeps the compiler from discarding a computed value
+template <class T> inline void do_not_optimize(const T &value) {
+#if defined(_MSC_VER)
+    static volatile const void *sink;
+    sink = &value;
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+// Runs 'iterations' times the operation being measured
+using BenchFunction = std::function<void(uint64_t iterations)>;
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations{0};
+    double ns_per_op{0};
+    double min_ns_per_op{0};
+    double max_ns_per_op{0};
+};
+
+// Each benchmark is calibrated to run at least 'min_time_ms', then repeated and reported by its
+// median. Results are written as JSON (stable key and benchmark order, for diffing releases) to a
+// file, stdout being shared with the library's own reporting.
+class BenchSuite {
+  public:
+    void add(const char *name, const BenchFunction &function, uint32_t repetitions = 5) {
+        m_benchmarks.push_back({name, function, repetitions});
+    }
+
+    void set_min_time_ms(double min_time_ms) { m_min_time_ms = min_time_ms; }
+
+    // tsg_bench [filter] [--json path]: only benchmarks whose name contains 'filter' run
+    int run(int argc, char **argv) {
+        const char *filter = nullptr;
+        std::string json_path = std::string("tsg_bench_") + TSG_BENCH_MMGR_MODE + ".json";
+        for (int index = 1; index < argc; index++) {
+            if (strcmp(argv[index], "--json") == 0 && index + 1 < argc) {
+                json_path = argv[++index];
+            } else {
+                filter = argv[index];
+            }
+        }
+
+        FILE *json = fopen(json_path.c_str(), "w");
+        if (json == nullptr) {
+            fprintf(stderr, "ERROR - bench: cannot open %s\n", json_path.c_str());
+            return 1;
+        }
+
+        std::vector<BenchResult> results;
+        for (auto &benchmark : m_benchmarks) {
+            if (filter != nullptr && filter[0] != '\0' && benchmark.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            results.push_back(measure(benchmark));
+            const BenchResult &result = results.back();
+            printf("%-40s %14.1f ns/op %12llu it\n", result.name.c_str(), result.ns_per_op,
+                   (unsigned long long)result.iterations);
+        }
+
+        print_json(json, results);
+        fclose(json);
+        printf("results written to %s\n", json_path.c_str());
+        return 0;
+    }
+
+  private:
+    struct Benchmark {
+        std::string name;
+        BenchFunction function;
+        uint32_t repetitions;
+    };
+
+    static double elapsed_ns(const BenchFunction &function, uint64_t iterations) {
+        auto start = std::chrono::steady_clock::now();
+        function(iterations);
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    BenchResult measure(const Benchmark &benchmark) {
+        uint64_t iterations = 1;
+        double ns = elapsed_ns(benchmark.function, iterations);
+        while (ns < m_min_time_ms * 1e6 && iterations < (1ULL << 40)) {
+            double factor = ns > 0 ? (m_min_time_ms * 1e6 * 1.2) / ns : 10.0;
+            iterations = (uint64_t)(iterations * std::min(std::max(factor, 2.0), 100.0));
+            ns = elapsed_ns(benchmark.function, iterations);
+        }
+
+        std::vector<double> samples{ns / iterations};
+        for (uint32_t repetition = 1; repetition < benchmark.repetitions; repetition++) {
+            samples.push_back(elapsed_ns(benchmark.function, iterations) / iterations);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        BenchResult result;
+        result.name = benchmark.name;
+        result.iterations = iterations;
+        result.ns_per_op = samples[samples.size() / 2];
+        result.min_ns_per_op = samples.front();
+        result.max_ns_per_op = samples.back();
+        return result;
+    }
+
+    static void print_json(FILE *json, const std::vector<BenchResult> &results) {
+        fprintf(json, "{\n");
+        fprintf(json, "  \"suite\": \"tsg_bench\",\n");
+        fprintf(json, "  \"mmgr_mode\": \"%s\",\n", TSG_BENCH_MMGR_MODE);
+        fprintf(json, "  \"benchmarks\": [\n");
+        for (size_t index = 0; index < results.size(); index++) {
+            const BenchResult &result = results[index];
+            fprintf(json, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, "
+                   "\"max_ns_per_op\": %.2f}%s\n",
+                   result.name.c_str(), (unsigned long long)result.iterations, result.ns_per_op,
+                   result.min_ns_per_op, result.max_ns_per_op, index + 1 < results.size() ? "," : "");
+        }
+        fprintf(json, "  ]\n");
+        fprintf(json, "}\n");
+    }
+
+    std::vector<Benchmark> m_benchmarks;
+    double m_min_time_ms{20.0};
+};
+
+void register_base_benchmarks(BenchSuite &suite);
+
+void register_apdu_benchmarks(BenchSuite &suite);
+
+void register_file_reader_benchmarks(BenchSuite &suite);
+
+// Unix systems only, where the reader server is available
+void register_remote_benchmarks(BenchSuite &suite);
+
+// Unix systems only, against the pcscd mock daemon
+void register_pcscd_benchmarks(BenchSuite &suite);
+
+} // namespace bench
+} // namespace tsg
+
+#endif // TSG_BENCH_BENCH_HPP
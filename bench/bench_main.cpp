@@ -0,0 +1,16 @@
+// tsg_bench [filter] [--json path] - runs the benchmarks whose name contains 'filter', results go to a JSON file
+
+#include "bench.hpp"
+
+int main(int argc, char **argv) {
+    tsg::bench::BenchSuite suite;
+    tsg::bench::register_base_benchmarks(suite);
+    tsg::bench::register_apdu_benchmarks(suite);
+    tsg::bench::register_file_reader_benchmarks(suite);
+#ifdef TSG_BENCH_REMOTE
+    tsg::bench::register_remote_benchmarks(suite);
+    tsg::bench::register_pcscd_benchmarks(suite);
+#endif
+
+    return suite.run(argc, argv);
+}
@@ -0,0 +1,126 @@
+// Throughput of FileReader against the in-memory terminal, for each chunk mode and transport latency.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <tsg/smartcard/file_reader.hpp>
+#include <tsg/smartcard/memory_terminal.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+#include "bench.hpp"
+
+using namespace tsg::smartcard;
+
+namespace tsg {
+namespace bench {
+
+namespace {
+
+constexpr const char *k_terminal_name = "File Reader Terminal";
+constexpr size_t k_file_size = 20 * 1024;
+constexpr uint16_t k_file_id = 0xC000;
+constexpr uint8_t k_aid[] = {0xA0, 0x00, 0x00, 0x03, 0x08, 0x00, 0x00, 0x10, 0x00};
+
+struct BenchMode {
+    const char *name;
+    size_t max_short_ne;
+    bool extended_length;
+};
+
+struct BenchLatency {
+    const char *name;
+    uint32_t command_latency_us;
+};
+
+const BenchMode k_modes[] = {
+    {"short255", 255, false},
+    {"short256", 256, false},
+    {"extended", 256, true},
+};
+
+const BenchLatency k_latencies[] = {
+    {"0", 0},
+    {"100us", 100},
+    {"1ms", 1000},
+};
+
+struct FileReaderFixture {
+    FileReaderFixture() {
+        std::vector<uint8_t> content(k_file_size);
+        for (size_t index = 0; index < content.size(); index++) {
+            content[index] = (uint8_t)(index * 31 + 7);
+        }
+        terminal.add_application(k_aid, sizeof(k_aid));
+        terminal.add_file(k_file_id, 0x01, content.data(), content.size());
+
+        provider.initialize();
+        provider.add_virtual_terminal(k_terminal_name, &terminal);
+        provider.refresh();
+    }
+
+    ~FileReaderFixture() { provider.cleanup(); }
+
+    MemoryTerminal terminal;
+    SmartCardProvider provider;
+};
+
+FileReaderFixture &file_reader_fixture() {
+    static FileReaderFixture fixture;
+    return fixture;
+}
+
+// One read of the whole file per iteration; the connection is opened per run so that the terminal
+// configuration applies to the ATR the reader sees.
+void read_file(const BenchMode &mode, const BenchLatency &latency, uint64_t iterations) {
+    FileReaderFixture &fixture = file_reader_fixture();
+
+    MemoryTerminalConfig config;
+    config.max_short_ne = mode.max_short_ne;
+    config.extended_length = mode.extended_length;
+    config.command_latency_us = latency.command_latency_us;
+    fixture.terminal.set_config(config);
+
+    CardConnection connection = fixture.provider.create_card_connection(k_terminal_name);
+    if (!connection.is_valid() || connection.connect() != 0) {
+        fprintf(stderr, "ERROR - bench: cannot connect to the memory terminal\n");
+        return;
+    }
+    connection.set_apdu_trace_enabled(false);
+    connection.transmit(apdu::select_df_name(k_aid));
+    connection.transmit(apdu::select_file_id(k_file_id));
+
+    std::vector<uint8_t> buffer(k_file_size + 2);
+    FileReader reader(connection);
+    for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+        size_t size = 0;
+        if (reader.read(buffer.data(), buffer.size(), size) != 0 || size != k_file_size) {
+            fprintf(stderr, "ERROR - bench: %s read failed (%zu bytes)\n", mode.name, size);
+            break;
+        }
+        do_not_optimize(buffer.data());
+    }
+
+    connection.disconnect();
+    fixture.provider.destroy_card_connection(connection);
+}
+
+} // namespace
+
+void register_file_reader_benchmarks(BenchSuite &suite) {
+    for (auto &mode : k_modes) {
+        for (auto &latency : k_latencies) {
+            std::string name = std::string("file_reader/") + mode.name + "/" + latency.name;
+            const BenchMode *bench_mode = &mode;
+            const BenchLatency *bench_latency = &latency;
+            suite.add(name.c_str(),
+                      [bench_mode, bench_latency](uint64_t iterations) {
+                          read_file(*bench_mode, *bench_latency, iterations);
+                      },
+                      latency.command_latency_us > 0 ? 3 : 5);
+        }
+    }
+}
+
+} // namespace bench
+} // namespace tsg
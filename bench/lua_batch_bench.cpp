@@ -0,0 +1,101 @@
+// Binding overhead per APDU of the Lua interface: one transmit() call per command against
+// transmit_batch(), both compared with the native CardConnection::transmit() on the memory terminal.
+
+#include <chrono>
+#include <cstdio>
+
+#include <smartcard_lua.hpp>
+#include <tsg/smartcard/memory_terminal.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+using namespace tsg::smartcard;
+
+namespace {
+
+constexpr int k_commands = 200;
+constexpr int k_rounds = 200;
+
+const char *k_script = R"(
+    local sc = require("smartcard")
+    local cc, commands, rounds = ...
+    local verify = sc.CommandAPDU(0x00, 0x20, 0x00, 0x80)
+
+    local batch = {}
+    for i = 1, commands do
+        batch[i] = verify
+    end
+
+    local clock = os.clock
+    local response = sc.ResponseAPDU()
+    local start = clock()
+    for round = 1, rounds do
+        for i = 1, commands do
+            cc:transmit(verify, response)
+            if response:sw() ~= 0x9000 then error("unexpected status") end
+        end
+    end
+    local single = clock() - start
+
+    local options = { sw = 0x9000 }
+    start = clock()
+    for round = 1, rounds do
+        local result = cc:transmit_batch(batch, options)
+        if not result:ok() then error("unexpected status") end
+    end
+    local batched = clock() - start
+
+    return single, batched
+)";
+
+} // namespace
+
+int main() {
+    MemoryTerminal terminal;
+    SmartCardProvider provider;
+    provider.initialize();
+    provider.add_virtual_terminal("Memory Terminal", &terminal);
+    provider.refresh();
+
+    CardConnection connection = provider.create_card_connection("Memory Terminal");
+    if (!connection.is_valid() || connection.connect() != 0) {
+        fprintf(stderr, "cannot connect to the memory terminal\n");
+        return 1;
+    }
+    connection.set_apdu_trace_enabled(false);
+
+    const uint8_t verify[] = {0x00, 0x20, 0x00, 0x80};
+    auto start = std::chrono::steady_clock::now();
+    for (int index = 0; index < k_commands * k_rounds; index++) {
+        connection.transmit(verify, sizeof(verify));
+    }
+    double native = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    lua::preload_smartcard(L);
+    if (luaL_loadstring(L, k_script) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    lua::push_card_connection(L, &connection);
+    lua_pushinteger(L, k_commands);
+    lua_pushinteger(L, k_rounds);
+    if (lua_pcall(L, 3, 2, 0) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    double single = lua_tonumber(L, -2);
+    double batched = lua_tonumber(L, -1);
+    lua_close(L);
+
+    double apdus = (double)k_commands * k_rounds;
+    printf("%-16s %12s %14s\n", "path", "ns/apdu", "overhead ns");
+    printf("%-16s %12.1f %14s\n", "native", native * 1e9 / apdus, "-");
+    printf("%-16s %12.1f %14.1f\n", "lua transmit", single * 1e9 / apdus, (single - native) * 1e9 / apdus);
+    printf("%-16s %12.1f %14.1f\n", "lua batch", batched * 1e9 / apdus, (batched - native) * 1e9 / apdus);
+
+    provider.destroy_card_connection(connection);
+    provider.cleanup();
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Exchanges with the in-memory terminal through the pcscd protocol, PcscdTerminal talking to PcscdMock
+// on a Unix domain socket: the terminal alone and behind a card connection. Each iteration is one
+// command, to be compared with remote/read_binary_256_in_process.
+
+#include <vector>
+
+#include <tsg/smartcard/apdu_builder.hpp>
+#include <tsg/smartcard/memory_terminal.hpp>
+#include <tsg/smartcard/pcscd_mock.hpp>
+#include <tsg/smartcard/pcscd_terminal.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+#include "bench.hpp"
+
+using namespace tsg::smartcard;
+
+namespace tsg {
+namespace bench {
+
+namespace {
+
+constexpr const char *k_reader_name = "Mock Reader 0";
+constexpr const char *k_terminal_name = "Pcscd Bench Terminal";
+constexpr const char *k_socket_path = "tsg_bench_pcscd.sock";
+constexpr uint16_t k_file_id = 0x0101;
+constexpr uint8_t k_aid[] = {0xA0, 0x00, 0x00, 0x03, 0x08, 0x00, 0x00, 0x10, 0x00};
+
+struct PcscdFixture {
+    PcscdFixture() {
+        std::vector<uint8_t> content(1024);
+        for (size_t index = 0; index < content.size(); index++) {
+            content[index] = (uint8_t)index;
+        }
+        terminal.add_application(k_aid, sizeof(k_aid));
+        terminal.add_file(k_file_id, 0x01, content.data(), content.size());
+        mock.add_reader(k_reader_name, &terminal);
+        mock.start(k_socket_path);
+
+        PcscdTerminalConfig config;
+        config.socket_path = k_socket_path;
+        pcscd.open(k_reader_name, config);
+        provider.add_virtual_terminal(k_terminal_name, &pcscd);
+        provider.refresh();
+
+        connection = provider.create_card_connection(k_terminal_name);
+        connection.set_apdu_trace_enabled(false);
+        connection.connect();
+        connection.transmit(apdu::select_df_name(k_aid));
+        connection.transmit(apdu::select_file_id(k_file_id));
+    }
+
+    ~PcscdFixture() {
+        provider.destroy_card_connection(connection);
+        pcscd.close();
+        mock.stop();
+    }
+
+    MemoryTerminal terminal;
+    PcscdMock mock;
+    PcscdTerminal pcscd;
+    SmartCardProvider provider;
+    CardConnection connection;
+};
+
+PcscdFixture &pcscd_fixture() {
+    static PcscdFixture fixture;
+    return fixture;
+}
+
+} // namespace
+
+void register_pcscd_benchmarks(BenchSuite &suite) {
+    suite.add("pcscd/read_binary_256", [](uint64_t iterations) {
+        PcscdTerminal &pcscd = pcscd_fixture().pcscd;
+        auto capdu = apdu::read_binary(0, 256);
+        uint8_t response[258];
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            size_t response_size = sizeof(response);
+            pcscd.transmit(capdu.data(), capdu.size(), response, response_size);
+            do_not_optimize(response);
+        }
+    });
+
+    suite.add("pcscd/read_binary_256_card_connection", [](uint64_t iterations) {
+        CardConnection &connection = pcscd_fixture().connection;
+        auto capdu = apdu::read_binary(0, 256);
+        uint8_t response[258];
+        for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+            size_t response_size = sizeof(response);
+            connection.transmit(capdu.data(), capdu.size(), response, response_size);
+            do_not_optimize(response);
+        }
+    });
+}
+
+} // namespace bench
+} // namespace tsg
@@ -0,0 +1,156 @@
+// Exchanges with the in-memory terminal through a ReaderServer on a Unix domain socket: one command per
+// request, pipelined and batched, then through rings in shared memory, against the terminal called
+// directly in process. Each iteration is one command. The client is a thread of the bench, the rings
+// being exchanged the same way with a worker process.
+
+#include <string>
+#include <vector>
+
+#include <tsg/smartcard/apdu_builder.hpp>
+#include <tsg/smartcard/memory_terminal.hpp>
+#include <tsg/smartcard/reader_server.hpp>
+#include <tsg/smartcard/remote_terminal.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+#include "bench.hpp"
+
+using namespace tsg::smartcard;
+
+namespace tsg {
+namespace bench {
+
+namespace {
+
+constexpr const char *k_terminal_name = "Remote Bench Terminal";
+constexpr const char *k_shared_terminal_name = "Remote Bench Shared Terminal";
+constexpr const char *k_socket_path = "tsg_bench_reader.sock";
+constexpr uint16_t k_file_id = 0x0101;
+constexpr uint8_t k_aid[] = {0xA0, 0x00, 0x00, 0x03, 0x08, 0x00, 0x00, 0x10, 0x00};
+
+// Commands in flight when pipelining, and per batch
+constexpr size_t k_window = 32;
+
+void select_file(VirtualTerminal &terminal) {
+    ATR atr;
+    CardConnection::CommunicationProtocol protocol;
+    terminal.power_on(CardConnection::reset_type_cold, atr, protocol);
+
+    uint8_t response[258];
+    size_t response_size = sizeof(response);
+    auto select_application = apdu::select_df_name(k_aid);
+    terminal.transmit(select_application.data(), select_application.size(), response, response_size);
+    response_size = sizeof(response);
+    auto select_file = apdu::select_file_id(k_file_id);
+    terminal.transmit(select_file.data(), select_file.size(), response, response_size);
+}
+
+struct RemoteFixture {
+    RemoteFixture() : server(provider) {
+        std::vector<uint8_t> content(1024);
+        for (size_t index = 0; index < content.size(); index++) {
+            content[index] = (uint8_t)index;
+        }
+        for (MemoryTerminal *memory : {&terminal, &shared_terminal, &local_terminal}) {
+            memory->add_application(k_aid, sizeof(k_aid));
+            memory->add_file(k_file_id, 0x01, content.data(), content.size());
+        }
+
+        provider.add_virtual_terminal(k_terminal_name, &terminal);
+        provider.add_virtual_terminal(k_shared_terminal_name, &shared_terminal);
+        provider.refresh();
+        server.start(k_socket_path);
+
+        remote.open(k_socket_path, k_terminal_name);
+        select_file(remote);
+        shared_remote.open(k_socket_path, k_shared_terminal_name);
+        shared_remote.use_shared_memory();
+        select_file(shared_remote);
+        select_file(local_terminal);
+    }
+
+    ~RemoteFixture() {
+        remote.close();
+        shared_remote.close();
+        server.stop();
+    }
+
+    MemoryTerminal terminal;
+    MemoryTerminal shared_terminal;
+    MemoryTerminal local_terminal;
+    SmartCardProvider provider;
+    ReaderServer server;
+    RemoteTerminal remote;
+    RemoteTerminal shared_remote;
+};
+
+RemoteFixture &remote_fixture() {
+    static RemoteFixture fixture;
+    return fixture;
+}
+
+void run_read_binary(VirtualTerminal &terminal, uint64_t iterations) {
+    auto capdu = apdu::read_binary(0, 256);
+    uint8_t response[258];
+    for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+        size_t response_size = sizeof(response);
+        terminal.transmit(capdu.data(), capdu.size(), response, response_size);
+        do_not_optimize(response);
+    }
+}
+
+void run_read_binary_pipelined(RemoteTerminal &remote, uint64_t iterations) {
+    auto capdu = apdu::read_binary(0, 256);
+    uint8_t response[258];
+    uint64_t sent = 0;
+    for (uint64_t received = 0; received < iterations; received++) {
+        while (sent < iterations && sent - received < k_window) {
+            remote.send_transmit(capdu.data(), capdu.size());
+            sent++;
+        }
+        size_t response_size = sizeof(response);
+        remote.receive_transmit(response, response_size);
+        do_not_optimize(response);
+    }
+}
+
+} // namespace
+
+void register_remote_benchmarks(BenchSuite &suite) {
+    suite.add("remote/read_binary_256_in_process",
+              [](uint64_t iterations) { run_read_binary(remote_fixture().local_terminal, iterations); });
+
+    suite.add("remote/read_binary_256",
+              [](uint64_t iterations) { run_read_binary(remote_fixture().remote, iterations); });
+
+    suite.add("remote/read_binary_256_pipelined",
+              [](uint64_t iterations) { run_read_binary_pipelined(remote_fixture().remote, iterations); });
+
+    suite.add("remote/read_binary_256_shared_memory",
+              [](uint64_t iterations) { run_read_binary(remote_fixture().shared_remote, iterations); });
+
+    suite.add("remote/read_binary_256_shared_memory_pipelined",
+              [](uint64_t iterations) { run_read_binary_pipelined(remote_fixture().shared_remote, iterations); });
+
+    suite.add("remote/read_binary_256_batched", [](uint64_t iterations) {
+        RemoteTerminal &remote = remote_fixture().remote;
+        auto capdu = apdu::read_binary(0, 256);
+        std::vector<uint8_t> responses(k_window * 258);
+        RemoteCommand commands[k_window];
+        for (uint64_t done = 0; done < iterations;) {
+            size_t count = (iterations - done) < k_window ? (size_t)(iterations - done) : k_window;
+            for (size_t index = 0; index < count; index++) {
+                commands[index].capdu = capdu.data();
+                commands[index].capdu_size = capdu.size();
+                commands[index].response = &responses[index * 258];
+                commands[index].response_size = 258;
+            }
+            size_t completed = 0;
+            remote.transmit_batch(commands, count, completed);
+            do_not_optimize(responses.data());
+            done += count;
+        }
+    });
+}
+
+} // namespace bench
+} // namespace tsg
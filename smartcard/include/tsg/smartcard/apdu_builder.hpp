@@ -0,0 +1,308 @@
+#ifndef TSG_SMARTCARD_APDU_BUILDER_HPP
+#define TSG_SMARTCARD_APDU_BUILDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <tsg/base/byte_array.hpp>
+
+#include "command_apdu.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+// ISO/IEC 7816-3 command cases
+//   case 1 : CLA INS P1 P2
+//   case 2 : CLA INS P1 P2 Le
+//   case 3 : CLA INS P1 P2 Lc Data
+//   case 4 : CLA INS P1 P2 Lc Data Le
+enum APDUCase {
+    apdu_case_1 = 1,
+    apdu_case_2 = 2,
+    apdu_case_3 = 3,
+    apdu_case_4 = 4,
+};
+
+enum APDULengthForm {
+    apdu_length_short,
+    apdu_length_extended,
+};
+
+constexpr size_t k_max_short_nc = 255;
+constexpr size_t k_max_short_ne = 256;
+constexpr size_t k_max_extended_nc = 65535;
+constexpr size_t k_max_extended_ne = 65536;
+constexpr size_t k_max_short_capdu_length = 4 + 1 + k_max_short_nc + 1;
+
+namespace priv {
+
+template <APDUCase C, APDULengthForm F, size_t Nc> struct APDULayout {
+    static constexpr bool has_data = (C == apdu_case_3 || C == apdu_case_4);
+    static constexpr bool has_le = (C == apdu_case_2 || C == apdu_case_4);
+    static constexpr bool extended = (F == apdu_length_extended);
+
+    static_assert(has_data || Nc == 0, "case 1 and case 2 commands carry no command data");
+    static_assert(!has_data || Nc > 0, "case 3 and case 4 commands require command data");
+    static_assert(Nc <= (extended ? k_max_extended_nc : k_max_short_nc), "command data does not fit the length form");
+
+    static constexpr size_t lc_size = has_data ? (extended ? 3 : 1) : 0;
+    static constexpr size_t le_size = has_le ? (extended ? (has_data ? 2 : 3) : 1) : 0;
+
+    static constexpr size_t lc_offset = 4;
+    static constexpr size_t data_offset = lc_offset + lc_size;
+    static constexpr size_t le_offset = data_offset + Nc;
+    static constexpr size_t size = le_offset + le_size;
+
+    static constexpr size_t max_ne = extended ? k_max_extended_ne : k_max_short_ne;
+};
+
+} // namespace priv
+
+// Command APDU whose case and length form are fixed at compile time. The encoded size and
+// the offsets of every field are constants, so the command lives in fixed storage and is
+// assembled without branches or heap allocation.
+template <APDUCase C, APDULengthForm F = apdu_length_short, size_t Nc = 0> class TypedCommandAPDU {
+  public:
+    using layout_type = priv::APDULayout<C, F, Nc>;
+    using value_type = uint8_t;
+    using pointer_type = value_type *;
+    using const_pointer_type = const value_type *;
+    using size_type = size_t;
+
+    static constexpr APDUCase apdu_case = C;
+    static constexpr APDULengthForm length_form = F;
+    static constexpr size_type data_size = Nc;
+    static constexpr size_type encoded_size = layout_type::size;
+
+    // Zero-length arrays are ill-formed, case 1 and case 2 keep a placeholder extent
+    using data_array_type = const value_type (&)[Nc > 0 ? Nc : 1];
+
+  public:
+    constexpr TypedCommandAPDU() : TypedCommandAPDU(0x00, 0x00, 0x00, 0x00) {}
+
+    constexpr TypedCommandAPDU(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2) {
+        m_bytes[0] = cla;
+        m_bytes[1] = ins;
+        m_bytes[2] = p1;
+        m_bytes[3] = p2;
+
+        if constexpr (layout_type::has_data) {
+            if constexpr (layout_type::extended) {
+                m_bytes[layout_type::lc_offset + 0] = 0x00;
+                m_bytes[layout_type::lc_offset + 1] = (uint8_t)(Nc >> 8);
+                m_bytes[layout_type::lc_offset + 2] = (uint8_t)(Nc & 0xFF);
+            } else {
+                m_bytes[layout_type::lc_offset] = (uint8_t)Nc;
+            }
+        }
+
+        if constexpr (layout_type::has_le) {
+            set_le(layout_type::max_ne);
+        }
+    }
+
+    constexpr TypedCommandAPDU(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2, size_type ne)
+        : TypedCommandAPDU(cla, ins, p1, p2) {
+        set_le(ne);
+    }
+
+    constexpr TypedCommandAPDU(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2, data_array_type data)
+        : TypedCommandAPDU(cla, ins, p1, p2) {
+        set_data(&data[0]);
+    }
+
+    constexpr TypedCommandAPDU(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2, data_array_type data, size_type ne)
+        : TypedCommandAPDU(cla, ins, p1, p2) {
+        set_data(&data[0]);
+        set_le(ne);
+    }
+
+    constexpr TypedCommandAPDU &set_cla(uint8_t cla) {
+        m_bytes[0] = cla;
+        return *this;
+    }
+
+    constexpr TypedCommandAPDU &set_ins(uint8_t ins) {
+        m_bytes[1] = ins;
+        return *this;
+    }
+
+    constexpr TypedCommandAPDU &set_p1(uint8_t p1) {
+        m_bytes[2] = p1;
+        return *this;
+    }
+
+    constexpr TypedCommandAPDU &set_p2(uint8_t p2) {
+        m_bytes[3] = p2;
+        return *this;
+    }
+
+    // Copies exactly data_size bytes from data
+    constexpr TypedCommandAPDU &set_data(const_pointer_type data) {
+        static_assert(layout_type::has_data, "only case 3 and case 4 commands carry command data");
+        for (size_type index = 0; index < Nc; index++) {
+            m_bytes[layout_type::data_offset + index] = data[index];
+        }
+        return *this;
+    }
+
+    // Ne is the number of expected response bytes, zero or the maximum of the length form being encoded as zero
+    constexpr TypedCommandAPDU &set_le(size_type ne) {
+        static_assert(layout_type::has_le, "only case 2 and case 4 commands carry Le");
+        size_type encoded_ne = (ne >= layout_type::max_ne) ? 0 : ne;
+        if constexpr (layout_type::extended) {
+            if constexpr (!layout_type::has_data) {
+                m_bytes[layout_type::le_offset] = 0x00;
+            }
+            m_bytes[encoded_size - 2] = (uint8_t)(encoded_ne >> 8);
+            m_bytes[encoded_size - 1] = (uint8_t)(encoded_ne & 0xFF);
+        } else {
+            m_bytes[layout_type::le_offset] = (uint8_t)encoded_ne;
+        }
+        return *this;
+    }
+
+    constexpr uint8_t cla() const { return m_bytes[0]; }
+
+    constexpr uint8_t ins() const { return m_bytes[1]; }
+
+    constexpr uint8_t p1() const { return m_bytes[2]; }
+
+    constexpr uint8_t p2() const { return m_bytes[3]; }
+
+    constexpr size_type ne() const {
+        if constexpr (!layout_type::has_le) {
+            return 0;
+        } else if constexpr (layout_type::extended) {
+            size_type value = ((size_type)m_bytes[encoded_size - 2] << 8) | m_bytes[encoded_size - 1];
+            return value == 0 ? layout_type::max_ne : value;
+        } else {
+            size_type value = m_bytes[layout_type::le_offset];
+            return value == 0 ? layout_type::max_ne : value;
+        }
+    }
+
+    constexpr pointer_type command_data() { return &m_bytes[layout_type::data_offset]; }
+
+    constexpr const_pointer_type command_data() const { return &m_bytes[layout_type::data_offset]; }
+
+    static constexpr size_type size() { return encoded_size; }
+
+    constexpr pointer_type data() { return m_bytes.data(); }
+
+    constexpr const_pointer_type data() const { return m_bytes.data(); }
+
+    constexpr pointer_type begin() { return m_bytes.begin(); }
+
+    constexpr const_pointer_type begin() const { return m_bytes.begin(); }
+
+    constexpr pointer_type end() { return m_bytes.end(); }
+
+    constexpr const_pointer_type end() const { return m_bytes.end(); }
+
+    constexpr uint8_t &operator[](size_type i) { return m_bytes[i]; }
+
+    constexpr const uint8_t &operator[](size_type i) const { return m_bytes[i]; }
+
+    // Heap copy for code paths still taking a CommandAPDU
+    CommandAPDU to_command_apdu() const { return CommandAPDU((uint8_t *)data(), size()); }
+
+  private:
+    ByteArray<encoded_size> m_bytes{};
+};
+
+namespace apdu {
+
+enum Instruction : uint8_t {
+    ins_verify = 0x20,
+    ins_read_binary = 0xB0,
+    ins_read_binary_odd = 0xB1,
+    ins_read_record = 0xB2,
+    ins_get_response = 0xC0,
+    ins_get_data = 0xCA,
+    ins_select = 0xA4,
+};
+
+enum SelectP1 : uint8_t {
+    select_p1_file_id = 0x00,
+    select_p1_child_df = 0x01,
+    select_p1_ef_under_current_df = 0x02,
+    select_p1_parent_df = 0x03,
+    select_p1_df_name = 0x04,
+    select_p1_path_from_mf = 0x08,
+    select_p1_path_from_current_df = 0x09,
+};
+
+enum SelectP2 : uint8_t {
+    select_p2_first_or_only = 0x00,
+    select_p2_next = 0x02,
+    select_p2_return_fci = 0x00,
+    select_p2_return_fcp = 0x04,
+    select_p2_return_fmd = 0x08,
+    select_p2_no_response_data = 0x0C,
+};
+
+template <size_t N>
+constexpr TypedCommandAPDU<apdu_case_4, apdu_length_short, N>
+select_df_name(const uint8_t (&aid)[N], uint8_t p2 = select_p2_first_or_only | select_p2_return_fci,
+               size_t ne = k_max_short_ne) {
+    return TypedCommandAPDU<apdu_case_4, apdu_length_short, N>(0x00, ins_select, select_p1_df_name, p2, aid, ne);
+}
+
+constexpr TypedCommandAPDU<apdu_case_3, apdu_length_short, 2>
+select_file_id(uint16_t file_id, uint8_t p1 = select_p1_file_id, uint8_t p2 = select_p2_no_response_data) {
+    const uint8_t fid[2] = {(uint8_t)(file_id >> 8), (uint8_t)(file_id & 0xFF)};
+    return TypedCommandAPDU<apdu_case_3, apdu_length_short, 2>(0x00, ins_select, p1, p2, fid);
+}
+
+template <size_t N>
+constexpr TypedCommandAPDU<apdu_case_3, apdu_length_short, N>
+select_path(const uint8_t (&path)[N], uint8_t p1 = select_p1_path_from_mf, uint8_t p2 = select_p2_no_response_data) {
+    static_assert(N % 2 == 0, "a path is a sequence of two byte file identifiers");
+    return TypedCommandAPDU<apdu_case_3, apdu_length_short, N>(0x00, ins_select, p1, p2, path);
+}
+
+// Offset is limited to 15 bits, P1 bit 8 being reserved for the short EF identifier form
+template <APDULengthForm F = apdu_length_short>
+constexpr TypedCommandAPDU<apdu_case_2, F> read_binary(uint16_t offset, size_t ne) {
+    return TypedCommandAPDU<apdu_case_2, F>(0x00, ins_read_binary, (uint8_t)((offset >> 8) & 0x7F),
+                                            (uint8_t)(offset & 0xFF), ne);
+}
+
+template <APDULengthForm F = apdu_length_short>
+constexpr TypedCommandAPDU<apdu_case_2, F> read_binary_sfi(uint8_t sfi, uint8_t offset, size_t ne) {
+    return TypedCommandAPDU<apdu_case_2, F>(0x00, ins_read_binary, (uint8_t)(0x80 | (sfi & 0x1F)), offset, ne);
+}
+
+// Reads record number 'record' of the EF referenced by 'sfi', zero meaning the current EF
+template <APDULengthForm F = apdu_length_short>
+constexpr TypedCommandAPDU<apdu_case_2, F> read_record(uint8_t record, uint8_t sfi = 0, size_t ne = 0) {
+    return TypedCommandAPDU<apdu_case_2, F>(0x00, ins_read_record, record, (uint8_t)(((sfi & 0x1F) << 3) | 0x04),
+                                            ne);
+}
+
+template <APDULengthForm F = apdu_length_short>
+constexpr TypedCommandAPDU<apdu_case_2, F> get_data(uint16_t tag, size_t ne = 0) {
+    return TypedCommandAPDU<apdu_case_2, F>(0x00, ins_get_data, (uint8_t)(tag >> 8), (uint8_t)(tag & 0xFF),
+                                            ne);
+}
+
+template <size_t N>
+constexpr TypedCommandAPDU<apdu_case_3, apdu_length_short, N> verify(uint8_t reference, const uint8_t (&pin)[N]) {
+    return TypedCommandAPDU<apdu_case_3, apdu_length_short, N>(0x00, ins_verify, 0x00, reference, pin);
+}
+
+// Case 1 VERIFY, answered with the verification status (9000 or 63Cx retries left)
+constexpr TypedCommandAPDU<apdu_case_1> verify_status(uint8_t reference) {
+    return TypedCommandAPDU<apdu_case_1>(0x00, ins_verify, 0x00, reference);
+}
+
+constexpr TypedCommandAPDU<apdu_case_2> get_response(uint8_t ne) {
+    return TypedCommandAPDU<apdu_case_2>(0x00, ins_get_response, 0x00, 0x00, ne);
+}
+
+} // namespace apdu
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_APDU_BUILDER_HPP
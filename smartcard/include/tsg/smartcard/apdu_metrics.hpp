@@ -0,0 +1,129 @@
+#ifndef TSG_SMARTCARD_APDU_METRICS_HPP
+#define TSG_SMARTCARD_APDU_METRICS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace tsg {
+namespace smartcard {
+
+struct LatencySnapshot {
+    uint64_t count{0};
+    uint64_t min_ns{0};
+    uint64_t max_ns{0};
+    double mean_ns{0};
+    uint64_t p50_ns{0};
+    uint64_t p90_ns{0};
+    uint64_t p99_ns{0};
+    uint64_t p999_ns{0};
+};
+
+// Log-bucketed latency histogram (HDR style): values are grouped by power of two, each split in
+// k_sub_bucket_count linear sub-buckets, so that a reported percentile is within 1/16 of the recorded
+// value. Values beyond k_max_exponent saturate in the last bucket.
+//
+// A single thread records at a time, snapshots may be taken concurrently from any thread. Counters are
+// relaxed atomics, a snapshot is therefore consistent per bucket but not across buckets.
+class LatencyHistogram {
+  public:
+    static constexpr uint32_t k_sub_bucket_bits = 4;
+    static constexpr uint32_t k_sub_bucket_count = 1 << k_sub_bucket_bits;
+    static constexpr uint32_t k_max_exponent = 40;
+    static constexpr size_t k_bucket_count = (k_max_exponent - k_sub_bucket_bits + 2) * k_sub_bucket_count;
+
+    LatencyHistogram() {}
+
+    void record(uint64_t value_ns);
+
+    LatencySnapshot snapshot() const;
+
+    static size_t bucket_of(uint64_t value);
+
+    // Highest value falling in 'bucket'
+    static uint64_t bucket_upper_bound(size_t bucket);
+
+  private:
+    std::atomic<uint64_t> m_buckets[k_bucket_count] = {};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_min{UINT64_MAX};
+    std::atomic<uint64_t> m_max{0};
+};
+
+struct APDUMetricsSnapshot {
+    uint64_t commands{0};
+    uint64_t failures{0};
+    uint64_t round_trips{0};
+    uint64_t bytes_out{0};
+    uint64_t bytes_in{0};
+
+    // Commands resent with the Le indicated by a 6Cxx
+    uint64_t retries{0};
+
+    // GET RESPONSE sent after a 61xx
+    uint64_t chaining_rounds{0};
+
+    LatencySnapshot latency;
+
+    // connect() and reconnect(), failed ones counted but not timed
+    uint64_t connects{0};
+    uint64_t connect_failures{0};
+    LatencySnapshot connect_latency;
+
+    // From the card being detected (or the connect when not known) to the first round-trip after it
+    LatencySnapshot time_to_first_apdu;
+};
+
+// Always-on instrumentation of the exchanges of a connection: one latency histogram for every
+// command, one per INS byte (allocated on first use) and traffic counters. Recording follows the
+// single thread transmitting on the connection, get_snapshot() and get_instruction_snapshot() may
+// be called from any thread without locking.
+class APDUMetrics {
+  public:
+    APDUMetrics() {}
+
+    ~APDUMetrics();
+
+    APDUMetrics(const APDUMetrics &) = delete;
+
+    APDUMetrics &operator=(const APDUMetrics &) = delete;
+
+    void record_round_trip(size_t capdu_size, size_t rapdu_size);
+
+    void record_command(uint8_t ins, uint64_t latency_ns, uint32_t retries, uint32_t chaining_rounds, bool failed);
+
+    void record_connect(uint64_t latency_ns, bool failed);
+
+    void record_time_to_first_apdu(uint64_t elapsed_ns);
+
+    APDUMetricsSnapshot get_snapshot() const;
+
+    // Returns -1 when no command with this INS was recorded
+    int32_t get_instruction_snapshot(uint8_t ins, LatencySnapshot &snapshot) const;
+
+  private:
+    static void add(std::atomic<uint64_t> &counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram m_latency;
+    std::atomic<LatencyHistogram *> m_instructions[256] = {};
+
+    std::atomic<uint64_t> m_commands{0};
+    std::atomic<uint64_t> m_failures{0};
+    std::atomic<uint64_t> m_round_trips{0};
+    std::atomic<uint64_t> m_bytes_out{0};
+    std::atomic<uint64_t> m_bytes_in{0};
+    std::atomic<uint64_t> m_retries{0};
+    std::atomic<uint64_t> m_chaining_rounds{0};
+
+    LatencyHistogram m_connect_latency;
+    LatencyHistogram m_time_to_first_apdu;
+    std::atomic<uint64_t> m_connects{0};
+    std::atomic<uint64_t> m_connect_failures{0};
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_APDU_METRICS_HPP
@@ -0,0 +1,152 @@
+#ifndef TSG_SMARTCARD_APDU_TRACE_HPP
+#define TSG_SMARTCARD_APDU_TRACE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "atr.hpp"
+#include "card_connection.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+// APDU session trace file, append-only and little-endian:
+//
+//   file header    magic "TSGTRACE", u16 version, u16 header size, u32 reserved
+//   record header  u32 record size (header included), u8 type, u8 flags, u16 reserved,
+//                  u64 timestamp (ns since the session record)
+//   session        u64 wall clock (ns since the Unix epoch), u16 terminal name size, u16 reserved,
+//                  terminal name
+//   connect        u8 protocol, u8 reserved, u16 reserved, u32 ATR size, ATR
+//   exchange       u32 latency (ns), u32 C-APDU size, u32 R-APDU size, C-APDU, R-APDU
+//   disconnect     no body
+//
+// Every round-trip is an exchange record, GET RESPONSE and Le retries included. A truncated last
+// record (e.g. the process died before the writer was closed) is ignored by the reader.
+enum TraceRecordType : uint8_t {
+    trace_record_session = 0x01,
+    trace_record_connect = 0x02,
+    trace_record_exchange = 0x03,
+    trace_record_disconnect = 0x04,
+};
+
+enum TraceRecordFlags : uint8_t {
+    trace_flag_transmit_failed = 0x01,
+};
+
+constexpr char k_trace_magic[8] = {'T', 'S', 'G', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint16_t k_trace_version = 1;
+constexpr size_t k_trace_file_header_size = 16;
+constexpr size_t k_trace_record_header_size = 16;
+
+// Writes a trace through an in-memory buffer, flushed when it fills up and on close. The buffer holds
+// the largest exchange record (extended C-APDU and R-APDU).
+class TraceWriter {
+  public:
+    static constexpr size_t k_buffer_size = 256 * 1024;
+
+    TraceWriter() {}
+
+    ~TraceWriter() { close(); }
+
+    TraceWriter(const TraceWriter &) = delete;
+
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    // Truncates 'path' and writes the file header and the session record
+    int32_t open(const char *path, const char *terminal_name);
+
+    int32_t close();
+
+    bool is_open() const { return m_file != nullptr; }
+
+    int32_t flush();
+
+    void write_connect(const ATR &atr, CardConnection::CommunicationProtocol protocol);
+
+    void write_exchange(std::chrono::steady_clock::time_point start, uint64_t latency_ns, const uint8_t *capdu,
+                        size_t capdu_size, const uint8_t *rapdu, size_t rapdu_size, bool failed);
+
+    void write_disconnect();
+
+    uint64_t get_record_count() const { return m_record_count; }
+
+  private:
+    uint8_t *append_record(TraceRecordType type, uint8_t flags, uint64_t timestamp_ns, size_t body_size);
+
+    uint64_t timestamp_of(std::chrono::steady_clock::time_point time) const;
+
+    FILE *m_file{nullptr};
+    uint8_t *m_buffer{nullptr};
+    size_t m_buffer_size{0};
+    std::chrono::steady_clock::time_point m_start;
+    uint64_t m_record_count{0};
+};
+
+// A record as found in the mapped file, the byte fields pointing into the mapping
+struct TraceRecord {
+    TraceRecordType type{trace_record_session};
+    uint8_t flags{0};
+    uint64_t timestamp_ns{0};
+
+    // session
+    uint64_t wall_clock_ns{0};
+    const char *terminal_name{nullptr};
+    size_t terminal_name_size{0};
+
+    // connect
+    CardConnection::CommunicationProtocol protocol{CardConnection::com_protocol_t_none};
+    const uint8_t *atr{nullptr};
+    size_t atr_size{0};
+
+    // exchange
+    uint32_t latency_ns{0};
+    const uint8_t *capdu{nullptr};
+    size_t capdu_size{0};
+    const uint8_t *rapdu{nullptr};
+    size_t rapdu_size{0};
+};
+
+// Maps a trace file read-only and walks its records without copying them
+class TraceReader {
+  public:
+    TraceReader() {}
+
+    ~TraceReader() { close(); }
+
+    TraceReader(const TraceReader &) = delete;
+
+    TraceReader &operator=(const TraceReader &) = delete;
+
+    int32_t open(const char *path);
+
+    void close();
+
+    bool is_open() const { return m_data != nullptr; }
+
+    // Returns false at the end of the trace, or on a truncated or malformed record
+    bool next(TraceRecord &record);
+
+    void rewind() { m_offset = m_header_size; }
+
+    const uint8_t *data() const { return m_data; }
+
+    size_t size() const { return m_size; }
+
+  private:
+    const uint8_t *m_data{nullptr};
+    size_t m_size{0};
+    size_t m_header_size{0}; // as written in the file, later versions may extend it
+    size_t m_offset{0};
+
+    // Platform mapping handles
+    void *m_file_handle{nullptr};
+    void *m_mapping_handle{nullptr};
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_APDU_TRACE_HPP
@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 
 namespace tsg {
 namespace smartcard {
@@ -22,7 +23,7 @@ class ATR {
         m_size = size;
     }
 
-    ~ATR() {}
+    ~ATR() = default; // keeps ATR a literal type, ATR().capacity() sizing arrays
 
     void swap(ATR &other) {
         std::swap(m_data, other.m_data);
@@ -68,6 +69,69 @@ class ATR {
 
     constexpr const uint8_t *data() const { return m_data; }
 
+    // Locates the historical bytes by walking T0 and the TDi interface bytes (ISO/IEC 7816-3)
+    constexpr bool get_historical_bytes(size_t &offset, size_t &count) const {
+        if (m_size < 2) {
+            return false;
+        }
+
+        size_t index = 1;
+        uint8_t y = m_data[1] >> 4;
+        count = m_data[1] & 0x0F;
+        while (index < m_size) {
+            size_t next = index + 1;
+            next += ((y & 0x01) ? 1 : 0) + ((y & 0x02) ? 1 : 0) + ((y & 0x04) ? 1 : 0);
+            if ((y & 0x08) == 0) {
+                index = next;
+                break;
+            }
+            if (next >= m_size) {
+                return false;
+            }
+            y = m_data[next] >> 4; // TDi
+            index = next;
+        }
+
+        if (index + count > m_size) {
+            return false;
+        }
+        offset = index;
+        return true;
+    }
+
+    // Card capabilities (compact-TLV tag 7) of historical bytes in category 0x80 format
+    constexpr bool get_card_capabilities(const uint8_t *&capabilities, size_t &count) const {
+        size_t offset = 0;
+        size_t hist_count = 0;
+        if (!get_historical_bytes(offset, hist_count) || hist_count == 0 || m_data[offset] != 0x80) {
+            return false;
+        }
+
+        size_t index = offset + 1;
+        size_t end = offset + hist_count;
+        while (index < end) {
+            uint8_t tag = m_data[index] >> 4;
+            size_t length = m_data[index] & 0x0F;
+            if (index + 1 + length > end) {
+                return false;
+            }
+            if (tag == 0x7) {
+                capabilities = &m_data[index + 1];
+                count = length;
+                return true;
+            }
+            index += 1 + length;
+        }
+        return false;
+    }
+
+    // Extended Lc and Le fields, third software function table byte, bit 7
+    constexpr bool supports_extended_length() const {
+        const uint8_t *capabilities = nullptr;
+        size_t count = 0;
+        return get_card_capabilities(capabilities, count) && count >= 3 && (capabilities[2] & 0x40) != 0;
+    }
+
   private:
     static const size_t m_max_size = 42;
     uint8_t m_data[m_max_size] = {};
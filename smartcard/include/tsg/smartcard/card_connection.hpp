@@ -1,9 +1,18 @@
 #ifndef TSG_SMARTCARD_CARD_CONNECTION_HPP
 #define TSG_SMARTCARD_CARD_CONNECTION_HPP
 
+#include "apdu_builder.hpp"
+#include "apdu_metrics.hpp"
 #include "atr.hpp"
 #include "command_apdu.hpp"
+#include "read_cache.hpp"
+#include "reader_capabilities.hpp"
+#include "recovery_policy.hpp"
+#include "selection_tracker.hpp"
 #include "response_apdu.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
 
 namespace tsg {
 namespace smartcard {
@@ -27,6 +36,14 @@ class CardConnection {
         com_protocol_t_1,
     };
 
+    enum ShareMode {
+        share_mode_shared,
+        // No other application may connect to the card while this connection is open
+        share_mode_exclusive,
+    };
+
+    static constexpr uint32_t k_wait_forever = UINT32_MAX;
+
   public:
     CardConnection();
 
@@ -40,12 +57,52 @@ class CardConnection {
 
     int32_t connect();
 
+    // reset_type_none recovers the handle (e.g. after another application reset the card) leaving the
+    // card as it is
     int32_t reconnect(ResetType reset_type);
 
     int32_t disconnect();
 
+    // Applies from the next connect() or reconnect()
+    void set_share_mode(ShareMode share_mode);
+
+    ShareMode get_share_mode() const;
+
+    // Locks the card for this connection until the matching end_transaction(), so that a sequence of
+    // commands runs without other applications interleaving theirs and without the resource manager
+    // arbitrating the reader for every one. Nested calls only count. Returns 0 once locked, 1 when
+    // another application kept the reader exclusively for 'timeout_ms', -1 on error.
+    int32_t begin_transaction(uint32_t timeout_ms = k_wait_forever);
+
+    // A reset requested by any of the nested scopes is applied when the outermost one ends
+    int32_t end_transaction(ResetType reset_type = reset_type_none);
+
+    uint32_t get_transaction_depth() const;
+
+    // Short form responses only (k_max_rapdu_length bytes), a longer one being reported as an error with
+    // an empty response: commands with an extended Le go through the (response, response_size) overload
     ResponseAPDU transmit(CommandAPDU &capdu);
 
+    ResponseAPDU transmit(const uint8_t *capdu, size_t capdu_size);
+
+    template <APDUCase C, APDULengthForm F, size_t Nc> ResponseAPDU transmit(const TypedCommandAPDU<C, F, Nc> &capdu) {
+        return transmit(capdu.data(), capdu.size());
+    }
+
+    // Receives the response (data and SW1 SW2) in place, 'response_size' holding the capacity of
+    // 'response' on input. Responses are not limited to the short form, nor served from the read cache.
+    int32_t transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size);
+
+    // Starts the exchange on the connection's own thread and returns at once, 'on_complete' being called
+    // from that thread when the response is available. No other call may be made on the connection
+    // until end_transmit() collected the response.
+    int32_t begin_transmit(const uint8_t *capdu, size_t capdu_size, const std::function<void()> &on_complete);
+
+    bool is_transmit_pending() const;
+
+    // Waits for the pending exchange if needed, an empty response meaning a transmission failure
+    ResponseAPDU end_transmit();
+
     ATR get_atr();
 
     CommunicationProtocol get_communication_protocol();
@@ -54,9 +111,74 @@ class CardConnection {
 
     bool is_connected() const;
 
+    // Capabilities of the reader, discovered on the first connect to it and cached for every later
+    // connection. Virtual terminals report none.
+    ReaderCapabilities get_reader_capabilities() const;
+
+    // Largest Ne the reader carries in a response: k_max_short_ne when it reported short APDUs only,
+    // k_max_extended_ne when it did not tell
+    size_t get_max_reader_ne() const;
+
+    // SCardControl on the connected reader, e.g. with a control code of ReaderCapabilities.
+    // 'out_size' holds the capacity of 'out' on input.
+    int32_t control(uint32_t control_code, const uint8_t *in, size_t in_size, uint8_t *out, size_t &out_size);
+
+    // Cheap check (a single SCardStatus) that the connection still addresses the card it connected to:
+    // 0 when it does, 1 when the card was reset since (reconnect() recovers the connection) and -1
+    // when it was removed or the connection is closed
+    int32_t check_card();
+
+    // Waits until a card is present in the terminal (or absent), returning 0 once it is, 1 on timeout
+    // and -1 on error. A card seen arriving starts the time to first APDU of the next connect.
+    int32_t wait_card_presence(bool present, uint32_t timeout_ms);
+
+    void set_read_cache_enabled(bool enabled);
+
+    bool is_read_cache_enabled() const;
+
+    void invalidate_read_cache();
+
+    ReadCacheStatistics get_read_cache_statistics() const;
+
+    // Latency and traffic of the exchanges, callable from any thread (e.g. a monitoring one) while the
+    // connection transmits. Commands answered from the read cache or elided are not exchanges.
+    APDUMetricsSnapshot get_apdu_metrics() const;
+
+    // Returns -1 when no command with this INS was exchanged
+    int32_t get_apdu_latency(uint8_t ins, LatencySnapshot &snapshot) const;
+
+    // Records the session (ATR, protocol and every round-trip with its timing) to a trace file, see
+    // apdu_trace.hpp. The file is complete once stop_recording() returned.
+    int32_t start_recording(const char *path);
+
+    int32_t stop_recording();
+
+    bool is_recording() const;
+
+    void set_select_elision_enabled(bool enabled);
+
+    bool is_select_elision_enabled() const;
+
+    SelectionTracker get_selection() const;
+
+    SelectionStatistics get_selection_statistics() const;
+
+    void set_apdu_trace_enabled(bool enabled);
+
+    // Applied by the transmit() calls and by connect() on a sharing violation. Virtual terminals
+    // report no PC/SC errors and are never recovered.
+    void set_recovery_policy(const RecoveryPolicy &policy);
+
+    RecoveryPolicy get_recovery_policy() const;
+
+    RecoveryStatistics get_recovery_statistics() const;
+
     bool is_valid() const;
 
   private:
+    // Exchange recovering from the failures the recovery policy covers
+    int32_t exchange(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size);
+
     CardConnectionImpl *m_impl;
 };
 
@@ -0,0 +1,124 @@
+#ifndef TSG_SMARTCARD_CARD_PIPELINE_HPP
+#define TSG_SMARTCARD_CARD_PIPELINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "apdu_metrics.hpp"
+#include "atr.hpp"
+#include "card_connection.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+class SmartCardProvider;
+struct CardPipelineImpl;
+
+enum PipelineStage {
+    // Waiting for the next card to be inserted
+    pipeline_stage_detect,
+    pipeline_stage_connect,
+    pipeline_stage_identify,
+    // Waiting for the card's data from the preparation threads, non-zero when they fall behind
+    pipeline_stage_prepare_wait,
+    pipeline_stage_run,
+    pipeline_stage_verify,
+    pipeline_stage_eject,
+    // Waiting for the card to be taken out of the reader
+    pipeline_stage_removal,
+    pipeline_stage_count,
+};
+
+struct PipelineCard {
+    // Production order of the card's data, assigned by the preparation
+    uint64_t sequence{0};
+    size_t reader{0};
+    ATR atr;
+    std::vector<uint8_t> data;
+};
+
+struct PipelineHandlers {
+    // CPU-side preparation of the data of card 'sequence', run ahead of the readers on the
+    // preparation threads. Required.
+    std::function<int32_t(uint64_t sequence, std::vector<uint8_t> &data)> prepare;
+
+    // Rejects a card from its ATR before any data is assigned to it. Optional.
+    std::function<int32_t(const ATR &atr, size_t reader)> identify;
+
+    // Required
+    std::function<int32_t(CardConnection &connection, PipelineCard &card)> run;
+
+    // Optional
+    std::function<int32_t(CardConnection &connection, PipelineCard &card)> verify;
+
+    // Signals the card to be taken out (e.g. to the handler robot), after the card was disconnected.
+    // Called from the reader's thread. Optional.
+    std::function<void(const PipelineCard &card, bool succeeded)> eject;
+};
+
+struct PipelineOptions {
+    // Cards to produce, 0 running until stop()
+    uint64_t card_count{0};
+
+    size_t prepare_threads{1};
+
+    // Prepared cards kept ahead of the readers, 0 for two per reader
+    size_t prepare_ahead{0};
+
+    // Period the reader threads check for stop() while waiting on a card
+    uint32_t poll_interval_ms{100};
+};
+
+struct PipelineStatistics {
+    uint64_t cards_completed{0};
+    uint64_t cards_failed{0};
+
+    // Cards rejected before data was assigned (connect or identify failed)
+    uint64_t cards_rejected{0};
+
+    uint64_t elapsed_ns{0};
+
+    LatencySnapshot stages[pipeline_stage_count];
+
+    double cards_per_hour() const {
+        return elapsed_ns == 0 ? 0.0 : (double)(cards_completed + cards_failed) * 3.6e12 / (double)elapsed_ns;
+    }
+};
+
+// Runs cards through detect, connect, identify, run, verify and eject on every reader at once, each
+// reader on its own thread, while the data of the next cards is prepared on CPU threads. A reader
+// starts waiting for its next card as soon as the previous one was taken out, so the stages of
+// different readers overlap and the only serial part per reader is the card handling itself.
+class CardPipeline {
+  public:
+    CardPipeline();
+
+    ~CardPipeline();
+
+    CardPipeline(const CardPipeline &) = delete;
+
+    CardPipeline &operator=(const CardPipeline &) = delete;
+
+    // 'provider' must outlive the pipeline
+    int32_t start(SmartCardProvider &provider, const std::vector<std::string> &terminal_names,
+                  const PipelineHandlers &handlers, const PipelineOptions &options = PipelineOptions());
+
+    // Waits until PipelineOptions::card_count cards went through, or stop() was called
+    int32_t wait();
+
+    // Readers finish the card in progress, cards not yet inserted are not waited for
+    void stop();
+
+    PipelineStatistics get_statistics() const;
+
+  private:
+    CardPipelineImpl *m_impl;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_CARD_PIPELINE_HPP
@@ -0,0 +1,58 @@
+#ifndef TSG_SMARTCARD_CARD_TRANSACTION_HPP
+#define TSG_SMARTCARD_CARD_TRANSACTION_HPP
+
+#include <cstdint>
+
+#include "card_connection.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+// Transaction on a connection for the lifetime of the scope, see CardConnection::begin_transaction().
+// Scopes nest: only the outermost one locks and unlocks the card.
+//
+//   CardTransaction transaction(connection, 500);
+//   if (!transaction.is_active()) {
+//       return -1;
+//   }
+class CardTransaction {
+  public:
+    CardTransaction(CardConnection &connection, uint32_t timeout_ms = CardConnection::k_wait_forever)
+        : m_connection(connection) {
+        m_result = m_connection.begin_transaction(timeout_ms);
+    }
+
+    ~CardTransaction() { end(); }
+
+    CardTransaction(const CardTransaction &) = delete;
+
+    CardTransaction &operator=(const CardTransaction &) = delete;
+
+    bool is_active() const { return m_result == 0 && !m_ended; }
+
+    // Result of CardConnection::begin_transaction(): 1 on timeout, -1 on error
+    int32_t get_result() const { return m_result; }
+
+    // Resets the card when the outermost scope ends, e.g. to drop a verified PIN
+    void reset_on_end(CardConnection::ResetType reset_type) { m_reset_type = reset_type; }
+
+    // Ends the scope before its destruction
+    int32_t end() {
+        if (!is_active()) {
+            return 0;
+        }
+        m_ended = true;
+        return m_connection.end_transaction(m_reset_type);
+    }
+
+  private:
+    CardConnection &m_connection;
+    int32_t m_result{-1};
+    bool m_ended{false};
+    CardConnection::ResetType m_reset_type{CardConnection::reset_type_none};
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_CARD_TRANSACTION_HPP
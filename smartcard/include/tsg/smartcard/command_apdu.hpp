@@ -9,34 +9,31 @@ class CommandAPDU : public ByteHeapArray {
   public:
     using ByteHeapArray::ByteHeapArray;
 
-    CommandAPDU(uint8_t cls, uint8_t ins, uint8_t p1, uint8_t p2) : CommandAPDU(4) {
-        at(0) = cls;
-        at(1) = ins;
-        at(2) = p1;
-        at(3) = p2;
+    CommandAPDU(uint8_t cls, uint8_t ins, uint8_t p1, uint8_t p2) : CommandAPDU(4) { set_header(cls, ins, p1, p2); }
+
+    // Sized once for the whole command, a single allocation
+    CommandAPDU(uint8_t cls, uint8_t ins, uint8_t p1, uint8_t p2, uint8_t *data, size_t data_size)
+        : CommandAPDU(5 + data_size) {
+        set_header(cls, ins, p1, p2);
+        at(4) = (uint8_t)data_size;
+        memcpy(this->data() + 5, data, data_size);
     }
 
-    CommandAPDU(uint8_t cls, uint8_t ins, uint8_t p1, uint8_t p2, uint8_t *data, size_t data_size) : CommandAPDU(4) {
-        at(0) = cls;
-        at(1) = ins;
-        at(2) = p1;
-        at(3) = p2;
-        push_back((uint8_t)data_size);
-        append(data, data_size);
+    CommandAPDU(uint8_t cls, uint8_t ins, uint8_t p1, uint8_t p2, uint8_t *data, size_t data_size, uint8_t le)
+        : CommandAPDU(6 + data_size) {
+        set_header(cls, ins, p1, p2);
+        at(4) = (uint8_t)data_size;
+        memcpy(this->data() + 5, data, data_size);
+        at(5 + data_size) = le;
     }
 
-    CommandAPDU(uint8_t cls, uint8_t ins, uint8_t p1, uint8_t p2, uint8_t *data, size_t data_size, uint8_t le)
-        : CommandAPDU(4) {
+  private:
+    void set_header(uint8_t cls, uint8_t ins, uint8_t p1, uint8_t p2) {
         at(0) = cls;
         at(1) = ins;
         at(2) = p1;
         at(3) = p2;
-        push_back((uint8_t)data_size);
-        append(data, data_size);
-        push_back(le);
     }
-
-    ~CommandAPDU() { ByteHeapArray::~ByteHeapArray(); }
 };
 
 } // namespace smartcard
@@ -0,0 +1,69 @@
+#ifndef TSG_SMARTCARD_CONNECTION_LEASE_HPP
+#define TSG_SMARTCARD_CONNECTION_LEASE_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "card_connection.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+class SmartCardProvider;
+struct ConnectionLeaseManagerImpl;
+
+struct ConnectionLeaseStatistics {
+    uint64_t leases{0};
+
+    // SCardConnect issued for a lease, the first one of a terminal or after its card was removed
+    uint64_t connects{0};
+
+    // Leases served by the connection left open by the previous one
+    uint64_t connects_avoided{0};
+
+    // Connections recovered with reconnect(), the card having been reset or the previous holder
+    // asking for it
+    uint64_t reconnects{0};
+
+    uint64_t failures{0};
+};
+
+// Keeps one connection per terminal open across jobs instead of connecting and disconnecting for
+// each one. A connection is checked with CardConnection::check_card() when leased again: it is
+// handed out as is while it still addresses the same card, recovered with reconnect() after a reset
+// and connected anew after a removal. Selection state and the read cache carry over between leases.
+//
+// Each terminal has one holder at a time.
+class ConnectionLeaseManager {
+  public:
+    // 'provider' must outlive the manager
+    ConnectionLeaseManager(SmartCardProvider &provider);
+
+    // Disconnects every connection, leased ones included
+    ~ConnectionLeaseManager();
+
+    ConnectionLeaseManager(const ConnectionLeaseManager &) = delete;
+
+    ConnectionLeaseManager &operator=(const ConnectionLeaseManager &) = delete;
+
+    // Connected connection to the card in 'terminal_name', -1 when the terminal is unknown, already
+    // leased or no card can be connected
+    int32_t acquire(const std::string &terminal_name, CardConnection &connection);
+
+    // Gives the connection back, 'reset_card' when the job left state on the card the next holder
+    // must not inherit (e.g. a verified PIN): the card is then warm reset on the next lease
+    void release(CardConnection &connection, bool reset_card = false);
+
+    // Disconnects the connections not leased, leaving their cards
+    void close_idle();
+
+    ConnectionLeaseStatistics get_statistics() const;
+
+  private:
+    ConnectionLeaseManagerImpl *m_impl;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_CONNECTION_LEASE_HPP
@@ -0,0 +1,83 @@
+#ifndef TSG_SMARTCARD_FILE_READER_HPP
+#define TSG_SMARTCARD_FILE_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "card_connection.hpp"
+#include <tsg/base/byte_heap_array.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+struct FileReadOptions {
+    // Upper bound of a READ BINARY Ne, zero for the largest the card accepts
+    size_t max_chunk_size{0};
+
+    // Try extended Le first when the ATR advertises it and the protocol is T=1
+    bool use_extended_length{true};
+
+    // Stop once this many bytes were read, zero to read up to the end of the file
+    size_t expected_size{0};
+
+    // Reference the file by short EF identifier in the first command, zero for the current EF
+    uint8_t sfi{0};
+};
+
+struct FileReadStatistics {
+    uint64_t commands{0};
+    uint64_t bytes{0};
+    uint64_t chunk_fallbacks{0};
+    size_t chunk_size{0};
+};
+
+// Receives the file content chunk by chunk, a non-zero return aborts the read
+using FileReadSink = std::function<int32_t(const uint8_t *data, size_t size)>;
+
+// Bytes read so far and expected size (zero when unknown)
+using FileReadProgress = std::function<void(size_t read, size_t expected)>;
+
+// Reads a transparent EF with as few READ BINARY commands as the card and protocol allow.
+//
+// The chunk size starts with extended Le when available, then 256 (Le=00) and 255, stepping down
+// whenever the card answers 6700. A 6Cxx answer is retried with the length given by the card, for that
+// chunk only. The read ends on 6282 or 6B00, on an empty or short chunk, or once the expected size is
+// reached. The chunk size found by stepping down is kept for the next read of this FileReader.
+class FileReader {
+  public:
+    FileReader(CardConnection &connection, const FileReadOptions &options = FileReadOptions());
+
+    void set_progress_callback(const FileReadProgress &progress) { m_progress = progress; }
+
+    // Receives the content in place into 'buffer', the read stopping when it is full
+    int32_t read(uint8_t *buffer, size_t capacity, size_t &size);
+
+    // Passes each chunk to 'sink' straight from the receive buffer
+    int32_t read(const FileReadSink &sink, size_t &size);
+
+    FileReadStatistics get_statistics() const { return m_statistics; }
+
+    void reset_statistics() { m_statistics = FileReadStatistics(); }
+
+  private:
+    int32_t read_chunks(uint8_t *buffer, size_t capacity, const FileReadSink *sink, size_t &size);
+
+    int32_t read_chunk(bool use_sfi, size_t offset, size_t ne, uint8_t *response, size_t &response_size);
+
+    size_t initial_chunk_size();
+
+    bool step_down(size_t &chunk_size);
+
+    CardConnection &m_connection;
+    FileReadOptions m_options;
+    FileReadProgress m_progress;
+    FileReadStatistics m_statistics;
+    ByteHeapArray m_scratch;
+    size_t m_chunk_size{0};
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_FILE_READER_HPP
@@ -0,0 +1,117 @@
+#ifndef TSG_SMARTCARD_JOB_ENGINE_HPP
+#define TSG_SMARTCARD_JOB_ENGINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "card_connection.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+class SmartCardProvider;
+struct JobEngineImpl;
+
+enum JobAffinity {
+    // Card-agnostic stage, any reader may run it and idle readers steal it
+    job_affinity_any,
+    // Stage bound to the card in Job::reader (e.g. verifying the card just personalized there)
+    job_affinity_reader,
+};
+
+struct Job {
+    // Runs on the reader's worker thread with the connection to its card, checked or connected
+    // beforehand. A non-zero result counts the job as failed and closes the connection.
+    std::function<int32_t(CardConnection &connection, size_t reader)> run;
+
+    JobAffinity affinity{job_affinity_any};
+
+    // Reader of a bound job; for a card-agnostic one the reader queued to, SIZE_MAX letting the
+    // engine pick the least loaded reader
+    size_t reader{SIZE_MAX};
+};
+
+struct JobEngineOptions {
+    // Jobs queued per reader, submit() blocks while the reader it queues to is full
+    size_t queue_capacity{64};
+
+    bool work_stealing_enabled{true};
+};
+
+struct ReaderJobStatistics {
+    std::string terminal_name;
+    uint64_t completed{0};
+    uint64_t failed{0};
+
+    // Jobs taken from the queues of other readers
+    uint64_t stolen{0};
+
+    // Connections opened on a new card (first job, card swapped or removed, failed job before) and
+    // recovered after another application reset the card
+    uint64_t connects{0};
+    uint64_t reconnects{0};
+
+    uint64_t busy_ns{0};
+    size_t queued{0};
+};
+
+struct JobEngineStatistics {
+    uint64_t submitted{0};
+    uint64_t completed{0};
+    uint64_t failed{0};
+    uint64_t stolen{0};
+    uint64_t connects{0};
+    uint64_t reconnects{0};
+
+    // Time submit() spent waiting for queue space
+    uint64_t back_pressure_ns{0};
+
+    std::vector<ReaderJobStatistics> readers;
+};
+
+// Runs card jobs on a rack of readers, one worker thread and one connection per reader. Each reader
+// has its own job deque: the worker takes jobs from the front of its deque and, when it runs dry,
+// steals card-agnostic jobs from the back of the most loaded other deque, so that the fastest
+// readers end up running most of the work. Jobs bound to a reader only ever run there.
+class JobEngine {
+  public:
+    JobEngine();
+
+    ~JobEngine();
+
+    JobEngine(const JobEngine &) = delete;
+
+    JobEngine &operator=(const JobEngine &) = delete;
+
+    // Starts one worker per terminal; connections are created through 'provider', which must outlive
+    // the engine, and connected by the workers before their first job
+    int32_t initialize(SmartCardProvider &provider, const std::vector<std::string> &terminal_names,
+                       const JobEngineOptions &options = JobEngineOptions());
+
+    // Runs the jobs still queued, then stops the workers and disconnects
+    int32_t cleanup();
+
+    // Blocks while the queue of the reader is full. Returns -1 for an unknown reader or once stopping.
+    int32_t submit(Job job);
+
+    // Same without blocking, -1 when the queue is full
+    int32_t try_submit(Job job);
+
+    // Waits until every submitted job ran
+    void wait_idle();
+
+    size_t get_reader_count() const;
+
+    JobEngineStatistics get_statistics() const;
+
+  private:
+    JobEngineImpl *m_impl;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_JOB_ENGINE_HPP
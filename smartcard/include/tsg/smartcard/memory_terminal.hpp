@@ -0,0 +1,109 @@
+#ifndef TSG_SMARTCARD_MEMORY_TERMINAL_HPP
+#define TSG_SMARTCARD_MEMORY_TERMINAL_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "virtual_terminal.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+struct MemoryTerminalConfig {
+    CardConnection::CommunicationProtocol protocol{CardConnection::com_protocol_t_1};
+
+    // Advertised in the ATR card capabilities and accepted in commands
+    bool extended_length{true};
+
+    // Larger Ne are rejected with 6700, 255 emulates cards refusing Le=00
+    size_t max_short_ne{256};
+    size_t max_extended_ne{65536};
+
+    // Simulated transport time, per command and per byte exchanged
+    uint32_t command_latency_us{0};
+    uint32_t byte_latency_ns{0};
+};
+
+// Virtual terminal holding a card with an in-memory file system (MF and applications selected by
+// AID, each with transparent and record EFs). It answers SELECT, READ BINARY, READ RECORD, GET
+// RESPONSE and VERIFY, which is enough to exercise the library without a reader.
+class MemoryTerminal : public VirtualTerminal {
+  public:
+    MemoryTerminal(const MemoryTerminalConfig &config = MemoryTerminalConfig());
+
+    ~MemoryTerminal() override {}
+
+    // Files added afterwards belong to this application, the MF being current initially
+    void add_application(const uint8_t *aid, size_t aid_size);
+
+    void add_file(uint16_t file_id, uint8_t sfi, const uint8_t *content, size_t content_size);
+
+    void add_record(uint16_t file_id, const uint8_t *record, size_t record_size);
+
+    void set_card_present(bool present) { m_card_present = present; }
+
+    void set_config(const MemoryTerminalConfig &config) { m_config = config; }
+
+    const MemoryTerminalConfig &get_config() const { return m_config; }
+
+    uint64_t get_command_count() const { return m_command_count; }
+
+    bool is_card_present() override { return m_card_present; }
+
+    int32_t power_on(CardConnection::ResetType reset_type, ATR &atr,
+                     CardConnection::CommunicationProtocol &protocol) override;
+
+    int32_t power_off() override;
+
+    int32_t transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) override;
+
+  private:
+    struct MemoryFile {
+        uint16_t file_id;
+        uint8_t sfi;
+        std::vector<uint8_t> content;
+        std::vector<std::vector<uint8_t>> records;
+    };
+
+    struct MemoryApplication {
+        std::vector<uint8_t> aid;
+        std::vector<MemoryFile> files;
+    };
+
+    int32_t find_file(uint16_t file_id) const;
+
+    int32_t find_file_by_sfi(uint8_t sfi) const;
+
+    int32_t process(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size);
+
+    int32_t select(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size);
+
+    int32_t read_binary(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size);
+
+    int32_t read_record(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size);
+
+    int32_t get_response(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size);
+
+    bool expected_length_of(const uint8_t *capdu, size_t capdu_size, size_t &ne, uint16_t &sw);
+
+    void simulate_latency(size_t bytes);
+
+    MemoryTerminalConfig m_config;
+    std::vector<MemoryApplication> m_applications;
+    std::vector<uint8_t> m_pending_response;
+
+    size_t m_current_application{0};
+    int32_t m_current_file{-1};
+    size_t m_edit_application{0};
+
+    uint64_t m_command_count{0};
+    // Toggled by tests and simulations while a connection waits on it from another thread
+    std::atomic<bool> m_card_present{true};
+    bool m_powered{false};
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_MEMORY_TERMINAL_HPP
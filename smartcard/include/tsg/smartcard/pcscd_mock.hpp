@@ -0,0 +1,58 @@
+#ifndef TSG_SMARTCARD_PCSCD_MOCK_HPP
+#define TSG_SMARTCARD_PCSCD_MOCK_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace tsg {
+namespace smartcard {
+
+class VirtualTerminal;
+struct PcscdMockImpl;
+
+struct PcscdMockStatistics {
+    uint64_t sessions{0};
+    uint64_t requests{0};
+    uint64_t transmits{0};
+    uint64_t errors{0};
+};
+
+// Local daemon answering the subset of the pcscd protocol spoken by PcscdTerminal, its readers being
+// virtual terminals, so that the backend is checked and measured without pcscd. Each client socket is
+// served by a thread of its own. It differs from pcscd where the subset is simpler:
+// - a transaction held by another card handle fails with a sharing violation instead of waiting;
+// - a reconnection keeps the share mode of the connection.
+//
+// Available on Unix systems only.
+class PcscdMock {
+  public:
+    PcscdMock();
+
+    ~PcscdMock();
+
+    PcscdMock(const PcscdMock &) = delete;
+
+    PcscdMock &operator=(const PcscdMock &) = delete;
+
+    // Readers are added before start(), 'terminal' outliving the daemon. Only the daemon calls into
+    // it while running.
+    int32_t add_reader(const std::string &name, VirtualTerminal *terminal);
+
+    // Listens on 'socket_path', replacing a socket file left there
+    int32_t start(const char *socket_path);
+
+    // Closes every client socket, disconnecting the cards left connected, and removes the socket file
+    void stop();
+
+    bool is_running() const;
+
+    PcscdMockStatistics get_statistics() const;
+
+  private:
+    PcscdMockImpl *m_impl;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_PCSCD_MOCK_HPP
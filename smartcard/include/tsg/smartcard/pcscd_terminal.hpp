@@ -0,0 +1,79 @@
+#ifndef TSG_SMARTCARD_PCSCD_TERMINAL_HPP
+#define TSG_SMARTCARD_PCSCD_TERMINAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "virtual_terminal.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+struct PcscdTerminalImpl;
+
+struct PcscdTerminalConfig {
+    // Socket of the daemon, PCSCLITE_CSOCK_NAME or /run/pcscd/pcscd.comm when empty
+    std::string socket_path;
+
+    CardConnection::ShareMode share_mode{CardConnection::share_mode_shared};
+
+    // Protocol version announced to the daemon, which refuses another one than its own
+    int32_t protocol_minor{4};
+};
+
+// Reader of pcscd reached through the daemon socket, without libpcsclite: no lock and no copy besides
+// the socket ones on an exchange, the command and response going straight from and to the caller
+// buffers. Each terminal has a socket and a context of its own, so that threads using a reader each
+// open their terminal rather than sharing one. Registered on SmartCardProvider as a virtual terminal,
+// card connections use it like a local reader.
+//
+// Only the commands of this interface are spoken (see pcscd_protocol.hpp), PcscdMock answering the
+// same subset. Available on Unix systems only.
+class PcscdTerminal : public VirtualTerminal {
+  public:
+    PcscdTerminal();
+
+    ~PcscdTerminal() override;
+
+    PcscdTerminal(const PcscdTerminal &) = delete;
+
+    PcscdTerminal &operator=(const PcscdTerminal &) = delete;
+
+    // Connects to the daemon and establishes a context, the card being connected by power_on()
+    int32_t open(const std::string &reader_name, const PcscdTerminalConfig &config = PcscdTerminalConfig());
+
+    // Disconnects the card, leaving it powered, and releases the context
+    void close();
+
+    bool is_open() const;
+
+    // Readers known to the daemon listening on 'socket_path', the default one when empty
+    static int32_t list_readers(const std::string &socket_path, std::vector<std::string> &names);
+
+    // Result code of the last call the daemon refused, 0 when none did
+    uint32_t get_last_error() const;
+
+    int32_t begin_transaction();
+
+    int32_t end_transaction(CardConnection::ResetType reset_type = CardConnection::reset_type_none);
+
+    bool is_card_present() override;
+
+    // Connects the card, or reconnects it with the reset asked for when already connected
+    int32_t power_on(CardConnection::ResetType reset_type, ATR &atr,
+                     CardConnection::CommunicationProtocol &protocol) override;
+
+    int32_t power_off() override;
+
+    int32_t transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) override;
+
+  private:
+    PcscdTerminalImpl *m_impl;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_PCSCD_TERMINAL_HPP
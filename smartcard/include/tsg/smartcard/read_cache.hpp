@@ -0,0 +1,71 @@
+#ifndef TSG_SMARTCARD_READ_CACHE_HPP
+#define TSG_SMARTCARD_READ_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "response_apdu.hpp"
+#include "selection_tracker.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+struct ReadCacheStatistics {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t stores{0};
+    uint64_t invalidations{0};
+
+    double hit_rate() const { return (hits + misses) == 0 ? 0.0 : (double)hits / (double)(hits + misses); }
+};
+
+// Read-through cache of READ BINARY / READ RECORD responses, keyed by the tracked selection path
+// and the command bytes. Only plain (no secure messaging) basic channel reads answered with 9000
+// are kept, and any command that may modify card content drops every entry.
+//
+// A hit on a command referencing a short EF identifier does not make that EF current on the card
+// as the real command would. The command is kept as pending and must be sent ahead of the next
+// command acting on the current EF, see take_pending_selection().
+class ReadCache {
+  public:
+    static constexpr size_t k_max_entries = 512;
+
+    ReadCache() {}
+
+    void set_enabled(bool enabled);
+
+    bool is_enabled() const { return m_enabled; }
+
+    bool lookup(const SelectionTracker &selection, const uint8_t *capdu, size_t capdu_size, ResponseAPDU &rapdu);
+
+    void observe(const SelectionTracker &selection, const uint8_t *capdu, size_t capdu_size,
+                 const ResponseAPDU &rapdu);
+
+    void invalidate();
+
+    // Copies the pending command to 'pending' (pending_size holding its capacity) if 'capdu' needs it first
+    bool take_pending_selection(const uint8_t *capdu, size_t capdu_size, uint8_t *pending, size_t &pending_size);
+
+    ReadCacheStatistics get_statistics() const { return m_statistics; }
+
+    void reset_statistics() { m_statistics = ReadCacheStatistics(); }
+
+    static bool is_cacheable_command(const uint8_t *capdu, size_t capdu_size);
+
+    static bool is_write_command(const uint8_t *capdu, size_t capdu_size);
+
+  private:
+    void key_of(const SelectionTracker &selection, const uint8_t *capdu, size_t capdu_size);
+
+    std::unordered_map<std::string, ResponseAPDU> m_entries;
+    std::string m_key;
+    std::string m_pending_selection;
+    ReadCacheStatistics m_statistics;
+    bool m_enabled{false};
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_READ_CACHE_HPP
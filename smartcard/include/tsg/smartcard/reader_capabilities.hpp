@@ -0,0 +1,81 @@
+#ifndef TSG_SMARTCARD_READER_CAPABILITIES_HPP
+#define TSG_SMARTCARD_READER_CAPABILITIES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tsg {
+namespace smartcard {
+
+// Features a reader may report through CM_IOCTL_GET_FEATURE_REQUEST (PC/SC part 10), by tag
+enum ReaderFeature : uint8_t {
+    reader_feature_verify_pin_start = 0x01,
+    reader_feature_verify_pin_finish = 0x02,
+    reader_feature_modify_pin_start = 0x03,
+    reader_feature_modify_pin_finish = 0x04,
+    reader_feature_get_key_pressed = 0x05,
+    reader_feature_verify_pin_direct = 0x06,
+    reader_feature_modify_pin_direct = 0x07,
+    reader_feature_mct_reader_direct = 0x08,
+    reader_feature_mct_universal = 0x09,
+    reader_feature_ifd_pin_properties = 0x0A,
+    reader_feature_abort = 0x0B,
+    reader_feature_set_spe_message = 0x0C,
+    reader_feature_verify_pin_direct_app_id = 0x0D,
+    reader_feature_modify_pin_direct_app_id = 0x0E,
+    reader_feature_write_display = 0x0F,
+    reader_feature_get_key = 0x10,
+    reader_feature_ifd_display_properties = 0x11,
+    reader_feature_get_tlv_properties = 0x12,
+    reader_feature_ccid_esc_command = 0x13,
+    reader_feature_execute_pace = 0x20,
+};
+
+constexpr size_t k_reader_feature_count = 0x21;
+
+enum ReaderSupport {
+    reader_support_unknown,
+    reader_support_available,
+    reader_support_unavailable,
+};
+
+// What a PC/SC reader reported about itself, discovered once per reader by the first connection to
+// it and cached by the provider. Fields the reader did not report keep their default.
+struct ReaderCapabilities {
+    bool discovered{false};
+
+    // SCARD_ATTR_VENDOR_NAME, SCARD_ATTR_VENDOR_IFD_TYPE and SCARD_ATTR_VENDOR_IFD_VERSION
+    std::string vendor_name;
+    std::string ifd_type;
+    uint32_t ifd_version{0};
+
+    // SCARD_ATTR_MAX_IFSD, the largest T=1 block the reader accepts
+    uint32_t max_ifsd{0};
+
+    // From FEATURE_GET_TLV_PROPERTIES
+    uint16_t vendor_id{0};
+    uint16_t product_id{0};
+    std::string firmware_id;
+
+    // Extended APDUs as reported by dwMaxAPDUDataSize, max_apdu_data_size being 0 for short APDUs only
+    // or when not reported
+    ReaderSupport extended_apdu{reader_support_unknown};
+    uint32_t max_apdu_data_size{0};
+
+    // Control codes for CardConnection::control(), 0 for the features not reported
+    uint32_t feature_control_codes[k_reader_feature_count] = {};
+
+    bool has_feature(ReaderFeature feature) const {
+        return feature < k_reader_feature_count && feature_control_codes[feature] != 0;
+    }
+
+    uint32_t get_control_code(ReaderFeature feature) const {
+        return feature < k_reader_feature_count ? feature_control_codes[feature] : 0;
+    }
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_READER_CAPABILITIES_HPP
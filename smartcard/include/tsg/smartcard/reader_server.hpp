@@ -0,0 +1,68 @@
+#ifndef TSG_SMARTCARD_READER_SERVER_HPP
+#define TSG_SMARTCARD_READER_SERVER_HPP
+
+#include <cstdint>
+
+namespace tsg {
+namespace smartcard {
+
+class SmartCardProvider;
+struct ReaderServerImpl;
+
+struct ReaderServerStatistics {
+    uint64_t sessions{0};
+
+    // Sessions moved to rings in shared memory
+    uint64_t shared_memory_sessions{0};
+
+    uint64_t requests{0};
+
+    // Commands exchanged with the cards, each command of a batch counting as one
+    uint64_t transmits{0};
+    uint64_t batches{0};
+
+    // Writes to the clients, several responses to pipelined requests sharing one
+    uint64_t flushes{0};
+
+    uint64_t errors{0};
+};
+
+// Exports the terminals of a provider, PC/SC readers and virtual terminals alike, over a Unix domain
+// socket so that processes not owning the readers can use them through RemoteTerminal. Each client
+// session is served by a thread of its own and attaches to one reader, which no other session can
+// attach to meanwhile. See remote_channel.hpp for the framing.
+//
+// A client in another process can move its session to shared memory (see
+// RemoteTerminal::use_shared_memory()), the server then acting as a broker owning the readers for
+// worker processes exchanging through rings.
+//
+// Available on Unix systems only, the shared memory on Linux only.
+class ReaderServer {
+  public:
+    // 'provider' must outlive the server, it is only used from the server threads while running
+    ReaderServer(SmartCardProvider &provider);
+
+    ~ReaderServer();
+
+    ReaderServer(const ReaderServer &) = delete;
+
+    ReaderServer &operator=(const ReaderServer &) = delete;
+
+    // Listens on 'socket_path', replacing a socket file left there
+    int32_t start(const char *socket_path);
+
+    // Closes every session, powering off the cards they left connected, and removes the socket file
+    void stop();
+
+    bool is_running() const;
+
+    ReaderServerStatistics get_statistics() const;
+
+  private:
+    ReaderServerImpl *m_impl;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_READER_SERVER_HPP
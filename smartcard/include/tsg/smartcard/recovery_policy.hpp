@@ -0,0 +1,94 @@
+#ifndef TSG_SMARTCARD_RECOVERY_POLICY_HPP
+#define TSG_SMARTCARD_RECOVERY_POLICY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tsg {
+namespace smartcard {
+
+// How a failed exchange is recovered from, by PC/SC error
+enum RecoveryAction {
+    // Success, or an error not coming from the resource manager
+    recovery_action_none,
+    // The command did not reach the card (e.g. another application holds it exclusively): sent again
+    recovery_action_retry,
+    // The command may have been executed (communication error, timeout): sent again when replayable
+    recovery_action_retry_replayable,
+    // Another application reset the card: the handle is recovered with SCardReconnect, leaving the card
+    recovery_action_reconnect,
+    // The card lost power or stopped answering: reconnected with a warm reset
+    recovery_action_reconnect_reset,
+    // The handle or the service was lost: connected anew
+    recovery_action_connect,
+    // The card was removed, or nothing but the application can fix the error
+    recovery_action_fail,
+};
+
+// What a command needs to be sent a second time with the same outcome
+enum ReplayKind {
+    replay_kind_none,
+    // Selects by DF name or from the MF, re-establishing the state it depends on
+    replay_kind_direct,
+    // Reads data of the current DF (short EF identifier, GET DATA): the DF is selected again first when
+    // the card lost its state
+    replay_kind_in_current_df,
+};
+
+// Recovery applied by CardConnection when an exchange fails. Reconnections of the threads sharing a
+// reader are spread by the jitter, each waiting a random share of the backoff of its attempt.
+struct RecoveryPolicy {
+    // Recoveries attempted for one command, 0 disabling recovery
+    uint32_t max_retries{3};
+
+    // Backoff of the first attempt, doubled on each following one up to 'max_backoff_ms'
+    uint32_t initial_backoff_ms{10};
+    uint32_t max_backoff_ms{250};
+
+    // Share of the backoff drawn at random, 0 to 100
+    uint32_t jitter_percent{50};
+
+    // Reconnections after a reset or a lost handle, retries of undelivered commands only when disabled
+    bool reconnect_enabled{true};
+};
+
+struct RecoveryStatistics {
+    // Exchanges failing with a PC/SC error
+    uint64_t errors{0};
+
+    // Exchanges that succeeded after one or more recoveries
+    uint64_t recovered{0};
+
+    // Commands sent again on the same handle
+    uint64_t retries{0};
+
+    // SCardReconnect after the card was reset or lost power
+    uint64_t reconnects{0};
+
+    // SCardConnect after the handle or the service was lost
+    uint64_t connects{0};
+
+    // Commands sent again after the card lost its state, and DFs selected again before them
+    uint64_t replays{0};
+    uint64_t reselections{0};
+
+    // Failures left to the application: command not replayable, card removed (or a reset within a
+    // transaction), retries exhausted
+    uint64_t not_replayable{0};
+    uint64_t unrecoverable{0};
+    uint64_t exhausted{0};
+
+    uint64_t backoff_ms{0};
+};
+
+RecoveryAction classify_pcsc_error(uint32_t error);
+
+ReplayKind replay_kind_of(const uint8_t *capdu, size_t capdu_size);
+
+// Jittered backoff before the recovery 'attempt' (from 0), drawn from a generator of the calling thread
+uint32_t compute_backoff_ms(const RecoveryPolicy &policy, uint32_t attempt);
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_RECOVERY_POLICY_HPP
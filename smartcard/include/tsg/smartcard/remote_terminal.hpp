@@ -0,0 +1,90 @@
+#ifndef TSG_SMARTCARD_REMOTE_TERMINAL_HPP
+#define TSG_SMARTCARD_REMOTE_TERMINAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "virtual_terminal.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+struct RemoteTerminalImpl;
+
+// Command of a batch, 'response_size' holding the capacity of 'response' on input
+struct RemoteCommand {
+    const uint8_t *capdu{nullptr};
+    size_t capdu_size{0};
+    uint8_t *response{nullptr};
+    size_t response_size{0};
+};
+
+// Reader exported by a ReaderServer, registered on SmartCardProvider as a virtual terminal so that
+// card connections use it like a local reader. Besides the single exchanges of card connections it
+// offers two ways of saving round-trips to the server:
+// - pipelining, send_transmit() queuing commands that receive_transmit() collects the responses of
+//   in order, the server working on the next command while the client handles a response;
+// - batches, transmit_batch() sending several commands in a single request.
+// The commands in flight should fit the socket or ring buffers, the server not reading more requests
+// while its responses are not read.
+//
+// Like card connections, a terminal is used by one thread at a time. Available on Unix systems only.
+class RemoteTerminal : public VirtualTerminal {
+  public:
+    RemoteTerminal();
+
+    ~RemoteTerminal() override;
+
+    RemoteTerminal(const RemoteTerminal &) = delete;
+
+    RemoteTerminal &operator=(const RemoteTerminal &) = delete;
+
+    // Connects to the server listening on 'socket_path' and attaches to its reader 'reader_name'
+    int32_t open(const char *socket_path, const std::string &reader_name);
+
+    void close();
+
+    bool is_open() const;
+
+    // Moves the exchanges from the socket to two rings of 'ring_capacity' bytes (a power of two) in
+    // memory shared with the server, a command then costing no system call while both sides are busy.
+    // Linux only.
+    int32_t use_shared_memory(uint32_t ring_capacity = 256 * 1024);
+
+    // Readers exported by the server listening on 'socket_path'
+    static int32_t list_readers(const char *socket_path, std::vector<std::string> &names);
+
+    bool is_card_present() override;
+
+    int32_t power_on(CardConnection::ResetType reset_type, ATR &atr,
+                     CardConnection::CommunicationProtocol &protocol) override;
+
+    int32_t power_off() override;
+
+    // Single exchange, only while no pipelined command is pending
+    int32_t transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) override;
+
+    // Queues a command, sent with the following ones on the next receive_transmit() or flush()
+    int32_t send_transmit(const uint8_t *capdu, size_t capdu_size);
+
+    int32_t flush();
+
+    // Response to the oldest pending command, -1 when it failed or none is pending
+    int32_t receive_transmit(uint8_t *response, size_t &response_size);
+
+    uint32_t get_pending_count() const;
+
+    // Exchanges the commands in order, stopping at the first one failing: 'completed' commands received
+    // their response. Returns 0 when all did.
+    int32_t transmit_batch(RemoteCommand *commands, size_t count, size_t &completed);
+
+  private:
+    RemoteTerminalImpl *m_impl;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_REMOTE_TERMINAL_HPP
@@ -3,18 +3,22 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 
 namespace tsg {
 namespace smartcard {
 
 struct StatusWord {
     enum SW1 {
+        normal_processing = 0x90,
         response_bytes_still_available = 0x61,
+        warning_state_unchanged = 0x62,
         wrong_length_le = 0x6C,
     };
 };
 
-constexpr uint32_t k_max_rapdu_length = 256;
+// Short form response, up to 256 data bytes followed by SW1 SW2
+constexpr uint32_t k_max_rapdu_length = 256 + 2;
 
 class ResponseAPDU {
   public:
@@ -26,9 +30,9 @@ class ResponseAPDU {
         }
     }
 
-    ResponseAPDU(uint8_t *bytes, size_t size) {
-        memcpy(m_data, bytes, size);
-        m_size = size;
+    ResponseAPDU(const uint8_t *bytes, size_t size) {
+        m_size = size < k_max_rapdu_length ? size : k_max_rapdu_length;
+        memcpy(m_data, bytes, m_size);
     }
 
     ~ResponseAPDU() {}
@@ -37,7 +41,11 @@ class ResponseAPDU {
 
     constexpr uint8_t &get_sw2() { return at(size() - 1); }
 
-    constexpr bool sw_is(uint8_t sw1, uint8_t sw2) { return (get_sw1() == sw1 && get_sw2() == sw2); }
+    constexpr const uint8_t &get_sw1() const { return at(size() - 2); }
+
+    constexpr const uint8_t &get_sw2() const { return at(size() - 1); }
+
+    constexpr bool sw_is(uint8_t sw1, uint8_t sw2) const { return (get_sw1() == sw1 && get_sw2() == sw2); }
 
     void swap(ResponseAPDU &other) {
         std::swap(m_data, other.m_data);
@@ -0,0 +1,93 @@
+#ifndef TSG_SMARTCARD_SELECTION_TRACKER_HPP
+#define TSG_SMARTCARD_SELECTION_TRACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "response_apdu.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+struct SelectionStatistics {
+    uint64_t selects{0};
+    uint64_t selects_elided{0};
+    uint64_t round_trips_saved{0};
+    uint64_t invalidations{0};
+};
+
+// Follows the file selection of the basic logical channel from the commands exchanged with the card.
+//
+// The selection is kept as the list of selections applied since the last absolute one (by DF name,
+// path from MF or MF itself). Selecting an EF, explicitly or implicitly through a short EF identifier,
+// replaces a trailing EF entry since it does not change the current DF. Two equal paths therefore
+// always denote the same file on the same card, which is what the path is used for.
+//
+// The last SELECT is remembered with its response while it still describes the current selection,
+// so that an identical SELECT can be answered without a round-trip (see elide()). Note that an elided
+// SELECT does not reset the transient state (e.g. PIN verification) the application holds.
+class SelectionTracker {
+  public:
+    static constexpr size_t k_max_path_size = 96;
+
+    constexpr SelectionTracker() {}
+
+    // round_trips is the number of exchanges the command took, including GET RESPONSE and Le retries
+    void observe(const uint8_t *capdu, size_t capdu_size, const ResponseAPDU &rapdu, uint32_t round_trips = 1);
+
+    void invalidate();
+
+    bool elide(const uint8_t *capdu, size_t capdu_size, ResponseAPDU &rapdu);
+
+    // AID of the selected application, when selected by DF name
+    bool selected_application(const uint8_t *&aid, size_t &aid_size) const;
+
+    constexpr bool is_known() const { return m_known; }
+
+    SelectionStatistics get_statistics() const { return m_statistics; }
+
+    void reset_statistics() { m_statistics = SelectionStatistics(); }
+
+    constexpr const uint8_t *path() const { return m_path; }
+
+    constexpr size_t path_size() const { return m_path_size; }
+
+    // Size of the path leading to the current DF, without a trailing EF entry
+    constexpr size_t df_path_size() const { return m_last_entry_is_ef ? m_last_entry_offset : m_path_size; }
+
+    static uint8_t logical_channel_of(uint8_t cla);
+
+    // Short EF identifier referenced by a binary or record command, zero if none
+    static uint8_t short_ef_identifier_of(const uint8_t *capdu, size_t capdu_size);
+
+    // True for binary and record commands acting on the current EF
+    static bool references_current_ef(const uint8_t *capdu, size_t capdu_size);
+
+  private:
+    enum EntryKind : uint8_t {
+        entry_kind_df = 0x00,
+        entry_kind_ef = 0x01,
+    };
+
+    void reset_path();
+
+    void append_entry(EntryKind kind, uint8_t p1, const uint8_t *data, size_t data_size);
+
+    uint8_t m_path[k_max_path_size] = {};
+    size_t m_path_size = 0;
+    size_t m_last_entry_offset = 0;
+    bool m_last_entry_is_ef = false;
+    bool m_known = false;
+
+    uint8_t m_select_capdu[k_max_path_size] = {};
+    size_t m_select_capdu_size = 0;
+    uint32_t m_select_round_trips = 0;
+    ResponseAPDU m_select_rapdu;
+
+    SelectionStatistics m_statistics;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_SELECTION_TRACKER_HPP
@@ -2,10 +2,12 @@
 #define TSG_SMARTCARD_SMARTCARD_PROVIDER_HPP
 
 #include <cstdint>
+#include <functional>
 #include <vector>
 #include <string>
 
 #include "card_connection.hpp"
+#include "reader_capabilities.hpp"
 
 namespace tsg {
 namespace smartcard {
@@ -14,7 +16,23 @@ namespace priv {
 struct ProviderImpl;
 } // namespace priv
 
+class VirtualTerminal;
 
+enum TerminalEventType {
+    terminal_event_added,
+    terminal_event_removed,
+};
+
+// A terminal appearing in or leaving the list on refresh(). 'id' stays the same for a terminal name
+// for the lifetime of the provider, unplugging and plugging the reader again included.
+struct TerminalEvent {
+    TerminalEventType type;
+    uint32_t id;
+    std::string name;
+    bool virtual_terminal{false};
+};
+
+using TerminalListener = std::function<void(const TerminalEvent &event)>;
 
 class SmartCardProvider {
   public:
@@ -28,10 +46,32 @@ class SmartCardProvider {
 
     CardConnection create_card_connection();
 
+    CardConnection create_card_connection(const std::string &terminal_name);
+
     void destroy_card_connection(CardConnection & cc);
 
+    // Lists the readers again and diffs them with the current list: only the readers added or removed
+    // are reported, to the listener and std::cerr, and the list is left untouched when nothing changed
     void refresh();
 
+    // Called from refresh() on its thread, after the list was updated
+    void set_terminal_listener(TerminalListener listener);
+
+    // Terminals listed by the last refresh(), PC/SC readers first
+    void get_terminal_names(std::vector<std::string> &names) const;
+
+    // Stable id of a listed terminal, -1 when it is not listed
+    int32_t get_terminal_id(const std::string &terminal_name, uint32_t &id);
+
+    // Capabilities of a PC/SC reader, 'discovered' remaining false until a connection to it connected
+    // (and for virtual terminals). Returns -1 for an unknown terminal.
+    int32_t get_reader_capabilities(const std::string &terminal_name, ReaderCapabilities &capabilities);
+
+    // Virtual terminals are listed after the PC/SC readers on the next refresh(), 'terminal' is not owned
+    void add_virtual_terminal(const std::string &name, VirtualTerminal *terminal);
+
+    void remove_virtual_terminal(const std::string &name);
+
   private:
     priv::ProviderImpl *m_impl;
 };
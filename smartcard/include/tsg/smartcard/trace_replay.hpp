@@ -0,0 +1,149 @@
+#ifndef TSG_SMARTCARD_TRACE_REPLAY_HPP
+#define TSG_SMARTCARD_TRACE_REPLAY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "apdu_trace.hpp"
+#include "virtual_terminal.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+enum ReplayPacing {
+    replay_pacing_as_fast_as_possible,
+    // Recorded card latencies and gaps between commands
+    replay_pacing_real_time,
+    // Recorded durations divided by ReplayOptions::speed
+    replay_pacing_scaled,
+};
+
+struct ReplayOptions {
+    ReplayPacing pacing{replay_pacing_as_fast_as_possible};
+    double speed{1.0};
+
+    // Recorded exchanges searched ahead of the expected one before looking in the whole trace
+    size_t resync_window{16};
+};
+
+struct ReplayStatistics {
+    uint64_t commands{0};
+    uint64_t matched{0};
+    uint64_t resynchronized{0};
+    uint64_t unmatched{0};
+};
+
+// Exchanges of a recorded session, indexed once and shared read-only by any number of replays. The
+// byte fields point into the trace mapping, the TraceReader must stay open while the session is used.
+class TraceReplaySession {
+  public:
+    struct Exchange {
+        const uint8_t *capdu;
+        size_t capdu_size;
+        const uint8_t *rapdu;
+        size_t rapdu_size;
+        uint64_t timestamp_ns;
+        uint32_t latency_ns;
+    };
+
+    TraceReplaySession() {}
+
+    // Reads every record of 'reader' from the start
+    int32_t load(TraceReader &reader);
+
+    const std::vector<Exchange> &get_exchanges() const { return m_exchanges; }
+
+    // Exchanges sent by the host, excluding the GET RESPONSE and Le retries CardConnection adds itself
+    const std::vector<size_t> &get_commands() const { return m_commands; }
+
+    const ATR &get_atr() const { return m_atr; }
+
+    CardConnection::CommunicationProtocol get_protocol() const { return m_protocol; }
+
+    // First exchange at or after 'from' with this C-APDU, wrapping around, -1 if none
+    int64_t find(const uint8_t *capdu, size_t capdu_size, size_t from) const;
+
+  private:
+    static uint64_t hash_of(const uint8_t *bytes, size_t size);
+
+    std::vector<Exchange> m_exchanges;
+    std::vector<size_t> m_commands;
+    std::unordered_map<uint64_t, std::vector<size_t>> m_index;
+    ATR m_atr;
+    CardConnection::CommunicationProtocol m_protocol{CardConnection::com_protocol_t_none};
+};
+
+// Card answering from a recorded session. A C-APDU is matched against the next recorded exchange,
+// then within ReplayOptions::resync_window exchanges ahead, then anywhere in the trace; the replay
+// continues after the exchange found. Unmatched commands are answered 6F00.
+class TraceReplayTerminal : public VirtualTerminal {
+  public:
+    TraceReplayTerminal(const TraceReplaySession &session, const ReplayOptions &options = ReplayOptions());
+
+    ~TraceReplayTerminal() override {}
+
+    int32_t power_on(CardConnection::ResetType reset_type, ATR &atr,
+                     CardConnection::CommunicationProtocol &protocol) override;
+
+    int32_t power_off() override;
+
+    int32_t transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) override;
+
+    ReplayStatistics get_statistics() const { return m_statistics; }
+
+  private:
+    void pace(uint32_t latency_ns);
+
+    const TraceReplaySession &m_session;
+    ReplayOptions m_options;
+    ReplayStatistics m_statistics;
+    size_t m_cursor{0};
+    bool m_powered{false};
+};
+
+struct ReplayRunOptions {
+    ReplayOptions replay;
+
+    // Parallel replays, each on its own thread, terminal and connection
+    size_t replay_count{1};
+
+    // Passes over the recorded commands per replay, the card being reset between passes
+    size_t iterations{1};
+};
+
+struct ReplayRunStatistics {
+    ReplayStatistics replay;
+    uint64_t transmit_failures{0};
+    uint64_t elapsed_ns{0};
+
+    double commands_per_second() const {
+        return elapsed_ns == 0 ? 0.0 : (double)replay.commands * 1e9 / (double)elapsed_ns;
+    }
+};
+
+// Load generator sending the recorded host commands through CardConnection to replay terminals, the
+// host side following the recorded gaps between commands unless pacing as fast as possible.
+class TraceReplayRunner {
+  public:
+    TraceReplayRunner(const TraceReplaySession &session, const ReplayRunOptions &options = ReplayRunOptions());
+
+    int32_t run();
+
+    ReplayRunStatistics get_statistics() const { return m_statistics; }
+
+    // Latency of each replay as seen by its connection, valid after run()
+    const std::vector<APDUMetricsSnapshot> &get_replay_metrics() const { return m_replay_metrics; }
+
+  private:
+    const TraceReplaySession &m_session;
+    ReplayRunOptions m_options;
+    ReplayRunStatistics m_statistics;
+    std::vector<APDUMetricsSnapshot> m_replay_metrics;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_TRACE_REPLAY_HPP
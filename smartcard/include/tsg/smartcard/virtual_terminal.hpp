@@ -0,0 +1,34 @@
+#ifndef TSG_SMARTCARD_VIRTUAL_TERMINAL_HPP
+#define TSG_SMARTCARD_VIRTUAL_TERMINAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "atr.hpp"
+#include "card_connection.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+// Terminal implemented in software, registered on SmartCardProvider next to the PC/SC readers.
+// Card connections on a virtual terminal call into it instead of the PC/SC resource manager.
+class VirtualTerminal {
+  public:
+    virtual ~VirtualTerminal() {}
+
+    virtual bool is_card_present() { return true; }
+
+    // Powers the card up (cold or warm reset), returning its ATR and the protocol in use
+    virtual int32_t power_on(CardConnection::ResetType reset_type, ATR &atr,
+                             CardConnection::CommunicationProtocol &protocol) = 0;
+
+    virtual int32_t power_off() { return 0; }
+
+    // Single exchange, 'response_size' holds the capacity of 'response' on input
+    virtual int32_t transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) = 0;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_VIRTUAL_TERMINAL_HPP
@@ -0,0 +1,63 @@
+#include "lua_internal.hpp"
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+namespace {
+
+ATR &check_atr(lua_State *L, int index) { return *(ATR *)luaL_checkudata(L, index, k_atr_metatable); }
+
+// atr:historical_bytes() returns the position (1-based) and count of the historical bytes
+int atr_historical_bytes(lua_State *L) {
+    size_t offset = 0;
+    size_t count = 0;
+    if (!check_atr(L, 1).get_historical_bytes(offset, count)) {
+        return 0;
+    }
+    lua_pushinteger(L, (lua_Integer)offset + 1);
+    lua_pushinteger(L, (lua_Integer)count);
+    return 2;
+}
+
+int atr_supports_extended_length(lua_State *L) {
+    lua_pushboolean(L, check_atr(L, 1).supports_extended_length());
+    return 1;
+}
+
+const luaL_Reg atr_methods[] = {
+    {"historical_bytes", atr_historical_bytes},
+    {"supports_extended_length", atr_supports_extended_length},
+    {nullptr, nullptr},
+};
+
+// smartcard.ATR(bytes)
+int atr_new(lua_State *L) {
+    uint8_t scratch[ATR().capacity()];
+    ByteView view = check_bytes(L, 1, scratch, sizeof(scratch));
+    luaL_argcheck(L, view.size <= sizeof(scratch), 1, "too many bytes");
+    push_atr(L)->reset((uint8_t *)view.data, view.size);
+    return 1;
+}
+
+} // namespace
+
+ATR *push_atr(lua_State *L) {
+    auto atr = (ATR *)lua_newuserdatauv(L, sizeof(ATR), 0);
+    Memory::construct_at(atr);
+    luaL_setmetatable(L, k_atr_metatable);
+    return atr;
+}
+
+void register_atr(lua_State *L) {
+    luaL_newmetatable(L, k_atr_metatable);
+    set_byte_view_metatable(L, byte_view_kind_atr, atr_methods);
+    lua_pop(L, 1);
+
+    lua_pushcfunction(L, atr_new);
+    lua_setfield(L, -2, "ATR");
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
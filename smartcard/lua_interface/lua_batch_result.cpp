@@ -0,0 +1,209 @@
+#include <vector>
+
+#include "lua_internal.hpp"
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+namespace {
+
+// Responses of a batch packed in one userdata: header, count + 1 offsets, then the response bytes
+struct LuaBatchResult {
+    uint32_t count;
+    uint32_t failed; // 1-based index of the first unexpected status word, zero if none
+    uint32_t offsets[1];
+
+    const uint8_t *bytes() const { return (const uint8_t *)&offsets[count + 1]; }
+
+    const uint8_t *response(uint32_t index) const { return bytes() + offsets[index]; }
+
+    size_t response_size(uint32_t index) const { return offsets[index + 1] - offsets[index]; }
+};
+
+// Filled while the batch runs, thread_local since a Lua error would skip the destructor of a local
+thread_local std::vector<uint8_t> g_batch_bytes;
+thread_local std::vector<uint32_t> g_batch_offsets;
+
+LuaBatchResult &check_batch_result(lua_State *L, int index) {
+    return *(LuaBatchResult *)luaL_checkudata(L, index, k_batch_result_metatable);
+}
+
+uint32_t check_response_index(lua_State *L, const LuaBatchResult &result, int index) {
+    lua_Integer position = luaL_checkinteger(L, index);
+    luaL_argcheck(L, position >= 1 && position <= (lua_Integer)result.count, index, "index out of range");
+    return (uint32_t)(position - 1);
+}
+
+// Expected status word of an entry, or of the options when the entry has none
+bool get_expected_sw(lua_State *L, int index, lua_Integer &sw, lua_Integer &mask) {
+    if (lua_getfield(L, index, "sw") == LUA_TNIL) {
+        lua_pop(L, 1);
+        return false;
+    }
+    sw = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    mask = (lua_getfield(L, index, "sw_mask") == LUA_TNIL ? 0xFFFF : lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    return true;
+}
+
+int batch_result_len(lua_State *L) {
+    lua_pushinteger(L, check_batch_result(L, 1).count);
+    return 1;
+}
+
+// result[i] creates a ResponseAPDU on access, methods are looked up otherwise
+int batch_result_index(lua_State *L) {
+    if (lua_type(L, 2) == LUA_TNUMBER) {
+        LuaBatchResult &result = check_batch_result(L, 1);
+        lua_Integer position = lua_tointeger(L, 2);
+        if (position < 1 || position > (lua_Integer)result.count) {
+            lua_pushnil(L);
+            return 1;
+        }
+        uint32_t index = (uint32_t)(position - 1);
+        *push_response_apdu(L) = ResponseAPDU(result.response(index), result.response_size(index));
+        return 1;
+    }
+
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    return 1;
+}
+
+// result:sw(i) without creating the response
+int batch_result_sw(lua_State *L) {
+    LuaBatchResult &result = check_batch_result(L, 1);
+    uint32_t index = check_response_index(L, result, 2);
+    size_t size = result.response_size(index);
+    if (size < 2) {
+        return 0;
+    }
+    const uint8_t *response = result.response(index);
+    lua_pushinteger(L, (response[size - 2] << 8) | response[size - 1]);
+    return 1;
+}
+
+int batch_result_data_size(lua_State *L) {
+    LuaBatchResult &result = check_batch_result(L, 1);
+    size_t size = result.response_size(check_response_index(L, result, 2));
+    lua_pushinteger(L, size < 2 ? 0 : (lua_Integer)size - 2);
+    return 1;
+}
+
+int batch_result_ok(lua_State *L) {
+    lua_pushboolean(L, check_batch_result(L, 1).failed == 0);
+    return 1;
+}
+
+int batch_result_failed(lua_State *L) {
+    LuaBatchResult &result = check_batch_result(L, 1);
+    if (result.failed == 0) {
+        return 0;
+    }
+    lua_pushinteger(L, result.failed);
+    return 1;
+}
+
+const luaL_Reg batch_result_methods[] = {
+    {"sw", batch_result_sw},
+    {"data_size", batch_result_data_size},
+    {"ok", batch_result_ok},
+    {"failed", batch_result_failed},
+    {nullptr, nullptr},
+};
+
+} // namespace
+
+// connection:transmit_batch(commands [, options]) sends the commands in one native call. Each entry is
+// a command (CommandAPDU, hex string or byte table) or a table { command, sw = 0x9000, sw_mask = 0xFFFF }.
+// options.sw and options.sw_mask give the expected status word of entries without one, and the batch
+// stops at the first unexpected one unless options.continue_on_error is set. Returns a BatchResult.
+int card_connection_transmit_batch(lua_State *L) {
+    CardConnection &connection = check_card_connection(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    bool has_options = lua_istable(L, 3);
+
+    lua_Integer default_sw = 0;
+    lua_Integer default_mask = 0;
+    bool has_default_sw = has_options && get_expected_sw(L, 3, default_sw, default_mask);
+    bool continue_on_error = false;
+    if (has_options) {
+        lua_getfield(L, 3, "continue_on_error");
+        continue_on_error = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+
+    g_batch_bytes.clear();
+    g_batch_offsets.clear();
+    g_batch_offsets.push_back(0);
+
+    uint32_t failed = 0;
+    size_t count = (size_t)lua_rawlen(L, 2);
+    for (size_t position = 1; position <= count; position++) {
+        lua_rawgeti(L, 2, (lua_Integer)position);
+        int entry = lua_gettop(L);
+
+        lua_Integer sw = default_sw;
+        lua_Integer mask = default_mask;
+        bool check_sw = has_default_sw;
+        int command = entry;
+        if (lua_istable(L, entry) && lua_rawgeti(L, entry, 1) != LUA_TNUMBER) {
+            command = lua_gettop(L);
+            if (get_expected_sw(L, entry, sw, mask)) {
+                check_sw = true;
+            }
+        }
+
+        uint8_t scratch[k_max_short_capdu_length];
+        ByteView capdu = check_bytes(L, command, scratch, sizeof(scratch));
+        ResponseAPDU rapdu = connection.transmit(capdu.data, capdu.size);
+        lua_settop(L, entry - 1);
+
+        g_batch_bytes.insert(g_batch_bytes.end(), rapdu.begin(), rapdu.end());
+        g_batch_offsets.push_back((uint32_t)g_batch_bytes.size());
+
+        if (rapdu.size() < 2) { // transmission failure
+            failed = (uint32_t)position;
+            break;
+        }
+        uint16_t actual = (uint16_t)((rapdu.get_sw1() << 8) | rapdu.get_sw2());
+        if (check_sw && (actual & mask) != (sw & mask) && failed == 0) {
+            failed = (uint32_t)position;
+            if (!continue_on_error) {
+                break;
+            }
+        }
+    }
+
+    uint32_t executed = (uint32_t)(g_batch_offsets.size() - 1);
+    size_t offsets_size = g_batch_offsets.size() * sizeof(uint32_t);
+    auto result = (LuaBatchResult *)lua_newuserdatauv(
+        L, offsetof(LuaBatchResult, offsets) + offsets_size + g_batch_bytes.size(), 0);
+    result->count = executed;
+    result->failed = failed;
+    memcpy(result->offsets, g_batch_offsets.data(), offsets_size);
+    if (!g_batch_bytes.empty()) {
+        memcpy((uint8_t *)result->bytes(), g_batch_bytes.data(), g_batch_bytes.size());
+    }
+    luaL_setmetatable(L, k_batch_result_metatable);
+
+    return 1;
+}
+
+void register_batch_result(lua_State *L) {
+    luaL_newmetatable(L, k_batch_result_metatable);
+    lua_newtable(L);
+    luaL_setfuncs(L, batch_result_methods, 0);
+    lua_pushcclosure(L, batch_result_index, 1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, batch_result_len);
+    lua_setfield(L, -2, "__len");
+    lua_pop(L, 1);
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
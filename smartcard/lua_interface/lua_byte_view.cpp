@@ -0,0 +1,200 @@
+#include "lua_internal.hpp"
+#include <tsg/base/hex.hpp>
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+namespace {
+
+// The metamethods are closures over the view kind, their first argument always has the matching metatable
+ByteView view_of(lua_State *L, int index, int kind) {
+    void *ud = lua_touserdata(L, index);
+    switch (kind) {
+    case byte_view_kind_atr:
+        return {((ATR *)ud)->data(), ((ATR *)ud)->size()};
+    case byte_view_kind_command_apdu:
+        return {((LuaCommandAPDU *)ud)->bytes, ((LuaCommandAPDU *)ud)->size};
+    default:
+        return {((ResponseAPDU *)ud)->data(), ((ResponseAPDU *)ud)->size()};
+    }
+}
+
+ByteView check_byte_view(lua_State *L, int index) {
+    ByteView view;
+    if (!to_byte_view(L, index, view)) {
+        luaL_typeerror(L, index, "byte view");
+    }
+    return view;
+}
+
+int byte_view_index(lua_State *L) {
+    if (lua_type(L, 2) == LUA_TNUMBER) {
+        ByteView view = view_of(L, 1, (int)lua_tointeger(L, lua_upvalueindex(2)));
+        lua_Integer position = lua_tointeger(L, 2);
+        if (position >= 1 && (size_t)position <= view.size) {
+            lua_pushinteger(L, view.data[position - 1]);
+        } else {
+            lua_pushnil(L);
+        }
+        return 1;
+    }
+
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    return 1;
+}
+
+int byte_view_len(lua_State *L) {
+    lua_pushinteger(L, (lua_Integer)view_of(L, 1, (int)lua_tointeger(L, lua_upvalueindex(1))).size);
+    return 1;
+}
+
+int byte_view_hex(lua_State *L) {
+    ByteView view = check_byte_view(L, 1);
+
+    luaL_Buffer buffer;
+    char *text = luaL_buffinitsize(L, &buffer, view.size * 2);
+    for (size_t index = 0; index < view.size; index++) {
+        hex::hex_string_of(view.data[index], text[index * 2], text[index * 2 + 1], true);
+    }
+    luaL_pushresultsize(&buffer, view.size * 2);
+
+    return 1;
+}
+
+int byte_view_eq(lua_State *L) {
+    ByteView a;
+    ByteView b;
+    lua_pushboolean(L, to_byte_view(L, 1, a) && to_byte_view(L, 2, b) && a.size == b.size &&
+                           (a.size == 0 || memcmp(a.data, b.data, a.size) == 0));
+    return 1;
+}
+
+// view:bytes([i [, j]]) returns the bytes i..j as integers, like string.byte
+int byte_view_bytes(lua_State *L) {
+    ByteView view = check_byte_view(L, 1);
+    lua_Integer first = luaL_optinteger(L, 2, 1);
+    lua_Integer last = luaL_optinteger(L, 3, first);
+    if (first < 1) {
+        first = 1;
+    }
+    if (last > (lua_Integer)view.size) {
+        last = (lua_Integer)view.size;
+    }
+    if (first > last) {
+        return 0;
+    }
+
+    int count = (int)(last - first + 1);
+    luaL_checkstack(L, count, "too many bytes");
+    for (lua_Integer position = first; position <= last; position++) {
+        lua_pushinteger(L, view.data[position - 1]);
+    }
+
+    return count;
+}
+
+// view:size() for symmetry with the C++ classes, same as #view
+int byte_view_size(lua_State *L) {
+    lua_pushinteger(L, (lua_Integer)check_byte_view(L, 1).size);
+    return 1;
+}
+
+const luaL_Reg byte_view_methods[] = {
+    {"hex", byte_view_hex},
+    {"bytes", byte_view_bytes},
+    {"size", byte_view_size},
+    {nullptr, nullptr},
+};
+
+} // namespace
+
+bool to_byte_view(lua_State *L, int index, ByteView &view) {
+    if (luaL_testudata(L, index, k_command_apdu_metatable) != nullptr) {
+        view = view_of(L, index, byte_view_kind_command_apdu);
+        return true;
+    }
+    if (luaL_testudata(L, index, k_response_apdu_metatable) != nullptr) {
+        view = view_of(L, index, byte_view_kind_response_apdu);
+        return true;
+    }
+    if (luaL_testudata(L, index, k_atr_metatable) != nullptr) {
+        view = view_of(L, index, byte_view_kind_atr);
+        return true;
+    }
+    return false;
+}
+
+size_t check_byte_count(lua_State *L, int index) {
+    ByteView view;
+    if (to_byte_view(L, index, view)) {
+        return view.size;
+    }
+    if (lua_type(L, index) == LUA_TSTRING) {
+        return (size_t)lua_rawlen(L, index) / 2;
+    }
+    if (lua_type(L, index) == LUA_TTABLE) {
+        return (size_t)lua_rawlen(L, index);
+    }
+    luaL_typeerror(L, index, "byte view, hex string or table");
+    return 0;
+}
+
+ByteView check_bytes(lua_State *L, int index, uint8_t *scratch, size_t scratch_capacity) {
+    ByteView view;
+    if (to_byte_view(L, index, view)) {
+        return view;
+    }
+
+    if (lua_type(L, index) == LUA_TSTRING) {
+        size_t length = 0;
+        const char *text = lua_tolstring(L, index, &length);
+        luaL_argcheck(L, length % 2 == 0, index, "odd number of hex digits");
+        luaL_argcheck(L, length / 2 <= scratch_capacity, index, "too many bytes");
+        for (size_t offset = 0; offset < length; offset += 2) {
+            scratch[offset / 2] = (uint8_t)((hex::ascii_to_hex_map[(uint8_t)text[offset]] << 4) |
+                                            hex::ascii_to_hex_map[(uint8_t)text[offset + 1]]);
+        }
+        return {scratch, length / 2};
+    }
+
+    if (lua_type(L, index) == LUA_TTABLE) {
+        size_t count = (size_t)lua_rawlen(L, index);
+        luaL_argcheck(L, count <= scratch_capacity, index, "too many bytes");
+        for (size_t position = 1; position <= count; position++) {
+            lua_rawgeti(L, index, (lua_Integer)position);
+            scratch[position - 1] = (uint8_t)lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+        return {scratch, count};
+    }
+
+    luaL_typeerror(L, index, "byte view, hex string or table");
+    return {nullptr, 0};
+}
+
+void set_byte_view_metatable(lua_State *L, ByteViewKind kind, const luaL_Reg *methods) {
+    lua_newtable(L);
+    luaL_setfuncs(L, byte_view_methods, 0);
+    if (methods != nullptr) {
+        luaL_setfuncs(L, methods, 0);
+    }
+    lua_pushinteger(L, kind);
+    lua_pushcclosure(L, byte_view_index, 2);
+    lua_setfield(L, -2, "__index");
+
+    lua_pushinteger(L, kind);
+    lua_pushcclosure(L, byte_view_len, 1);
+    lua_setfield(L, -2, "__len");
+
+    lua_pushcfunction(L, byte_view_hex);
+    lua_setfield(L, -2, "__tostring");
+
+    lua_pushcfunction(L, byte_view_eq);
+    lua_setfield(L, -2, "__eq");
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
@@ -0,0 +1,190 @@
+#include "lua_internal.hpp"
+#include "lua_scheduler.hpp"
+#include "smartcard_lua.hpp"
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+namespace {
+
+int push_result(lua_State *L, int32_t result) {
+    lua_pushboolean(L, result == 0);
+    return 1;
+}
+
+int card_connection_connect(lua_State *L) { return push_result(L, check_card_connection(L, 1).connect()); }
+
+int card_connection_reconnect(lua_State *L) {
+    CardConnection &connection = check_card_connection(L, 1);
+    auto reset_type = (CardConnection::ResetType)luaL_optinteger(L, 2, CardConnection::reset_type_warm);
+    return push_result(L, connection.reconnect(reset_type));
+}
+
+int card_connection_disconnect(lua_State *L) { return push_result(L, check_card_connection(L, 1).disconnect()); }
+
+int push_transmit_result(lua_State *L, const ResponseAPDU &response) {
+    if (response.empty()) {
+        return 0;
+    }
+
+    if (lua_isnoneornil(L, 3)) {
+        *push_response_apdu(L) = response;
+    } else {
+        *(ResponseAPDU *)luaL_checkudata(L, 3, k_response_apdu_metatable) = response;
+        lua_settop(L, 3);
+    }
+
+    return 1;
+}
+
+int card_connection_transmit_continuation(lua_State *L, int, lua_KContext) {
+    return push_transmit_result(L, check_card_connection(L, 1).end_transmit());
+}
+
+// connection:transmit(capdu [, rapdu]) fills 'rapdu' when given, so that a loop of commands does not
+// create a response per iteration. Returns nil when the exchange failed. In a LuaScheduler task the
+// coroutine yields until the response arrived.
+int card_connection_transmit(lua_State *L) {
+    CardConnection &connection = check_card_connection(L, 1);
+
+    ByteView view;
+    uint8_t scratch[k_max_short_capdu_length];
+    if (auto capdu = (LuaCommandAPDU *)luaL_testudata(L, 2, k_command_apdu_metatable)) {
+        view = {capdu->bytes, capdu->size};
+    } else {
+        view = check_bytes(L, 2, scratch, sizeof(scratch));
+    }
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checkudata(L, 3, k_response_apdu_metatable);
+    }
+
+    LuaScheduler *scheduler = LuaScheduler::task_scheduler_of(L);
+    if (scheduler == nullptr || !lua_isyieldable(L)) {
+        return push_transmit_result(L, connection.transmit(view.data, view.size));
+    }
+
+    scheduler->wait(L, connection);
+    if (connection.begin_transmit(view.data, view.size, [scheduler, L]() { scheduler->notify(L); }) != 0) {
+        return luaL_error(L, "a transmission is already pending on this connection");
+    }
+    return lua_yieldk(L, 0, 0, card_connection_transmit_continuation);
+}
+
+int card_connection_get_atr(lua_State *L) {
+    *push_atr(L) = check_card_connection(L, 1).get_atr();
+    return 1;
+}
+
+int card_connection_get_communication_protocol(lua_State *L) {
+    lua_pushinteger(L, check_card_connection(L, 1).get_communication_protocol());
+    return 1;
+}
+
+int card_connection_get_terminal_name(lua_State *L) {
+    lua_pushstring(L, check_card_connection(L, 1).get_terminal_name().c_str());
+    return 1;
+}
+
+int card_connection_is_connected(lua_State *L) {
+    auto ud = (LuaCardConnection *)luaL_checkudata(L, 1, k_card_connection_metatable);
+    lua_pushboolean(L, ud->connection.is_valid() && ud->connection.is_connected());
+    return 1;
+}
+
+int card_connection_set_read_cache_enabled(lua_State *L) {
+    check_card_connection(L, 1).set_read_cache_enabled(lua_toboolean(L, 2));
+    return 0;
+}
+
+int card_connection_set_select_elision_enabled(lua_State *L) {
+    check_card_connection(L, 1).set_select_elision_enabled(lua_toboolean(L, 2));
+    return 0;
+}
+
+int card_connection_set_apdu_trace_enabled(lua_State *L) {
+    check_card_connection(L, 1).set_apdu_trace_enabled(lua_toboolean(L, 2));
+    return 0;
+}
+
+// Same as SmartCardProvider::destroy_card_connection(), also run by __gc and __close
+int card_connection_close(lua_State *L) {
+    auto ud = (LuaCardConnection *)luaL_checkudata(L, 1, k_card_connection_metatable);
+    if (ud->owned && ud->connection.is_valid()) {
+        if (ud->connection.is_connected()) {
+            ud->connection.disconnect();
+        }
+        ud->connection.cleanup();
+    }
+    ud->connection = CardConnection();
+    return 0;
+}
+
+const luaL_Reg card_connection_methods[] = {
+    {"connect", card_connection_connect},
+    {"reconnect", card_connection_reconnect},
+    {"disconnect", card_connection_disconnect},
+    {"transmit", card_connection_transmit},
+    {"transmit_batch", card_connection_transmit_batch},
+    {"get_atr", card_connection_get_atr},
+    {"get_communication_protocol", card_connection_get_communication_protocol},
+    {"get_terminal_name", card_connection_get_terminal_name},
+    {"is_connected", card_connection_is_connected},
+    {"set_read_cache_enabled", card_connection_set_read_cache_enabled},
+    {"set_select_elision_enabled", card_connection_set_select_elision_enabled},
+    {"set_apdu_trace_enabled", card_connection_set_apdu_trace_enabled},
+    {"close", card_connection_close},
+    {nullptr, nullptr},
+};
+
+const luaL_Reg card_connection_metamethods[] = {
+    {"__gc", card_connection_close},
+    {"__close", card_connection_close},
+    {nullptr, nullptr},
+};
+
+} // namespace
+
+CardConnection &check_card_connection(lua_State *L, int index) {
+    auto ud = (LuaCardConnection *)luaL_checkudata(L, index, k_card_connection_metatable);
+    luaL_argcheck(L, ud->connection.is_valid(), index, "card connection closed");
+    return ud->connection;
+}
+
+void push_card_connection(lua_State *L, CardConnection *connection) {
+    luaL_requiref(L, "smartcard", open_smartcard, 0); // the metatables are registered with the module
+    lua_pop(L, 1);
+
+    auto ud = (LuaCardConnection *)lua_newuserdatauv(L, sizeof(LuaCardConnection), 0);
+    Memory::construct_at(ud);
+    ud->connection = *connection; // shares the implementation, CardConnection being a handle
+    ud->owned = false;
+    luaL_setmetatable(L, k_card_connection_metatable);
+}
+
+void register_card_connection(lua_State *L) {
+    luaL_newmetatable(L, k_card_connection_metatable);
+    luaL_setfuncs(L, card_connection_metamethods, 0);
+    lua_newtable(L);
+    luaL_setfuncs(L, card_connection_methods, 0);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    lua_pushinteger(L, CardConnection::reset_type_none);
+    lua_setfield(L, -2, "reset_type_none");
+    lua_pushinteger(L, CardConnection::reset_type_warm);
+    lua_setfield(L, -2, "reset_type_warm");
+    lua_pushinteger(L, CardConnection::reset_type_cold);
+    lua_setfield(L, -2, "reset_type_cold");
+
+    lua_pushinteger(L, CardConnection::com_protocol_t_none);
+    lua_setfield(L, -2, "com_protocol_t_none");
+    lua_pushinteger(L, CardConnection::com_protocol_t_0);
+    lua_setfield(L, -2, "com_protocol_t_0");
+    lua_pushinteger(L, CardConnection::com_protocol_t_1);
+    lua_setfield(L, -2, "com_protocol_t_1");
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
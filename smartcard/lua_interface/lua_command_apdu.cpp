@@ -0,0 +1,173 @@
+#include "lua_internal.hpp"
+#include <tsg/smartcard/apdu_builder.hpp>
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+namespace {
+
+LuaCommandAPDU &check_command_apdu(lua_State *L, int index) {
+    return *(LuaCommandAPDU *)luaL_checkudata(L, index, k_command_apdu_metatable);
+}
+
+// Short form whenever Nc and Ne allow it (ISO/IEC 7816-4, 5.1)
+bool is_extended(size_t nc, size_t ne) { return nc > k_max_short_nc || ne > k_max_short_ne; }
+
+size_t encoded_size_of(size_t nc, size_t ne) {
+    size_t size = 4;
+    if (is_extended(nc, ne)) {
+        size += (nc > 0 ? 3 + nc : 0) + (ne > 0 ? (nc > 0 ? 2 : 3) : 0);
+    } else {
+        size += (nc > 0 ? 1 + nc : 0) + (ne > 0 ? 1 : 0);
+    }
+    return size;
+}
+
+// Lc and Le around the command data already in place at offset 5 (short) or 7 (extended)
+void encode_lengths(uint8_t *bytes, size_t nc, size_t ne) {
+    if (is_extended(nc, ne)) {
+        size_t offset = 4;
+        bytes[offset++] = 0x00;
+        if (nc > 0) {
+            bytes[offset++] = (uint8_t)(nc >> 8);
+            bytes[offset++] = (uint8_t)(nc & 0xFF);
+            offset += nc;
+        }
+        if (ne > 0) {
+            size_t le = (ne == k_max_extended_ne ? 0 : ne);
+            bytes[offset++] = (uint8_t)(le >> 8);
+            bytes[offset++] = (uint8_t)(le & 0xFF);
+        }
+    } else {
+        size_t offset = 4;
+        if (nc > 0) {
+            bytes[offset++] = (uint8_t)nc;
+            offset += nc;
+        }
+        if (ne > 0) {
+            bytes[offset++] = (uint8_t)(ne == k_max_short_ne ? 0 : ne);
+        }
+    }
+}
+
+int command_apdu_header_byte(lua_State *L, size_t offset) {
+    lua_pushinteger(L, check_command_apdu(L, 1).bytes[offset]);
+    return 1;
+}
+
+int command_apdu_set_header_byte(lua_State *L, size_t offset) {
+    LuaCommandAPDU &capdu = check_command_apdu(L, 1);
+    capdu.bytes[offset] = (uint8_t)luaL_checkinteger(L, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+int command_apdu_cla(lua_State *L) { return command_apdu_header_byte(L, 0); }
+
+int command_apdu_ins(lua_State *L) { return command_apdu_header_byte(L, 1); }
+
+int command_apdu_p1(lua_State *L) { return command_apdu_header_byte(L, 2); }
+
+int command_apdu_p2(lua_State *L) { return command_apdu_header_byte(L, 3); }
+
+int command_apdu_set_cla(lua_State *L) { return command_apdu_set_header_byte(L, 0); }
+
+int command_apdu_set_ins(lua_State *L) { return command_apdu_set_header_byte(L, 1); }
+
+int command_apdu_set_p1(lua_State *L) { return command_apdu_set_header_byte(L, 2); }
+
+int command_apdu_set_p2(lua_State *L) { return command_apdu_set_header_byte(L, 3); }
+
+// capdu:set_p1p2(0x0100), e.g. the offset of a READ BINARY reused in a loop
+int command_apdu_set_p1p2(lua_State *L) {
+    LuaCommandAPDU &capdu = check_command_apdu(L, 1);
+    lua_Integer p1p2 = luaL_checkinteger(L, 2);
+    capdu.bytes[2] = (uint8_t)((p1p2 >> 8) & 0xFF);
+    capdu.bytes[3] = (uint8_t)(p1p2 & 0xFF);
+    lua_settop(L, 1);
+    return 1;
+}
+
+// capdu[i] = byte, within the encoded command
+int command_apdu_newindex(lua_State *L) {
+    LuaCommandAPDU &capdu = check_command_apdu(L, 1);
+    lua_Integer position = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, position >= 1 && (size_t)position <= capdu.size, 2, "index out of range");
+    capdu.bytes[position - 1] = (uint8_t)luaL_checkinteger(L, 3);
+    return 0;
+}
+
+const luaL_Reg command_apdu_methods[] = {
+    {"cla", command_apdu_cla},
+    {"ins", command_apdu_ins},
+    {"p1", command_apdu_p1},
+    {"p2", command_apdu_p2},
+    {"set_cla", command_apdu_set_cla},
+    {"set_ins", command_apdu_set_ins},
+    {"set_p1", command_apdu_set_p1},
+    {"set_p2", command_apdu_set_p2},
+    {"set_p1p2", command_apdu_set_p1p2},
+    {nullptr, nullptr},
+};
+
+// smartcard.CommandAPDU(cla, ins, p1, p2 [, data [, ne]]) or smartcard.CommandAPDU(bytes)
+int command_apdu_new(lua_State *L) {
+    if (lua_type(L, 1) != LUA_TNUMBER) {
+        size_t size = check_byte_count(L, 1);
+        luaL_argcheck(L, size >= 4, 1, "a command APDU has at least 4 bytes");
+        LuaCommandAPDU *capdu = push_command_apdu(L, size);
+        ByteView view = check_bytes(L, 1, capdu->bytes, size);
+        if (view.data != capdu->bytes) {
+            memcpy(capdu->bytes, view.data, size);
+        }
+        return 1;
+    }
+
+    uint8_t header[4];
+    for (int index = 0; index < 4; index++) {
+        header[index] = (uint8_t)luaL_checkinteger(L, index + 1);
+    }
+    size_t nc = lua_isnoneornil(L, 5) ? 0 : check_byte_count(L, 5);
+    lua_Integer ne = luaL_optinteger(L, 6, 0);
+    luaL_argcheck(L, nc <= k_max_extended_nc, 5, "too many bytes");
+    luaL_argcheck(L, ne >= 0 && ne <= (lua_Integer)k_max_extended_ne, 6, "Ne out of range");
+
+    size_t size = encoded_size_of(nc, (size_t)ne);
+    LuaCommandAPDU *capdu = push_command_apdu(L, size);
+    memcpy(capdu->bytes, header, sizeof(header));
+    if (nc > 0) {
+        uint8_t *data = capdu->bytes + (is_extended(nc, (size_t)ne) ? 7 : 5);
+        ByteView view = check_bytes(L, 5, data, nc);
+        if (view.data != data) {
+            memcpy(data, view.data, nc);
+        }
+    }
+    encode_lengths(capdu->bytes, nc, (size_t)ne);
+
+    return 1;
+}
+
+} // namespace
+
+LuaCommandAPDU *push_command_apdu(lua_State *L, size_t size) {
+    auto capdu = (LuaCommandAPDU *)lua_newuserdatauv(L, offsetof(LuaCommandAPDU, bytes) + size, 0);
+    capdu->size = size;
+    luaL_setmetatable(L, k_command_apdu_metatable);
+    return capdu;
+}
+
+void register_command_apdu(lua_State *L) {
+    luaL_newmetatable(L, k_command_apdu_metatable);
+    set_byte_view_metatable(L, byte_view_kind_command_apdu, command_apdu_methods);
+    lua_pushcfunction(L, command_apdu_newindex);
+    lua_setfield(L, -2, "__newindex");
+    lua_pop(L, 1);
+
+    lua_pushcfunction(L, command_apdu_new);
+    lua_setfield(L, -2, "CommandAPDU");
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
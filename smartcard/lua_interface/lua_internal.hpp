@@ -0,0 +1,94 @@
+#ifndef TSG_SMARTCARD_LUA_INTERNAL_HPP
+#define TSG_SMARTCARD_LUA_INTERNAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <lua.hpp>
+#include <tsg/smartcard/atr.hpp>
+#include <tsg/smartcard/card_connection.hpp>
+#include <tsg/smartcard/response_apdu.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+constexpr const char *k_atr_metatable = "tsg.smartcard.ATR";
+constexpr const char *k_command_apdu_metatable = "tsg.smartcard.CommandAPDU";
+constexpr const char *k_response_apdu_metatable = "tsg.smartcard.ResponseAPDU";
+constexpr const char *k_card_connection_metatable = "tsg.smartcard.CardConnection";
+constexpr const char *k_smartcard_provider_metatable = "tsg.smartcard.SmartCardProvider";
+constexpr const char *k_batch_result_metatable = "tsg.smartcard.BatchResult";
+
+// Command bytes live in the userdata itself, allocated once for the encoded size
+struct LuaCommandAPDU {
+    size_t size;
+    uint8_t bytes[1];
+};
+
+// Either created from a provider (owned, closed on __gc) or lent by the host through push_card_connection()
+struct LuaCardConnection {
+    CardConnection connection;
+    bool owned;
+};
+
+// Either created by a script (owned) or lent by the host application through push_smartcard_provider()
+struct LuaSmartCardProvider {
+    SmartCardProvider *provider;
+    bool owned;
+    bool initialized;
+};
+
+enum ByteViewKind {
+    byte_view_kind_atr,
+    byte_view_kind_command_apdu,
+    byte_view_kind_response_apdu,
+};
+
+// Bytes of a CommandAPDU, ResponseAPDU or ATR userdata, valid while the userdata is reachable
+struct ByteView {
+    const uint8_t *data;
+    size_t size;
+};
+
+bool to_byte_view(lua_State *L, int index, ByteView &view);
+
+// Accepts a byte view userdata (no copy), a hex string or an array of integers, decoded into 'scratch'
+ByteView check_bytes(lua_State *L, int index, uint8_t *scratch, size_t scratch_capacity);
+
+// Number of bytes check_bytes() gives for the same argument
+size_t check_byte_count(lua_State *L, int index);
+
+// With the metatable of 'kind' on top of the stack, installs the byte view metamethods (indexing,
+// length, __tostring as hex, __eq) and the methods shared by all views followed by 'methods'
+void set_byte_view_metatable(lua_State *L, ByteViewKind kind, const luaL_Reg *methods);
+
+CardConnection &check_card_connection(lua_State *L, int index);
+
+// connection:transmit_batch(commands [, options]), see lua_batch_result.cpp
+int card_connection_transmit_batch(lua_State *L);
+
+LuaCommandAPDU *push_command_apdu(lua_State *L, size_t size);
+
+ResponseAPDU *push_response_apdu(lua_State *L);
+
+ATR *push_atr(lua_State *L);
+
+// Each registers its metatable and adds its constructor and constants to the module table on top of the stack
+void register_atr(lua_State *L);
+
+void register_command_apdu(lua_State *L);
+
+void register_response_apdu(lua_State *L);
+
+void register_card_connection(lua_State *L);
+
+void register_smartcard_provider(lua_State *L);
+
+void register_batch_result(lua_State *L);
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_LUA_INTERNAL_HPP
@@ -0,0 +1,106 @@
+#include "lua_internal.hpp"
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+namespace {
+
+ResponseAPDU &check_response_apdu(lua_State *L, int index) {
+    return *(ResponseAPDU *)luaL_checkudata(L, index, k_response_apdu_metatable);
+}
+
+// rapdu:sw() returns SW1 SW2 as a single integer, e.g. 0x9000, nil for an empty response
+int response_apdu_sw(lua_State *L) {
+    ResponseAPDU &rapdu = check_response_apdu(L, 1);
+    if (rapdu.size() < 2) {
+        return 0;
+    }
+    lua_pushinteger(L, (rapdu.get_sw1() << 8) | rapdu.get_sw2());
+    return 1;
+}
+
+int response_apdu_sw1(lua_State *L) {
+    ResponseAPDU &rapdu = check_response_apdu(L, 1);
+    if (rapdu.size() < 2) {
+        return 0;
+    }
+    lua_pushinteger(L, rapdu.get_sw1());
+    return 1;
+}
+
+int response_apdu_sw2(lua_State *L) {
+    ResponseAPDU &rapdu = check_response_apdu(L, 1);
+    if (rapdu.size() < 2) {
+        return 0;
+    }
+    lua_pushinteger(L, rapdu.get_sw2());
+    return 1;
+}
+
+// rapdu:sw_is(0x9000) or rapdu:sw_is(0x90, 0x00)
+int response_apdu_sw_is(lua_State *L) {
+    ResponseAPDU &rapdu = check_response_apdu(L, 1);
+    lua_Integer sw1 = luaL_checkinteger(L, 2);
+    lua_Integer sw2 = 0;
+    if (lua_isnoneornil(L, 3)) {
+        sw2 = sw1 & 0xFF;
+        sw1 = (sw1 >> 8) & 0xFF;
+    } else {
+        sw2 = luaL_checkinteger(L, 3);
+    }
+    lua_pushboolean(L, rapdu.size() >= 2 && rapdu.sw_is((uint8_t)sw1, (uint8_t)sw2));
+    return 1;
+}
+
+// Number of data bytes, without SW1 SW2
+int response_apdu_data_size(lua_State *L) {
+    ResponseAPDU &rapdu = check_response_apdu(L, 1);
+    lua_pushinteger(L, rapdu.size() < 2 ? 0 : (lua_Integer)rapdu.size() - 2);
+    return 1;
+}
+
+const luaL_Reg response_apdu_methods[] = {
+    {"sw", response_apdu_sw},
+    {"sw1", response_apdu_sw1},
+    {"sw2", response_apdu_sw2},
+    {"sw_is", response_apdu_sw_is},
+    {"data_size", response_apdu_data_size},
+    {nullptr, nullptr},
+};
+
+// smartcard.ResponseAPDU([bytes]), an empty one being meant for reuse with transmit()
+int response_apdu_new(lua_State *L) {
+    if (lua_isnoneornil(L, 1)) {
+        push_response_apdu(L);
+        return 1;
+    }
+
+    uint8_t scratch[k_max_rapdu_length];
+    ByteView view = check_bytes(L, 1, scratch, sizeof(scratch));
+    luaL_argcheck(L, view.size <= k_max_rapdu_length, 1, "too many bytes");
+    *push_response_apdu(L) = ResponseAPDU(view.data, view.size);
+    return 1;
+}
+
+} // namespace
+
+ResponseAPDU *push_response_apdu(lua_State *L) {
+    auto rapdu = (ResponseAPDU *)lua_newuserdatauv(L, sizeof(ResponseAPDU), 0);
+    Memory::construct_at(rapdu);
+    luaL_setmetatable(L, k_response_apdu_metatable);
+    return rapdu;
+}
+
+void register_response_apdu(lua_State *L) {
+    luaL_newmetatable(L, k_response_apdu_metatable);
+    set_byte_view_metatable(L, byte_view_kind_response_apdu, response_apdu_methods);
+    lua_pop(L, 1);
+
+    lua_pushcfunction(L, response_apdu_new);
+    lua_setfield(L, -2, "ResponseAPDU");
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/card_connection.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "lua_scheduler.hpp"
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+namespace {
+
+constexpr const char *k_scheduler_registry_key = "tsg.smartcard.scheduler";
+
+} // namespace
+
+struct LuaTask {
+    int ref;       // anchors the thread in the registry
+    int nargs;     // values to pass on the next resume
+    bool waiting;  // yielded by transmit, resumed on notify()
+    CardConnection *connection; // exchanging for the task while waiting, anchored on its stack
+};
+
+struct LuaSchedulerImpl {
+    lua_State *state{nullptr};
+    std::unordered_map<lua_State *, LuaTask> tasks;
+    std::deque<lua_State *> runnable;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<lua_State *> completed; // filled from the exchange threads
+};
+
+namespace {
+
+int32_t impl_spawn(LuaSchedulerImpl *impl, lua_State *L, int nargs) {
+    lua_State *task = lua_newthread(L);
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_xmove(L, task, nargs + 1);
+
+    impl->tasks[task] = LuaTask{ref, nargs, false, nullptr};
+    impl->runnable.push_back(task);
+
+    return 0;
+}
+
+void impl_finish(LuaSchedulerImpl *impl, lua_State *task, bool failed) {
+    auto it = impl->tasks.find(task);
+    if (failed) {
+        // Runs pending to-be-closed variables, lua_closethread() replacing lua_resetthread() from 5.4.6
+#if LUA_VERSION_RELEASE_NUM >= 50406
+        lua_closethread(task, impl->state);
+#elif LUA_VERSION_NUM >= 504
+        lua_resetthread(task);
+#endif
+    }
+    luaL_unref(impl->state, LUA_REGISTRYINDEX, it->second.ref);
+    impl->tasks.erase(it);
+}
+
+// smartcard.spawn(f, ...)
+int impl_lua_spawn(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_getfield(L, LUA_REGISTRYINDEX, k_scheduler_registry_key);
+    auto scheduler = (LuaScheduler *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (scheduler == nullptr) {
+        return luaL_error(L, "no scheduler attached to this state");
+    }
+    scheduler->spawn(L, lua_gettop(L) - 1);
+    return 0;
+}
+
+} // namespace
+
+LuaScheduler::LuaScheduler() {
+    m_impl = (LuaSchedulerImpl *)TSG_ALLOC(sizeof(LuaSchedulerImpl));
+    tsg::Memory::construct_at(m_impl);
+}
+
+LuaScheduler::~LuaScheduler() {
+    cleanup();
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(LuaSchedulerImpl));
+}
+
+int32_t LuaScheduler::initialize(lua_State *L) {
+    cleanup();
+
+    m_impl->state = L;
+    lua_pushlightuserdata(L, this);
+    lua_setfield(L, LUA_REGISTRYINDEX, k_scheduler_registry_key);
+
+    lua_getglobal(L, "package");
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, "loaded");
+        lua_getfield(L, -1, "smartcard");
+        if (lua_istable(L, -1)) {
+            lua_pushcfunction(L, impl_lua_spawn);
+            lua_setfield(L, -2, "spawn");
+        }
+        lua_pop(L, 2);
+    }
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+int32_t LuaScheduler::cleanup() {
+    if (m_impl->state == nullptr) {
+        return 0;
+    }
+
+    // Tasks waiting for a card are abandoned once their exchange completed, so that its notify() does
+    // not outlive the scheduler and the connection accepts another exchange
+    std::vector<lua_State *> waiting;
+    for (auto &entry : m_impl->tasks) {
+        if (entry.second.waiting) {
+            if (entry.second.connection->is_valid()) {
+                entry.second.connection->end_transmit();
+            }
+            if (std::find(m_impl->runnable.begin(), m_impl->runnable.end(), entry.first) == m_impl->runnable.end()) {
+                waiting.push_back(entry.first);
+            }
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_impl->mutex);
+        m_impl->condition.wait(lock, [this, &waiting]() {
+            return std::all_of(waiting.begin(), waiting.end(), [this](lua_State *task) {
+                return std::find(m_impl->completed.begin(), m_impl->completed.end(), task) != m_impl->completed.end();
+            });
+        });
+        m_impl->completed.clear();
+    }
+
+    while (!m_impl->tasks.empty()) {
+        impl_finish(m_impl, m_impl->tasks.begin()->first, false);
+    }
+    m_impl->runnable.clear();
+
+    lua_pushnil(m_impl->state);
+    lua_setfield(m_impl->state, LUA_REGISTRYINDEX, k_scheduler_registry_key);
+    m_impl->state = nullptr;
+
+    return 0;
+}
+
+int32_t LuaScheduler::spawn(int nargs) { return impl_spawn(m_impl, m_impl->state, nargs); }
+
+int32_t LuaScheduler::spawn(lua_State *L, int nargs) { return impl_spawn(m_impl, L, nargs); }
+
+int32_t LuaScheduler::run() {
+    lua_State *L = m_impl->state;
+    int32_t result = 0;
+
+    while (!m_impl->tasks.empty()) {
+        if (m_impl->runnable.empty()) {
+            std::unique_lock<std::mutex> lock(m_impl->mutex);
+            m_impl->condition.wait(lock, [this]() { return !m_impl->completed.empty(); });
+            for (lua_State *task : m_impl->completed) {
+                if (m_impl->tasks.find(task) != m_impl->tasks.end()) { // ignores tasks dropped meanwhile
+                    m_impl->runnable.push_back(task);
+                }
+            }
+            m_impl->completed.clear();
+        }
+
+        if (m_impl->runnable.empty()) {
+            continue;
+        }
+        lua_State *task = m_impl->runnable.front();
+        m_impl->runnable.pop_front();
+
+        auto it = m_impl->tasks.find(task);
+        if (it == m_impl->tasks.end()) {
+            continue;
+        }
+        LuaTask &state = it->second;
+        int nargs = state.nargs;
+        state.nargs = 0;
+        state.waiting = false;
+        state.connection = nullptr;
+
+        int nresults = 0;
+        int status = lua_resume(task, L, nargs, &nresults);
+        if (status == LUA_YIELD) {
+            lua_pop(task, nresults);
+            if (!m_impl->tasks.find(task)->second.waiting) {
+                m_impl->runnable.push_back(task);
+            }
+        } else if (status == LUA_OK) {
+            impl_finish(m_impl, task, false);
+        } else {
+            const char *message = lua_tostring(task, -1);
+            luaL_traceback(L, task, message == nullptr ? "(error object is not a string)" : message, 0);
+            std::cerr << "ERROR - lua: " << lua_tostring(L, -1) << std::endl;
+            lua_pop(L, 1);
+            impl_finish(m_impl, task, true);
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+size_t LuaScheduler::get_task_count() const { return m_impl->tasks.size(); }
+
+LuaScheduler *LuaScheduler::task_scheduler_of(lua_State *L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, k_scheduler_registry_key);
+    auto scheduler = (LuaScheduler *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (scheduler == nullptr || scheduler->m_impl->tasks.find(L) == scheduler->m_impl->tasks.end()) {
+        return nullptr;
+    }
+    return scheduler;
+}
+
+void LuaScheduler::wait(lua_State *task, CardConnection &connection) {
+    auto it = m_impl->tasks.find(task);
+    if (it != m_impl->tasks.end()) {
+        it->second.waiting = true;
+        it->second.connection = &connection;
+    }
+}
+
+// Notifies under the lock, cleanup() destroying the scheduler as soon as it is released
+void LuaScheduler::notify(lua_State *task) {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->completed.push_back(task);
+    m_impl->condition.notify_one();
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
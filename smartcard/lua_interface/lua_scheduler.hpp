@@ -0,0 +1,64 @@
+#ifndef TSG_SMARTCARD_LUA_SCHEDULER_HPP
+#define TSG_SMARTCARD_LUA_SCHEDULER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <lua.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+class CardConnection;
+
+namespace lua {
+
+struct LuaSchedulerImpl;
+
+// Runs Lua functions as coroutines on one native thread. In a scheduled coroutine,
+// CardConnection:transmit() starts the exchange with CardConnection::begin_transmit() and yields;
+// the coroutine is resumed once the response arrived, so scripts driving different readers
+// overlap their card round-trips. Outside of it (main chunk, other coroutines) transmit blocks.
+//
+// Scripts schedule more work with smartcard.spawn(f, ...). A plain coroutine.yield() from a task
+// puts it back at the end of the run queue.
+class LuaScheduler {
+  public:
+    LuaScheduler();
+
+    ~LuaScheduler();
+
+    int32_t initialize(lua_State *L);
+
+    // Drops the tasks left, after waiting for the exchanges they started
+    int32_t cleanup();
+
+    // Schedules the function below 'nargs' arguments on the stack of the state, popping them
+    int32_t spawn(int nargs);
+
+    // Same from any thread of the state, e.g. a running task
+    int32_t spawn(lua_State *L, int nargs);
+
+    // Runs until every task finished, sleeping while all of them wait for a card. Returns -1 if
+    // any task failed, its error being reported.
+    int32_t run();
+
+    size_t get_task_count() const;
+
+    // Scheduler of 'L' when it is one of its tasks
+    static LuaScheduler *task_scheduler_of(lua_State *L);
+
+    // Called by the transmit binding, before yielding and from the exchange thread once done. The
+    // exchange of 'connection' is collected by cleanup() when the task is dropped while waiting.
+    void wait(lua_State *task, CardConnection &connection);
+
+    void notify(lua_State *task);
+
+  private:
+    LuaSchedulerImpl *m_impl;
+};
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_LUA_SCHEDULER_HPP
@@ -0,0 +1,248 @@
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <tsg/base/memory.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "lua_script_service.hpp"
+#include "smartcard_lua.hpp"
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+struct CompiledScript {
+    uint64_t id;
+    std::string source;
+    std::string bytecode;
+};
+
+struct LuaWorker {
+    lua_State *state{nullptr};
+    int functions_ref{LUA_NOREF};   // script id -> loaded function
+    int environment_ref{LUA_NOREF}; // metatable of the per-run environments
+    LuaScriptStatistics statistics;
+};
+
+struct LuaScriptServiceImpl {
+    std::vector<LuaWorker> workers;
+
+    std::mutex scripts_mutex;
+    std::unordered_multimap<uint64_t, CompiledScript> scripts; // source hash -> script
+    uint64_t next_script_id{1};
+};
+
+namespace {
+
+// FNV-1a
+uint64_t impl_hash_of(const char *source, size_t source_size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t index = 0; index < source_size; index++) {
+        hash ^= (uint8_t)source[index];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+int impl_dump_writer(lua_State *, const void *data, size_t size, void *ud) {
+    ((std::string *)ud)->append((const char *)data, size);
+    return 0;
+}
+
+int impl_message_handler(lua_State *L) {
+    const char *message = lua_tostring(L, 1);
+    luaL_traceback(L, L, message == nullptr ? "(error object is not a string)" : message, 1);
+    return 1;
+}
+
+int32_t impl_open_worker(LuaWorker &worker) {
+    lua_State *L = luaL_newstate();
+    if (L == nullptr) {
+        return -1;
+    }
+    luaL_openlibs(L);
+    preload_smartcard(L);
+    luaL_requiref(L, "smartcard", open_smartcard, 1);
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    worker.functions_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_createtable(L, 0, 1);
+    lua_pushglobaltable(L);
+    lua_setfield(L, -2, "__index");
+    worker.environment_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    worker.state = L;
+    return 0;
+}
+
+// Finds the script compiled from 'source' or compiles it in the worker state
+const CompiledScript *impl_compiled_script(LuaScriptServiceImpl *impl, LuaWorker &worker, const char *name,
+                                           const char *source, size_t source_size) {
+    uint64_t hash = impl_hash_of(source, source_size);
+
+    std::lock_guard<std::mutex> lock(impl->scripts_mutex);
+    auto range = impl->scripts.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.source.size() == source_size && memcmp(it->second.source.data(), source, source_size) == 0) {
+            return &it->second;
+        }
+    }
+
+    lua_State *L = worker.state;
+    if (luaL_loadbufferx(L, source, source_size, name, "t") != LUA_OK) {
+        std::cerr << "ERROR - lua: " << lua_tostring(L, -1) << std::endl;
+        lua_pop(L, 1);
+        return nullptr;
+    }
+
+    CompiledScript script;
+    script.id = impl->next_script_id++;
+    script.source.assign(source, source_size);
+    lua_dump(L, impl_dump_writer, &script.bytecode, 0);
+    worker.statistics.compilations++;
+
+    // This state keeps the function just compiled, the others load the bytecode
+    lua_rawgeti(L, LUA_REGISTRYINDEX, worker.functions_ref);
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, (lua_Integer)script.id);
+    lua_pop(L, 1);
+
+    return &impl->scripts.emplace(hash, std::move(script))->second;
+}
+
+// Pushes the function of 'script' loaded in the worker state
+int32_t impl_push_function(LuaWorker &worker, const CompiledScript *script, const char *name) {
+    lua_State *L = worker.state;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, worker.functions_ref);
+    if (lua_rawgeti(L, -1, (lua_Integer)script->id) == LUA_TFUNCTION) {
+        lua_remove(L, -2);
+        worker.statistics.function_reuses++;
+        return 0;
+    }
+    lua_pop(L, 1);
+
+    if (luaL_loadbufferx(L, script->bytecode.data(), script->bytecode.size(), name, "b") != LUA_OK) {
+        std::cerr << "ERROR - lua: " << lua_tostring(L, -1) << std::endl;
+        lua_pop(L, 2);
+        return -1;
+    }
+    worker.statistics.bytecode_loads++;
+
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, -3, (lua_Integer)script->id);
+    lua_remove(L, -2);
+
+    return 0;
+}
+
+} // namespace
+
+LuaScriptService::LuaScriptService() {
+    m_impl = (LuaScriptServiceImpl *)TSG_ALLOC(sizeof(LuaScriptServiceImpl));
+    tsg::Memory::construct_at(m_impl);
+}
+
+LuaScriptService::~LuaScriptService() {
+    cleanup();
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(LuaScriptServiceImpl));
+}
+
+int32_t LuaScriptService::initialize(const LuaScriptServiceCI &ci) {
+    cleanup();
+
+    m_impl->workers.resize(ci.worker_count);
+    for (auto &worker : m_impl->workers) {
+        if (impl_open_worker(worker) != 0) {
+            std::cerr << "ERROR - lua: cannot create state" << std::endl;
+            cleanup();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int32_t LuaScriptService::cleanup() {
+    for (auto &worker : m_impl->workers) {
+        if (worker.state != nullptr) {
+            lua_close(worker.state);
+        }
+    }
+    m_impl->workers.clear();
+
+    std::lock_guard<std::mutex> lock(m_impl->scripts_mutex);
+    m_impl->scripts.clear();
+
+    return 0;
+}
+
+int32_t LuaScriptService::run(size_t worker_index, const char *name, const char *source, size_t source_size,
+                              CardConnection *connection) {
+    if (worker_index >= m_impl->workers.size()) {
+        return -1;
+    }
+    LuaWorker &worker = m_impl->workers[worker_index];
+    lua_State *L = worker.state;
+    worker.statistics.runs++;
+
+    const CompiledScript *script = impl_compiled_script(m_impl, worker, name, source, source_size);
+    if (script == nullptr) {
+        return -1;
+    }
+
+    lua_pushcfunction(L, impl_message_handler);
+    int handler = lua_gettop(L);
+
+    if (impl_push_function(worker, script, name) != 0) {
+        lua_settop(L, 0);
+        return -1;
+    }
+
+    // Fresh _ENV (the first upvalue of a main chunk) reading through to the globals
+    lua_newtable(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, worker.environment_ref);
+    lua_setmetatable(L, -2);
+    lua_setupvalue(L, -2, 1);
+
+    if (connection != nullptr) {
+        push_card_connection(L, connection);
+    } else {
+        lua_pushnil(L);
+    }
+
+    int32_t result = 0;
+    if (lua_pcall(L, 1, 0, handler) != LUA_OK) {
+        std::cerr << "ERROR - lua: " << lua_tostring(L, -1) << std::endl;
+        result = -1;
+    }
+
+    lua_settop(L, 0);
+
+    return result;
+}
+
+lua_State *LuaScriptService::get_state(size_t worker) {
+    return worker < m_impl->workers.size() ? m_impl->workers[worker].state : nullptr;
+}
+
+size_t LuaScriptService::get_worker_count() const { return m_impl->workers.size(); }
+
+LuaScriptStatistics LuaScriptService::get_statistics() const {
+    LuaScriptStatistics statistics;
+    for (auto &worker : m_impl->workers) {
+        statistics.runs += worker.statistics.runs;
+        statistics.compilations += worker.statistics.compilations;
+        statistics.bytecode_loads += worker.statistics.bytecode_loads;
+        statistics.function_reuses += worker.statistics.function_reuses;
+    }
+    return statistics;
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
@@ -0,0 +1,64 @@
+#ifndef TSG_SMARTCARD_LUA_SCRIPT_SERVICE_HPP
+#define TSG_SMARTCARD_LUA_SCRIPT_SERVICE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <lua.hpp>
+#include <tsg/smartcard/card_connection.hpp>
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+struct LuaScriptServiceImpl;
+
+struct LuaScriptServiceCI {
+    // One state per worker thread
+    size_t worker_count{1};
+};
+
+struct LuaScriptStatistics {
+    uint64_t runs{0};
+    uint64_t compilations{0};
+    uint64_t bytecode_loads{0};
+    uint64_t function_reuses{0};
+};
+
+// Runs card scripts on a pool of Lua states created once, with the standard libraries and the
+// smartcard module already loaded.
+//
+// Scripts are compiled once per source: the bytecode dump is shared between the states, keyed by a
+// hash of the source, and each state keeps the loaded function for later runs. Every run gets a new
+// global environment falling back to the pristine globals, so globals set by a script do not leak
+// into the next card while the VM stays up. Changes to shared tables (string, package.loaded...) do.
+//
+// Worker 'n' must only be used from one thread at a time, the bytecode cache is shared safely.
+class LuaScriptService {
+  public:
+    LuaScriptService();
+
+    ~LuaScriptService();
+
+    int32_t initialize(const LuaScriptServiceCI &ci);
+
+    int32_t cleanup();
+
+    // Runs 'source' on the state of 'worker', the script receiving 'connection' as its argument (...)
+    int32_t run(size_t worker, const char *name, const char *source, size_t source_size,
+                CardConnection *connection);
+
+    lua_State *get_state(size_t worker);
+
+    size_t get_worker_count() const;
+
+    LuaScriptStatistics get_statistics() const;
+
+  private:
+    LuaScriptServiceImpl *m_impl;
+};
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_LUA_SCRIPT_SERVICE_HPP
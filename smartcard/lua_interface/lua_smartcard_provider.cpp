@@ -0,0 +1,126 @@
+#include "lua_internal.hpp"
+#include "smartcard_lua.hpp"
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+namespace {
+
+LuaSmartCardProvider &check_smartcard_provider(lua_State *L, int index) {
+    return *(LuaSmartCardProvider *)luaL_checkudata(L, index, k_smartcard_provider_metatable);
+}
+
+int smartcard_provider_initialize(lua_State *L) {
+    LuaSmartCardProvider &ud = check_smartcard_provider(L, 1);
+    if (!ud.initialized) {
+        ud.initialized = (ud.provider->initialize() == 0);
+    }
+    lua_pushboolean(L, ud.initialized);
+    return 1;
+}
+
+int smartcard_provider_cleanup(lua_State *L) {
+    LuaSmartCardProvider &ud = check_smartcard_provider(L, 1);
+    if (ud.owned && ud.initialized) {
+        ud.provider->cleanup();
+        ud.initialized = false;
+    }
+    return 0;
+}
+
+int smartcard_provider_refresh(lua_State *L) {
+    LuaSmartCardProvider &ud = check_smartcard_provider(L, 1);
+    luaL_argcheck(L, ud.initialized, 1, "provider not initialized");
+    ud.provider->refresh();
+    return 0;
+}
+
+// provider:create_card_connection([terminal_name]), nil when no terminal matches. The connection
+// keeps the provider alive, its context being used until the connection is closed.
+int smartcard_provider_create_card_connection(lua_State *L) {
+    LuaSmartCardProvider &ud = check_smartcard_provider(L, 1);
+    luaL_argcheck(L, ud.initialized, 1, "provider not initialized");
+
+    CardConnection connection = lua_isnoneornil(L, 2) ? ud.provider->create_card_connection()
+                                                      : ud.provider->create_card_connection(luaL_checkstring(L, 2));
+    if (!connection.is_valid()) {
+        return 0;
+    }
+
+    auto lua_connection = (LuaCardConnection *)lua_newuserdatauv(L, sizeof(LuaCardConnection), 1);
+    Memory::construct_at(lua_connection);
+    lua_connection->connection = connection;
+    lua_connection->owned = true;
+    luaL_setmetatable(L, k_card_connection_metatable);
+
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, -2, 1);
+
+    return 1;
+}
+
+int smartcard_provider_gc(lua_State *L) {
+    LuaSmartCardProvider &ud = check_smartcard_provider(L, 1);
+    if (ud.owned) {
+        smartcard_provider_cleanup(L);
+        Memory::destroy_at(ud.provider);
+        TSG_FREE(ud.provider, sizeof(SmartCardProvider));
+    }
+    ud.provider = nullptr;
+    return 0;
+}
+
+const luaL_Reg smartcard_provider_methods[] = {
+    {"initialize", smartcard_provider_initialize},
+    {"cleanup", smartcard_provider_cleanup},
+    {"refresh", smartcard_provider_refresh},
+    {"create_card_connection", smartcard_provider_create_card_connection},
+    {nullptr, nullptr},
+};
+
+// smartcard.SmartCardProvider()
+int smartcard_provider_new(lua_State *L) {
+    auto provider = (SmartCardProvider *)TSG_ALLOC(sizeof(SmartCardProvider));
+    if (provider == nullptr) {
+        return luaL_error(L, "cannot allocate SmartCardProvider");
+    }
+    Memory::construct_at(provider);
+
+    auto ud = (LuaSmartCardProvider *)lua_newuserdatauv(L, sizeof(LuaSmartCardProvider), 0);
+    ud->provider = provider;
+    ud->owned = true;
+    ud->initialized = false;
+    luaL_setmetatable(L, k_smartcard_provider_metatable);
+    return 1;
+}
+
+} // namespace
+
+void push_smartcard_provider(lua_State *L, SmartCardProvider *provider) {
+    luaL_requiref(L, "smartcard", open_smartcard, 0); // the metatables are registered with the module
+    lua_pop(L, 1);
+
+    auto ud = (LuaSmartCardProvider *)lua_newuserdatauv(L, sizeof(LuaSmartCardProvider), 0);
+    ud->provider = provider;
+    ud->owned = false;
+    ud->initialized = true;
+    luaL_setmetatable(L, k_smartcard_provider_metatable);
+}
+
+void register_smartcard_provider(lua_State *L) {
+    luaL_newmetatable(L, k_smartcard_provider_metatable);
+    lua_pushcfunction(L, smartcard_provider_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_newtable(L);
+    luaL_setfuncs(L, smartcard_provider_methods, 0);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    lua_pushcfunction(L, smartcard_provider_new);
+    lua_setfield(L, -2, "SmartCardProvider");
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
@@ -0,0 +1,33 @@
+#include "smartcard_lua.hpp"
+#include "lua_internal.hpp"
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+int open_smartcard(lua_State *L) {
+    luaL_checkversion(L);
+
+    lua_newtable(L);
+    register_atr(L);
+    register_command_apdu(L);
+    register_response_apdu(L);
+    register_card_connection(L);
+    register_smartcard_provider(L);
+    register_batch_result(L);
+
+    return 1;
+}
+
+void preload_smartcard(lua_State *L) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+    lua_pushcfunction(L, open_smartcard);
+    lua_setfield(L, -2, "smartcard");
+    lua_pop(L, 1);
+}
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
+
+extern "C" int luaopen_smartcard(lua_State *L) { return tsg::smartcard::lua::open_smartcard(L); }
@@ -0,0 +1,32 @@
+#ifndef TSG_SMARTCARD_LUA_HPP
+#define TSG_SMARTCARD_LUA_HPP
+
+#include <lua.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+namespace tsg {
+namespace smartcard {
+namespace lua {
+
+// Pushes the 'smartcard' module table: SmartCardProvider, CommandAPDU, ResponseAPDU and the enum
+// constants. APDUs and ATRs are userdata indexed like byte arrays (1-based), strings are only made
+// on request (hex(), tostring()).
+int open_smartcard(lua_State *L);
+
+// Makes the module available through require("smartcard")
+void preload_smartcard(lua_State *L);
+
+// Pushes an initialized provider owned by the host, e.g. with virtual terminals registered. The
+// provider must outlive the state; cleanup() from a script leaves it untouched.
+void push_smartcard_provider(lua_State *L, SmartCardProvider *provider);
+
+// Pushes a connection owned by the host, which stays open when the script releases it
+void push_card_connection(lua_State *L, CardConnection *connection);
+
+} // namespace lua
+} // namespace smartcard
+} // namespace tsg
+
+extern "C" int luaopen_smartcard(lua_State *L);
+
+#endif // TSG_SMARTCARD_LUA_HPP
@@ -0,0 +1,187 @@
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/apdu_metrics.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+uint32_t highest_bit_of(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (uint32_t)index;
+#else
+    return 63 - (uint32_t)__builtin_clzll(value);
+#endif
+}
+
+} // namespace
+
+size_t LatencyHistogram::bucket_of(uint64_t value) {
+    if (value < k_sub_bucket_count) {
+        return (size_t)value;
+    }
+
+    uint32_t exponent = highest_bit_of(value);
+    if (exponent > k_max_exponent) {
+        return k_bucket_count - 1;
+    }
+
+    uint32_t shift = exponent - k_sub_bucket_bits;
+    size_t sub_bucket = (size_t)((value >> shift) & (k_sub_bucket_count - 1));
+    return (size_t)(exponent - k_sub_bucket_bits + 1) * k_sub_bucket_count + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t bucket) {
+    if (bucket < k_sub_bucket_count) {
+        return bucket;
+    }
+
+    uint32_t shift = (uint32_t)(bucket / k_sub_bucket_count) - 1;
+    uint64_t sub_bucket = bucket % k_sub_bucket_count;
+    return ((k_sub_bucket_count + sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value_ns) {
+    std::atomic<uint64_t> &bucket = m_buckets[bucket_of(value_ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_sum.store(m_sum.load(std::memory_order_relaxed) + value_ns, std::memory_order_relaxed);
+
+    if (value_ns < m_min.load(std::memory_order_relaxed)) {
+        m_min.store(value_ns, std::memory_order_relaxed);
+    }
+    if (value_ns > m_max.load(std::memory_order_relaxed)) {
+        m_max.store(value_ns, std::memory_order_relaxed);
+    }
+}
+
+LatencySnapshot LatencyHistogram::snapshot() const {
+    LatencySnapshot snapshot;
+
+    uint64_t counts[k_bucket_count];
+    for (size_t bucket = 0; bucket < k_bucket_count; bucket++) {
+        counts[bucket] = m_buckets[bucket].load(std::memory_order_relaxed);
+        snapshot.count += counts[bucket];
+    }
+    if (snapshot.count == 0) {
+        return snapshot;
+    }
+
+    snapshot.min_ns = m_min.load(std::memory_order_relaxed);
+    snapshot.max_ns = m_max.load(std::memory_order_relaxed);
+    snapshot.mean_ns = (double)m_sum.load(std::memory_order_relaxed) / (double)snapshot.count;
+
+    struct Percentile {
+        uint64_t rank;
+        uint64_t *value;
+    };
+    // Rank of the sample at or below which the given fraction of samples falls, at least the first one
+    auto rank_of = [&snapshot](uint64_t per_thousand) {
+        uint64_t rank = (snapshot.count * per_thousand + 999) / 1000;
+        return rank == 0 ? 1 : rank;
+    };
+    Percentile percentiles[] = {
+        {rank_of(500), &snapshot.p50_ns},
+        {rank_of(900), &snapshot.p90_ns},
+        {rank_of(990), &snapshot.p99_ns},
+        {rank_of(999), &snapshot.p999_ns},
+    };
+
+    size_t next = 0;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < k_bucket_count && next < 4; bucket++) {
+        seen += counts[bucket];
+        while (next < 4 && seen >= percentiles[next].rank) {
+            uint64_t value = bucket_upper_bound(bucket);
+            *percentiles[next].value = value < snapshot.max_ns ? value : snapshot.max_ns;
+            next++;
+        }
+    }
+
+    return snapshot;
+}
+
+APDUMetrics::~APDUMetrics() {
+    for (auto &instruction : m_instructions) {
+        LatencyHistogram *histogram = instruction.load(std::memory_order_relaxed);
+        if (histogram != nullptr) {
+            tsg::Memory::destroy_at(histogram);
+            TSG_FREE(histogram, sizeof(LatencyHistogram));
+        }
+    }
+}
+
+void APDUMetrics::record_round_trip(size_t capdu_size, size_t rapdu_size) {
+    add(m_round_trips, 1);
+    add(m_bytes_out, capdu_size);
+    add(m_bytes_in, rapdu_size);
+}
+
+void APDUMetrics::record_command(uint8_t ins, uint64_t latency_ns, uint32_t retries, uint32_t chaining_rounds,
+                                 bool failed) {
+    add(m_commands, 1);
+    add(m_retries, retries);
+    add(m_chaining_rounds, chaining_rounds);
+    if (failed) {
+        add(m_failures, 1);
+        return; // a failed exchange does not tell the card latency
+    }
+
+    m_latency.record(latency_ns);
+
+    LatencyHistogram *histogram = m_instructions[ins].load(std::memory_order_relaxed);
+    if (histogram == nullptr) {
+        histogram = (LatencyHistogram *)TSG_ALLOC(sizeof(LatencyHistogram));
+        if (histogram == nullptr) {
+            return;
+        }
+        tsg::Memory::construct_at(histogram);
+        m_instructions[ins].store(histogram, std::memory_order_release);
+    }
+    histogram->record(latency_ns);
+}
+
+void APDUMetrics::record_connect(uint64_t latency_ns, bool failed) {
+    add(m_connects, 1);
+    if (failed) {
+        add(m_connect_failures, 1);
+        return;
+    }
+    m_connect_latency.record(latency_ns);
+}
+
+void APDUMetrics::record_time_to_first_apdu(uint64_t elapsed_ns) { m_time_to_first_apdu.record(elapsed_ns); }
+
+APDUMetricsSnapshot APDUMetrics::get_snapshot() const {
+    APDUMetricsSnapshot snapshot;
+    snapshot.commands = m_commands.load(std::memory_order_relaxed);
+    snapshot.failures = m_failures.load(std::memory_order_relaxed);
+    snapshot.round_trips = m_round_trips.load(std::memory_order_relaxed);
+    snapshot.bytes_out = m_bytes_out.load(std::memory_order_relaxed);
+    snapshot.bytes_in = m_bytes_in.load(std::memory_order_relaxed);
+    snapshot.retries = m_retries.load(std::memory_order_relaxed);
+    snapshot.chaining_rounds = m_chaining_rounds.load(std::memory_order_relaxed);
+    snapshot.latency = m_latency.snapshot();
+    snapshot.connects = m_connects.load(std::memory_order_relaxed);
+    snapshot.connect_failures = m_connect_failures.load(std::memory_order_relaxed);
+    snapshot.connect_latency = m_connect_latency.snapshot();
+    snapshot.time_to_first_apdu = m_time_to_first_apdu.snapshot();
+    return snapshot;
+}
+
+int32_t APDUMetrics::get_instruction_snapshot(uint8_t ins, LatencySnapshot &snapshot) const {
+    const LatencyHistogram *histogram = m_instructions[ins].load(std::memory_order_acquire);
+    if (histogram == nullptr) {
+        return -1;
+    }
+    snapshot = histogram->snapshot();
+    return 0;
+}
+
+} // namespace smartcard
+} // namespace tsg
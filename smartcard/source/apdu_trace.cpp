@@ -0,0 +1,339 @@
+#include <cstring>
+#include <iostream>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/apdu_trace.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+void store_u16(uint8_t *target, uint16_t value) {
+    target[0] = (uint8_t)value;
+    target[1] = (uint8_t)(value >> 8);
+}
+
+void store_u32(uint8_t *target, uint32_t value) {
+    for (size_t index = 0; index < 4; index++) {
+        target[index] = (uint8_t)(value >> (8 * index));
+    }
+}
+
+void store_u64(uint8_t *target, uint64_t value) {
+    for (size_t index = 0; index < 8; index++) {
+        target[index] = (uint8_t)(value >> (8 * index));
+    }
+}
+
+uint16_t load_u16(const uint8_t *source) { return (uint16_t)(source[0] | (source[1] << 8)); }
+
+uint32_t load_u32(const uint8_t *source) {
+    uint32_t value = 0;
+    for (size_t index = 0; index < 4; index++) {
+        value |= (uint32_t)source[index] << (8 * index);
+    }
+    return value;
+}
+
+uint64_t load_u64(const uint8_t *source) {
+    uint64_t value = 0;
+    for (size_t index = 0; index < 8; index++) {
+        value |= (uint64_t)source[index] << (8 * index);
+    }
+    return value;
+}
+
+} // namespace
+
+int32_t TraceWriter::open(const char *path, const char *terminal_name) {
+    close();
+
+    m_file = fopen(path, "wb");
+    if (m_file == nullptr) {
+        std::cerr << "ERROR - trace: cannot open " << path << std::endl;
+        return -1;
+    }
+    m_buffer = (uint8_t *)TSG_ALLOC(k_buffer_size);
+    if (m_buffer == nullptr) {
+        fclose(m_file);
+        m_file = nullptr;
+        return -1;
+    }
+    m_buffer_size = 0;
+    m_start = std::chrono::steady_clock::now();
+    m_record_count = 0;
+
+    uint8_t header[k_trace_file_header_size] = {};
+    memcpy(header, k_trace_magic, sizeof(k_trace_magic));
+    store_u16(&header[8], k_trace_version);
+    store_u16(&header[10], (uint16_t)k_trace_file_header_size);
+    memcpy(m_buffer, header, sizeof(header));
+    m_buffer_size = sizeof(header);
+
+    size_t name_size = strlen(terminal_name);
+    if (name_size > UINT16_MAX) {
+        name_size = UINT16_MAX;
+    }
+    uint64_t wall_clock_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+    uint8_t *body = append_record(trace_record_session, 0, 0, 12 + name_size);
+    store_u64(&body[0], wall_clock_ns);
+    store_u16(&body[8], (uint16_t)name_size);
+    memcpy(&body[12], terminal_name, name_size);
+
+    return 0;
+}
+
+int32_t TraceWriter::close() {
+    if (m_file == nullptr) {
+        return 0;
+    }
+    int32_t result = flush();
+    if (fclose(m_file) != 0) {
+        result = -1;
+    }
+    m_file = nullptr;
+    TSG_FREE(m_buffer, k_buffer_size);
+    m_buffer = nullptr;
+    m_buffer_size = 0;
+    return result;
+}
+
+int32_t TraceWriter::flush() {
+    if (m_file == nullptr || m_buffer_size == 0) {
+        return 0;
+    }
+    size_t written = fwrite(m_buffer, 1, m_buffer_size, m_file);
+    bool failed = (written != m_buffer_size);
+    m_buffer_size = 0;
+    if (failed) {
+        std::cerr << "ERROR - trace: write failed" << std::endl;
+        return -1;
+    }
+    return fflush(m_file) == 0 ? 0 : -1;
+}
+
+void TraceWriter::write_connect(const ATR &atr, CardConnection::CommunicationProtocol protocol) {
+    if (m_file == nullptr) {
+        return;
+    }
+    uint8_t *body = append_record(trace_record_connect, 0, timestamp_of(std::chrono::steady_clock::now()),
+                                  8 + atr.size());
+    body[0] = (uint8_t)protocol;
+    store_u32(&body[4], (uint32_t)atr.size());
+    if (atr.size() > 0) {
+        memcpy(&body[8], atr.data(), atr.size());
+    }
+}
+
+void TraceWriter::write_exchange(std::chrono::steady_clock::time_point start, uint64_t latency_ns,
+                                 const uint8_t *capdu, size_t capdu_size, const uint8_t *rapdu, size_t rapdu_size,
+                                 bool failed) {
+    if (m_file == nullptr) {
+        return;
+    }
+    if (failed) {
+        rapdu_size = 0;
+    }
+    uint8_t *body = append_record(trace_record_exchange, failed ? trace_flag_transmit_failed : 0,
+                                  timestamp_of(start), 12 + capdu_size + rapdu_size);
+    store_u32(&body[0], latency_ns > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_ns);
+    store_u32(&body[4], (uint32_t)capdu_size);
+    store_u32(&body[8], (uint32_t)rapdu_size);
+    memcpy(&body[12], capdu, capdu_size);
+    if (rapdu_size > 0) {
+        memcpy(&body[12 + capdu_size], rapdu, rapdu_size);
+    }
+}
+
+void TraceWriter::write_disconnect() {
+    if (m_file == nullptr) {
+        return;
+    }
+    append_record(trace_record_disconnect, 0, timestamp_of(std::chrono::steady_clock::now()), 0);
+}
+
+uint8_t *TraceWriter::append_record(TraceRecordType type, uint8_t flags, uint64_t timestamp_ns, size_t body_size) {
+    size_t record_size = k_trace_record_header_size + body_size;
+    if (m_buffer_size + record_size > k_buffer_size) {
+        flush();
+    }
+
+    uint8_t *record = &m_buffer[m_buffer_size];
+    m_buffer_size += record_size;
+    store_u32(&record[0], (uint32_t)record_size);
+    record[4] = (uint8_t)type;
+    record[5] = flags;
+    store_u16(&record[6], 0);
+    store_u64(&record[8], timestamp_ns);
+    m_record_count++;
+
+    return &record[k_trace_record_header_size];
+}
+
+uint64_t TraceWriter::timestamp_of(std::chrono::steady_clock::time_point time) const {
+    if (time < m_start) {
+        return 0;
+    }
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(time - m_start).count();
+}
+
+int32_t TraceReader::open(const char *path) {
+    close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "ERROR - trace: cannot open " << path << std::endl;
+        return -1;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || (uint64_t)file_size.QuadPart < k_trace_file_header_size) {
+        CloseHandle(file);
+        std::cerr << "ERROR - trace: " << path << " is not a trace" << std::endl;
+        return -1;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void *data = (mapping == NULL ? NULL : MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data == NULL) {
+        if (mapping != NULL) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        std::cerr << "ERROR - trace: cannot map " << path << std::endl;
+        return -1;
+    }
+    m_file_handle = file;
+    m_mapping_handle = mapping;
+    m_size = (size_t)file_size.QuadPart;
+#else
+    int file = ::open(path, O_RDONLY);
+    if (file < 0) {
+        std::cerr << "ERROR - trace: cannot open " << path << std::endl;
+        return -1;
+    }
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0 || (uint64_t)file_stat.st_size < k_trace_file_header_size) {
+        ::close(file);
+        std::cerr << "ERROR - trace: " << path << " is not a trace" << std::endl;
+        return -1;
+    }
+    void *data = mmap(nullptr, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file); // the mapping stays valid
+    if (data == MAP_FAILED) {
+        std::cerr << "ERROR - trace: cannot map " << path << std::endl;
+        return -1;
+    }
+    madvise(data, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+    m_size = (size_t)file_stat.st_size;
+#endif
+    m_data = (const uint8_t *)data;
+
+    if (memcmp(m_data, k_trace_magic, sizeof(k_trace_magic)) != 0 || load_u16(&m_data[8]) != k_trace_version) {
+        std::cerr << "ERROR - trace: " << path << " is not a version " << k_trace_version << " trace" << std::endl;
+        close();
+        return -1;
+    }
+    size_t header_size = load_u16(&m_data[10]);
+    if (header_size < k_trace_file_header_size || header_size > m_size) {
+        std::cerr << "ERROR - trace: " << path << " has a header of " << header_size << " bytes" << std::endl;
+        close();
+        return -1;
+    }
+    m_header_size = header_size;
+    m_offset = header_size;
+
+    return 0;
+}
+
+void TraceReader::close() {
+    if (m_data == nullptr) {
+        return;
+    }
+#if defined(_WIN32)
+    UnmapViewOfFile(m_data);
+    CloseHandle((HANDLE)m_mapping_handle);
+    CloseHandle((HANDLE)m_file_handle);
+#else
+    munmap((void *)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_header_size = 0;
+    m_offset = 0;
+    m_file_handle = nullptr;
+    m_mapping_handle = nullptr;
+}
+
+bool TraceReader::next(TraceRecord &record) {
+    if (m_data == nullptr || m_size - m_offset < k_trace_record_header_size) {
+        return false;
+    }
+
+    const uint8_t *header = &m_data[m_offset];
+    size_t record_size = load_u32(&header[0]);
+    if (record_size < k_trace_record_header_size || record_size > m_size - m_offset) {
+        return false;
+    }
+    const uint8_t *body = header + k_trace_record_header_size;
+    size_t body_size = record_size - k_trace_record_header_size;
+
+    record = TraceRecord();
+    record.type = (TraceRecordType)header[4];
+    record.flags = header[5];
+    record.timestamp_ns = load_u64(&header[8]);
+
+    switch (record.type) {
+    case trace_record_session: {
+        if (body_size < 12 || body_size < 12 + (size_t)load_u16(&body[8])) {
+            return false;
+        }
+        record.wall_clock_ns = load_u64(&body[0]);
+        record.terminal_name_size = load_u16(&body[8]);
+        record.terminal_name = (const char *)&body[12];
+    } break;
+
+    case trace_record_connect: {
+        if (body_size < 8 || body_size < 8 + (size_t)load_u32(&body[4])) {
+            return false;
+        }
+        record.protocol = (CardConnection::CommunicationProtocol)body[0];
+        record.atr_size = load_u32(&body[4]);
+        record.atr = &body[8];
+    } break;
+
+    case trace_record_exchange: {
+        if (body_size < 12) {
+            return false;
+        }
+        record.latency_ns = load_u32(&body[0]);
+        record.capdu_size = load_u32(&body[4]);
+        record.rapdu_size = load_u32(&body[8]);
+        if (body_size < 12 + record.capdu_size + record.rapdu_size) {
+            return false;
+        }
+        record.capdu = &body[12];
+        record.rapdu = &body[12 + record.capdu_size];
+    } break;
+
+    default: // disconnect and record types of later versions carry nothing this reader uses
+        break;
+    }
+
+    m_offset += record_size;
+    return true;
+}
+
+} // namespace smartcard
+} // namespace tsg
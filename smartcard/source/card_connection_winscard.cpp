@@ -1,14 +1,22 @@
+#include "context_manager.hpp"
 #include "internal_winscard.hpp"
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <tsg/base/memory.hpp>
+#include <tsg/smartcard/apdu_trace.hpp>
 #include <tsg/smartcard/card_connection.hpp>
+#include <tsg/smartcard/virtual_terminal.hpp>
 
 namespace tsg {
 namespace smartcard {
 
 /* Temporal Start */
-void log_hexstring_of(uint8_t *bytes, size_t size, const char *prefix, const char *separator) {
+void log_hexstring_of(const uint8_t *bytes, size_t size, const char *prefix, const char *separator) {
     std::cout << prefix;
     for (size_t i = 0; i < size; i++) {
         char f, s;
@@ -25,8 +33,24 @@ void log_hexstring_of(ResponseAPDU &rapdu) { log_hexstring_of(rapdu.data(), rapd
 void log_hexstring_of(ATR &atr) { log_hexstring_of(atr.data(), atr.size(), "ATR - ", ""); }
 /* Temporal End */
 
+// Exchange thread of a connection, started by the first begin_transmit()
+struct AsyncTransmitState {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool pending{false};
+    bool completed{false};
+    bool stop{false};
+    std::vector<uint8_t> capdu;
+    ResponseAPDU rapdu;
+    std::function<void()> on_complete;
+};
+
+constexpr size_t k_max_atr_size = 36;
+
 struct CardConnectionImpl {
     SCARDCONTEXT context;
+    ContextManager *contexts{nullptr};
     TerminalData terminal;
 
     SCARDHANDLE card_handle;
@@ -34,23 +58,39 @@ struct CardConnectionImpl {
     CardConnection::CommunicationProtocol protocol;
 
     bool is_connected{false};
+    CardConnection::ShareMode share_mode{CardConnection::share_mode_shared};
+
+    // Nesting of begin_transaction(), and the strongest reset asked for by the nested scopes
+    uint32_t transaction_depth{0};
+    CardConnection::ResetType transaction_reset{CardConnection::reset_type_none};
 
     ATR atr_bytes;
-};
 
-bool impl_update_atr_bytes(CardConnectionImpl *impl) {
-    SCARD_READERSTATE reader_state;
-    reader_state.szReader = impl->terminal.name.c_str();
-    LONG rv = SCardGetStatusChange(impl->context, 2000, &reader_state, 1);
-    if (rv != SCARD_S_SUCCESS) {
-        std::cerr << "ERROR - winscard: " << rv << std::endl;
-        return false;
-    }
+    SelectionTracker selection;
+    ReadCache read_cache;
+    bool select_elision_enabled{false};
 
-    impl->atr_bytes = ATR(reader_state.rgbAtr, reader_state.cbAtr);
+    uint64_t round_trips{0};
+    bool apdu_trace_enabled{true};
 
-    return true;
-}
+    // Error of the last failed PC/SC call, read by the recovery
+    LONG last_error{SCARD_S_SUCCESS};
+    RecoveryPolicy recovery_policy;
+    RecoveryStatistics recovery_statistics;
+
+    // Largest Ne the reader carries, from its capabilities
+    size_t max_reader_ne{k_max_extended_ne};
+
+    APDUMetrics metrics;
+    TraceWriter *recorder{nullptr};
+
+    // When the provider saw the card, consumed by the first connect
+    std::chrono::steady_clock::time_point card_detected;
+    std::chrono::steady_clock::time_point first_apdu_reference;
+    bool first_apdu_pending{false};
+
+    AsyncTransmitState *async{nullptr};
+};
 
 bool impl_update_send_pci(CardConnectionImpl *impl, int32_t active_protocol) {
     switch (active_protocol) {
@@ -72,31 +112,269 @@ bool impl_update_send_pci(CardConnectionImpl *impl, int32_t active_protocol) {
     return true;
 }
 
+// ATR and protocol of the connected card from a single SCardStatus, which unlike SCardGetStatusChange
+// neither waits on the reader nor needs a reader state
+bool impl_update_card_status(CardConnectionImpl *impl) {
+    uint8_t atr[k_max_atr_size];
+    DWORD atr_size = sizeof(atr);
+    DWORD reader_length = 0;
+    DWORD state = 0;
+    DWORD active_protocol = 0;
+    LONG rv = SCardStatus(impl->card_handle, NULL, &reader_length, &state, &active_protocol, atr, &atr_size);
+    if (rv != SCARD_S_SUCCESS) {
+        std::cerr << "ERROR - winscard: " << rv << std::endl;
+        return false;
+    }
+
+    impl->atr_bytes = ATR(atr, atr_size);
+    return impl_update_send_pci(impl, (int32_t)active_protocol);
+}
+
+#ifndef CM_IOCTL_GET_FEATURE_REQUEST
+#define CM_IOCTL_GET_FEATURE_REQUEST SCARD_CTL_CODE(3400)
+#endif
+
+// Tags of the FEATURE_GET_TLV_PROPERTIES response (PC/SC part 10)
+constexpr uint8_t k_tlv_property_firmware_id = 0x08;
+constexpr uint8_t k_tlv_property_max_apdu_data_size = 0x0A;
+constexpr uint8_t k_tlv_property_vendor_id = 0x0B;
+constexpr uint8_t k_tlv_property_product_id = 0x0C;
+
+uint32_t impl_load_le(const uint8_t *bytes, size_t size) {
+    uint32_t value = 0;
+    for (size_t index = 0; index < size && index < 4; index++) {
+        value |= (uint32_t)bytes[index] << (8 * index);
+    }
+    return value;
+}
+
+std::string impl_get_string_attrib(CardConnectionImpl *impl, DWORD attribute) {
+    uint8_t value[256];
+    DWORD size = sizeof(value);
+    if (SCardGetAttrib(impl->card_handle, attribute, value, &size) != SCARD_S_SUCCESS) {
+        return std::string();
+    }
+    while (size > 0 && value[size - 1] == 0) { // NUL terminated by some stacks
+        size--;
+    }
+    return std::string((const char *)value, size);
+}
+
+uint32_t impl_get_integer_attrib(CardConnectionImpl *impl, DWORD attribute) {
+    uint8_t value[8];
+    DWORD size = sizeof(value);
+    if (SCardGetAttrib(impl->card_handle, attribute, value, &size) != SCARD_S_SUCCESS) {
+        return 0;
+    }
+    return impl_load_le(value, size);
+}
+
+// Attributes and part 10 features of the reader, each query answered or not independently
+void impl_discover_capabilities(CardConnectionImpl *impl, ReaderCapabilities &capabilities) {
+    capabilities.vendor_name = impl_get_string_attrib(impl, SCARD_ATTR_VENDOR_NAME);
+    capabilities.ifd_type = impl_get_string_attrib(impl, SCARD_ATTR_VENDOR_IFD_TYPE);
+    capabilities.ifd_version = impl_get_integer_attrib(impl, SCARD_ATTR_VENDOR_IFD_VERSION);
+    capabilities.max_ifsd = impl_get_integer_attrib(impl, SCARD_ATTR_MAX_IFSD);
+
+    // Tag, length 4 and a big-endian control code per feature
+    uint8_t features[256];
+    DWORD features_size = 0;
+    if (SCardControl(impl->card_handle, CM_IOCTL_GET_FEATURE_REQUEST, NULL, 0, features, sizeof(features),
+                     &features_size) == SCARD_S_SUCCESS) {
+        for (size_t offset = 0; offset + 2 <= features_size; offset += 2 + features[offset + 1]) {
+            uint8_t tag = features[offset];
+            uint8_t length = features[offset + 1];
+            if (offset + 2 + length > features_size) {
+                break;
+            }
+            if (length == 4 && tag < k_reader_feature_count) {
+                const uint8_t *code = &features[offset + 2];
+                capabilities.feature_control_codes[tag] =
+                    ((uint32_t)code[0] << 24) | ((uint32_t)code[1] << 16) | ((uint32_t)code[2] << 8) | code[3];
+            }
+        }
+    }
+
+    // Tag, length and a little-endian value (or a string) per property
+    uint32_t properties_code = capabilities.get_control_code(reader_feature_get_tlv_properties);
+    uint8_t properties[256];
+    DWORD properties_size = 0;
+    if (properties_code != 0 && SCardControl(impl->card_handle, properties_code, NULL, 0, properties,
+                                             sizeof(properties), &properties_size) == SCARD_S_SUCCESS) {
+        for (size_t offset = 0; offset + 2 <= properties_size; offset += 2 + properties[offset + 1]) {
+            uint8_t tag = properties[offset];
+            uint8_t length = properties[offset + 1];
+            const uint8_t *value = &properties[offset + 2];
+            if (offset + 2 + length > properties_size) {
+                break;
+            }
+
+            switch (tag) {
+            case k_tlv_property_firmware_id: {
+                capabilities.firmware_id.assign((const char *)value, length);
+            } break;
+
+            case k_tlv_property_max_apdu_data_size: {
+                // 0 for short APDUs only, 261 to 65544 with extended ones
+                capabilities.max_apdu_data_size = impl_load_le(value, length);
+                capabilities.extended_apdu = capabilities.max_apdu_data_size > 0 ? reader_support_available
+                                                                                 : reader_support_unavailable;
+            } break;
+
+            case k_tlv_property_vendor_id: {
+                capabilities.vendor_id = (uint16_t)impl_load_le(value, length);
+            } break;
+
+            case k_tlv_property_product_id: {
+                capabilities.product_id = (uint16_t)impl_load_le(value, length);
+            } break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    capabilities.discovered = true;
+}
+
+// Discovers the reader on its first connection, and keeps the largest Ne it carries at hand
+void impl_update_capabilities(CardConnectionImpl *impl) {
+    ReaderCapabilityCache *cache = impl->terminal.capabilities;
+    if (cache == nullptr || impl->terminal.virtual_terminal != nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    if (!cache->capabilities.discovered) {
+        impl_discover_capabilities(impl, cache->capabilities);
+    }
+
+    const ReaderCapabilities &capabilities = cache->capabilities;
+    impl->max_reader_ne = k_max_extended_ne;
+    if (capabilities.extended_apdu == reader_support_unavailable) {
+        impl->max_reader_ne = k_max_short_ne;
+    } else if (capabilities.max_apdu_data_size > k_max_short_ne &&
+               capabilities.max_apdu_data_size < k_max_extended_ne) {
+        impl->max_reader_ne = capabilities.max_apdu_data_size;
+    }
+}
+
+// Connect latency, and the reference the first round-trip of the session is timed from
+void impl_record_connect_latency(CardConnectionImpl *impl, std::chrono::steady_clock::time_point start,
+                                 bool failed) {
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    impl->metrics.record_connect((uint64_t)latency.count(), failed);
+    if (failed) {
+        return;
+    }
+
+    impl->first_apdu_reference = start;
+    if (impl->card_detected != std::chrono::steady_clock::time_point()) {
+        impl->first_apdu_reference = impl->card_detected;
+        impl->card_detected = std::chrono::steady_clock::time_point();
+    }
+    impl->first_apdu_pending = true;
+}
+
+DWORD impl_share_mode_of(const CardConnectionImpl *impl) {
+    return impl->share_mode == CardConnection::share_mode_exclusive ? SCARD_SHARE_EXCLUSIVE : SCARD_SHARE_SHARED;
+}
+
+// Waits until the reader state has the bits of 'mask' set (or cleared), returning 0 once it has, 1 on
+// timeout and -1 on error. 'waited' tells whether the state changed during the call.
+int32_t impl_wait_reader_state(CardConnectionImpl *impl, DWORD mask, bool set, uint32_t timeout_ms, bool &waited) {
+    SCARDCONTEXT context = impl->context;
+    if (impl->contexts != nullptr && impl->contexts->acquire(context) != 0) {
+        return -1;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    auto remaining_ms = [&deadline, timeout_ms]() {
+        if (timeout_ms == CardConnection::k_wait_forever) {
+            return (DWORD)SCARD_INFINITE;
+        }
+        auto remaining =
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return remaining.count() > 0 ? (DWORD)remaining.count() : (DWORD)0;
+    };
+
+    SCARD_READERSTATE reader_state = {};
+    reader_state.szReader = impl->terminal.name.c_str();
+    reader_state.dwCurrentState = SCARD_STATE_UNAWARE;
+    waited = false;
+    while (true) {
+        LONG rv = SCardGetStatusChange(context, waited ? remaining_ms() : 0, &reader_state, 1);
+        if (rv == SCARD_E_TIMEOUT) {
+            if (remaining_ms() == 0) {
+                return 1;
+            }
+            waited = true;
+            continue;
+        }
+        if (rv != SCARD_S_SUCCESS) {
+            if (impl->contexts != nullptr && ContextManager::is_service_lost(rv)) {
+                impl->contexts->invalidate();
+            }
+            std::cerr << "ERROR - winscard: " << rv << std::endl;
+            return -1;
+        }
+
+        if (((reader_state.dwEventState & mask) != 0) == set) {
+            return 0;
+        }
+        if (waited && remaining_ms() == 0) {
+            return 1;
+        }
+        reader_state.dwCurrentState = reader_state.dwEventState & ~SCARD_STATE_CHANGED;
+        waited = true;
+    }
+}
+
 void impl_swap(CardConnectionImpl &a, CardConnectionImpl &b) {
 
     auto aux_context = a.context;
+    auto aux_contexts = a.contexts;
     auto aux_terminal = a.terminal;
     auto aux_card_handle = a.card_handle;
     auto aux_send_pci = a.send_pci;
     auto aux_protocol = a.protocol;
     auto aux_is_connected = a.is_connected;
     auto aux_atr_bytes = a.atr_bytes;
+    auto aux_selection = a.selection;
 
     a.context = b.context;
+    a.contexts = b.contexts;
     a.terminal = b.terminal;
     a.card_handle = b.card_handle;
     a.send_pci = b.send_pci;
     a.protocol = b.protocol;
     a.is_connected = b.is_connected;
     a.atr_bytes = b.atr_bytes;
+    a.selection = b.selection;
 
     b.context = aux_context;
+    b.contexts = aux_contexts;
     b.terminal = aux_terminal;
     b.card_handle = aux_card_handle;
     b.send_pci = aux_send_pci;
     b.protocol = aux_protocol;
     b.is_connected = aux_is_connected;
     b.atr_bytes = aux_atr_bytes;
+    b.selection = aux_selection;
+
+    std::swap(a.read_cache, b.read_cache);
+}
+
+void impl_invalidate_card_state(CardConnectionImpl *impl) {
+    impl->selection.invalidate();
+    impl->read_cache.invalidate();
+}
+
+void impl_record_connect(CardConnectionImpl *impl) {
+    if (impl->recorder != nullptr) {
+        impl->recorder->write_connect(impl->atr_bytes, impl->protocol);
+    }
 }
 
 static char *pcsc_stringify_error(LONG rv)
@@ -113,20 +391,189 @@ static char *pcsc_stringify_error(LONG rv)
   printf(f ": %s\n", pcsc_stringify_error(rv)); \
  }
 
-ResponseAPDU impl_transmit(CardConnectionImpl *impl, CommandAPDU &capdu) {
-    SCARD_IO_REQUEST send_pci = impl->send_pci;
+constexpr uint32_t k_max_get_response_rounds = 256;
 
-    uint8_t buffer[2048];
-    unsigned long length = sizeof(buffer);
+int32_t impl_transmit_bytes(CardConnectionImpl *impl, const uint8_t *capdu, size_t capdu_size, uint8_t *response,
+                            size_t &response_size) {
+    if (impl->terminal.virtual_terminal != nullptr) {
+        if (impl->terminal.virtual_terminal->transmit(capdu, capdu_size, response, response_size) != 0) {
+            response_size = 0;
+            return -1;
+        }
+        return 0;
+    }
+
+    SCARD_IO_REQUEST send_pci = impl->send_pci;
+    DWORD length = (DWORD)response_size;
 
-    LONG rv = SCardTransmit(impl->card_handle, &send_pci, capdu.data(), capdu.size(), NULL, buffer, &length);
+    LONG rv = SCardTransmit(impl->card_handle, &send_pci, capdu, (DWORD)capdu_size, NULL, response, &length);
     CHECK("SCardTransmit", rv);
 
     if (rv != SCARD_S_SUCCESS) {
-        return ResponseAPDU();
+        impl->last_error = rv;
+        response_size = 0;
+        return -1;
     }
+    response_size = length;
+    return 0;
+}
+
+// Single round-trip, 'response_size' holds the capacity of 'response' on input
+int32_t impl_transmit(CardConnectionImpl *impl, const uint8_t *capdu, size_t capdu_size, uint8_t *response,
+                      size_t &response_size) {
+    impl->round_trips++;
+
+    if (impl->first_apdu_pending) {
+        impl->first_apdu_pending = false;
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                            impl->first_apdu_reference);
+        impl->metrics.record_time_to_first_apdu((uint64_t)elapsed.count());
+    }
+
+    if (impl->apdu_trace_enabled) {
+        std::cout << "[TRACE] - ";
+        log_hexstring_of(capdu, capdu_size, "C-APDU - ", "");
+    }
+
+    if (impl->recorder != nullptr) {
+        auto start = std::chrono::steady_clock::now();
+        int32_t result = impl_transmit_bytes(impl, capdu, capdu_size, response, response_size);
+        auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        impl->recorder->write_exchange(start, (uint64_t)latency.count(), capdu, capdu_size, response, response_size,
+                                       result != 0);
+        if (result != 0) {
+            return -1;
+        }
+    } else if (impl_transmit_bytes(impl, capdu, capdu_size, response, response_size) != 0) {
+        return -1;
+    }
+    impl->metrics.record_round_trip(capdu_size, response_size);
+
+    if (impl->apdu_trace_enabled) {
+        std::cout << "[TRACE] - ";
+        log_hexstring_of(response, response_size, "R-APDU - ", "");
+    }
+
+    return 0;
+}
+
+// Offset of Le in a short command, appending it to case 1 and case 3 commands, zero for extended commands
+size_t impl_short_le_offset(const uint8_t *capdu, size_t capdu_size) {
+    if (capdu_size < 4) {
+        return 0;
+    }
+    if (capdu_size == 4 || capdu_size == 5) {
+        return 4;
+    }
+    if (capdu[4] != 0x00 && capdu_size == 5 + (size_t)capdu[4]) {
+        return capdu_size;
+    }
+    if (capdu[4] != 0x00 && capdu_size == 6 + (size_t)capdu[4]) {
+        return capdu_size - 1;
+    }
+    return 0;
+}
+
+// Exchanges a command, resending it with the Le indicated by a 6Cxx and collecting 61xx response
+// bytes with GET RESPONSE, each part being received in place right after the previous one.
+int32_t impl_exchange_parts(CardConnectionImpl *impl, const uint8_t *capdu, size_t capdu_size, uint8_t *response,
+                            size_t &response_size, uint32_t &retries, uint32_t &chaining_rounds) {
+    size_t capacity = response_size;
+    response_size = capacity;
+    if (impl_transmit(impl, capdu, capdu_size, response, response_size) != 0 || response_size < 2) {
+        return -1;
+    }
+
+    size_t le_offset = impl_short_le_offset(capdu, capdu_size);
+    if (response[response_size - 2] == StatusWord::wrong_length_le && le_offset != 0) {
+        uint8_t retry_capdu[k_max_short_capdu_length];
+        memcpy(retry_capdu, capdu, capdu_size);
+        retry_capdu[le_offset] = response[response_size - 1];
+        size_t retry_size = (le_offset == capdu_size) ? capdu_size + 1 : capdu_size;
+
+        retries++;
+        response_size = capacity;
+        if (impl_transmit(impl, retry_capdu, retry_size, response, response_size) != 0 || response_size < 2) {
+            return -1;
+        }
+    }
+
+    for (uint32_t rounds = 0; response[response_size - 2] == StatusWord::response_bytes_still_available; rounds++) {
+        if (rounds == k_max_get_response_rounds) {
+            return -1;
+        }
+
+        uint8_t get_response_bytes_capdu[5] = {0x80, 0xC0, 0x00, 0x00, response[response_size - 1]};
+
+        size_t offset = response_size - 2;
+        size_t part_size = capacity - offset;
+        chaining_rounds++;
+        if (impl_transmit(impl, get_response_bytes_capdu, sizeof(get_response_bytes_capdu), response + offset,
+                          part_size) != 0 ||
+            part_size < 2) {
+            return -1;
+        }
+        response_size = offset + part_size;
+    }
+
+    return 0;
+}
+
+// Exchange of a command with its latency recorded, from the first round-trip to the last response part
+int32_t impl_exchange(CardConnectionImpl *impl, const uint8_t *capdu, size_t capdu_size, uint8_t *response,
+                      size_t &response_size) {
+    uint32_t retries = 0;
+    uint32_t chaining_rounds = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    int32_t result = impl_exchange_parts(impl, capdu, capdu_size, response, response_size, retries, chaining_rounds);
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
 
-    return ResponseAPDU(buffer, length);
+    impl->metrics.record_command(capdu_size >= 2 ? capdu[1] : 0x00, (uint64_t)latency.count(), retries,
+                                 chaining_rounds, result != 0);
+    return result;
+}
+
+void impl_replay_pending_selection(CardConnectionImpl *impl, const uint8_t *capdu, size_t capdu_size) {
+    uint8_t pending_capdu[k_max_short_capdu_length];
+    size_t pending_capdu_size = sizeof(pending_capdu);
+    if (impl->read_cache.take_pending_selection(capdu, capdu_size, pending_capdu, pending_capdu_size)) {
+        uint8_t response[k_max_rapdu_length];
+        size_t response_size = sizeof(response);
+        impl_exchange(impl, pending_capdu, pending_capdu_size, response, response_size);
+    }
+}
+
+// SELECT of the current DF when it was selected by DF name, by path from the MF or as the MF itself,
+// 0 when it cannot be selected again with a single command
+size_t impl_reselect_capdu_of(const SelectionTracker &selection, uint8_t *capdu, size_t capacity) {
+    const uint8_t *path = selection.path();
+    if (!selection.is_known() || selection.df_path_size() < 3 || selection.df_path_size() != 3 + (size_t)path[2]) {
+        return 0;
+    }
+    uint8_t p1 = path[1];
+    size_t data_size = path[2];
+    if (p1 != apdu::select_p1_df_name && p1 != apdu::select_p1_path_from_mf && p1 != apdu::select_p1_file_id) {
+        return 0;
+    }
+    if (data_size == 0 || 6 + data_size > capacity) {
+        return 0;
+    }
+
+    capdu[0] = 0x00;
+    capdu[1] = apdu::ins_select;
+    capdu[2] = p1;
+    capdu[3] = 0x00;
+    capdu[4] = (uint8_t)data_size;
+    memcpy(&capdu[5], &path[3], data_size);
+    capdu[5 + data_size] = 0x00;
+    return 6 + data_size;
+}
+
+void impl_wait_backoff(CardConnectionImpl *impl, uint32_t attempt) {
+    uint32_t backoff_ms = compute_backoff_ms(impl->recovery_policy, attempt);
+    impl->recovery_statistics.backoff_ms += backoff_ms;
+    std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
 }
 
 CardConnection::CardConnection() { m_impl = nullptr; }
@@ -144,14 +591,36 @@ int32_t CardConnection::initialize(CardConnectCI &ci) {
     }
 
     m_impl->context = ci.context;
+    m_impl->contexts = ci.contexts;
     m_impl->terminal = ci.terminal;
+    m_impl->card_detected = ci.card_detected;
     m_impl->is_connected = false;
+    impl_invalidate_card_state(m_impl);
 
     return 0;
 }
 
+void impl_stop_async_transmit(CardConnectionImpl *impl) {
+    if (impl->async == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(impl->async->mutex);
+        impl->async->stop = true;
+    }
+    impl->async->condition.notify_all();
+    impl->async->thread.join();
+
+    tsg::Memory::destroy_at(impl->async);
+    TSG_FREE(impl->async, sizeof(AsyncTransmitState));
+    impl->async = nullptr;
+}
+
 int32_t CardConnection::cleanup() {
     if (m_impl != nullptr) {
+        impl_stop_async_transmit(m_impl);
+        stop_recording();
         tsg::Memory::destroy_at(m_impl);
         TSG_FREE(m_impl, sizeof(CardConnectionImpl));
         m_impl = nullptr;
@@ -170,23 +639,66 @@ int32_t CardConnection::connect() {
         return 0;
     }
 
+    auto start = std::chrono::steady_clock::now();
+
+    if (m_impl->terminal.virtual_terminal != nullptr) {
+        if (m_impl->terminal.virtual_terminal->power_on(reset_type_cold, m_impl->atr_bytes, m_impl->protocol) != 0) {
+            impl_record_connect_latency(m_impl, start, true);
+            return -1;
+        }
+        m_impl->is_connected = true;
+        impl_invalidate_card_state(m_impl);
+        impl_record_connect(m_impl);
+        impl_record_connect_latency(m_impl, start, false);
+        return 0;
+    }
+
+    // The card handle belongs to the context of the connecting thread
+    if (m_impl->contexts != nullptr && m_impl->contexts->acquire(m_impl->context) != 0) {
+        impl_record_connect_latency(m_impl, start, true);
+        return -1;
+    }
+
     SCARDHANDLE card_handle = 0;
     DWORD active_protocol;
-    LONG rv = SCardConnect(m_impl->context, m_impl->terminal.name.c_str(), SCARD_SHARE_SHARED,
+    LONG rv = SCardConnect(m_impl->context, m_impl->terminal.name.c_str(), impl_share_mode_of(m_impl),
                            SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &card_handle, &active_protocol);
+    if (m_impl->contexts != nullptr && ContextManager::is_service_lost(rv)) {
+        m_impl->contexts->invalidate();
+        if (m_impl->contexts->acquire(m_impl->context) == 0) {
+            rv = SCardConnect(m_impl->context, m_impl->terminal.name.c_str(), impl_share_mode_of(m_impl),
+                              SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &card_handle, &active_protocol);
+        }
+    }
+    // Another application holding the card exclusively, or the reader getting ready
+    for (uint32_t attempt = 0; classify_pcsc_error((uint32_t)rv) == recovery_action_retry &&
+                               attempt < m_impl->recovery_policy.max_retries;
+         attempt++) {
+        impl_wait_backoff(m_impl, attempt);
+        m_impl->recovery_statistics.retries++;
+        rv = SCardConnect(m_impl->context, m_impl->terminal.name.c_str(), impl_share_mode_of(m_impl),
+                          SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &card_handle, &active_protocol);
+    }
     if (rv != SCARD_S_SUCCESS) {
+        m_impl->last_error = rv;
         if (rv == SCARD_W_REMOVED_CARD) {
             std::cerr << "ERROR - winscard: Card removed" << std::endl;
         } else {
             std::cerr << "ERROR - winscard: " << rv << std::endl;
         }
+        impl_record_connect_latency(m_impl, start, true);
         return -1;
     }
     m_impl->card_handle = card_handle;
     m_impl->is_connected = true;
+    impl_invalidate_card_state(m_impl);
 
-    impl_update_atr_bytes(m_impl);
-    impl_update_send_pci(m_impl, active_protocol);
+    if (!impl_update_card_status(m_impl)) {
+        impl_update_send_pci(m_impl, active_protocol);
+    }
+    impl_update_capabilities(m_impl);
+    impl_record_connect(m_impl);
+    impl_record_connect_latency(m_impl, start, false);
 
     return 0;
 }
@@ -199,26 +711,60 @@ int32_t CardConnection::reconnect(ResetType reset_type) {
     DWORD initialization = SCARD_RESET_CARD;
     if (reset_type == ResetType::reset_type_cold) {
         initialization = SCARD_UNPOWER_CARD;
+    } else if (reset_type == ResetType::reset_type_none) {
+        initialization = SCARD_LEAVE_CARD;
+    }
+
+    impl_invalidate_card_state(m_impl);
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (m_impl->terminal.virtual_terminal != nullptr) {
+        if (m_impl->terminal.virtual_terminal->power_on(reset_type, m_impl->atr_bytes, m_impl->protocol) != 0) {
+            impl_record_connect_latency(m_impl, start, true);
+            return -1;
+        }
+        impl_record_connect(m_impl);
+        impl_record_connect_latency(m_impl, start, false);
+        return 0;
     }
 
-    rv = SCardReconnect(m_impl->card_handle, SCARD_SHARE_SHARED, SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, initialization,
-                        &active_protocol);
+    rv = SCardReconnect(m_impl->card_handle, impl_share_mode_of(m_impl), SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
+                        initialization, &active_protocol);
     if (rv != SCARD_S_SUCCESS) {
+        m_impl->last_error = rv;
         if (rv == SCARD_W_REMOVED_CARD) {
             std::cerr << "ERROR - winscard: Card removed" << std::endl;
         } else {
             std::cerr << "ERROR - winscard: " << rv << std::endl;
         }
+        impl_record_connect_latency(m_impl, start, true);
         return -1;
     }
 
-    impl_update_atr_bytes(m_impl);
-    impl_update_send_pci(m_impl, active_protocol);
+    if (!impl_update_card_status(m_impl)) {
+        impl_update_send_pci(m_impl, active_protocol);
+    }
+    impl_record_connect(m_impl);
+    impl_record_connect_latency(m_impl, start, false);
 
     return 0;
 }
 
 int32_t CardConnection::disconnect() {
+    impl_invalidate_card_state(m_impl);
+    // Disconnecting ends a transaction in progress
+    m_impl->transaction_depth = 0;
+    m_impl->transaction_reset = reset_type_none;
+    if (m_impl->recorder != nullptr) {
+        m_impl->recorder->write_disconnect();
+    }
+
+    if (m_impl->terminal.virtual_terminal != nullptr) {
+        m_impl->is_connected = false;
+        return m_impl->terminal.virtual_terminal->power_off();
+    }
+
     LONG rv = SCardDisconnect(m_impl->card_handle, SCARD_LEAVE_CARD);
     if (rv != SCARD_S_SUCCESS) {
         std::cerr << "ERROR - winscard: " << rv << std::endl;
@@ -229,34 +775,244 @@ int32_t CardConnection::disconnect() {
     return 0;
 }
 
-ResponseAPDU CardConnection::transmit(CommandAPDU &capdu) {
-    std::cout << "[TRACE] - ";
-    log_hexstring_of(capdu);
+int32_t CardConnection::exchange(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) {
+    size_t capacity = response_size;
+    m_impl->last_error = SCARD_S_SUCCESS;
+    if (impl_exchange(m_impl, capdu, capdu_size, response, response_size) == 0) {
+        return 0;
+    }
 
-    ResponseAPDU rapdu = impl_transmit(m_impl, capdu);
-    std::cout << "[TRACE] - ";
-    log_hexstring_of(rapdu);
+    const RecoveryPolicy &policy = m_impl->recovery_policy;
+    RecoveryStatistics &statistics = m_impl->recovery_statistics;
+    ReplayKind replay = replay_kind_of(capdu, capdu_size);
 
-    if (rapdu.get_sw1() == StatusWord::wrong_length_le) {
-        capdu.back() = rapdu.get_sw2();
-        std::cout << "[TRACE] - ";
-        log_hexstring_of(capdu);
-        rapdu = impl_transmit(m_impl, capdu);
-        std::cout << "[TRACE] - ";
-        log_hexstring_of(rapdu);
-    } else if (rapdu.get_sw1() == StatusWord::response_bytes_still_available) {
-        CommandAPDU get_response_bytes_capdu("80C00000");
-        get_response_bytes_capdu.push_back(rapdu.get_sw2());
-        std::cout << "[TRACE] - ";
-        log_hexstring_of(get_response_bytes_capdu);
-        rapdu = impl_transmit(m_impl, get_response_bytes_capdu);
-        std::cout << "[TRACE] - ";
-        log_hexstring_of(rapdu);
+    // Failures without a PC/SC error (virtual terminal, malformed response) are not recovered
+    if (m_impl->last_error != SCARD_S_SUCCESS) {
+        statistics.errors++;
     }
+    for (uint32_t attempt = 0; m_impl->last_error != SCARD_S_SUCCESS; attempt++) {
+        RecoveryAction action = classify_pcsc_error((uint32_t)m_impl->last_error);
+        bool loses_state = (action == recovery_action_reconnect || action == recovery_action_reconnect_reset ||
+                            action == recovery_action_connect);
+
+        // A transaction does not survive the card losing its state, the application has to start over
+        if (action == recovery_action_fail ||
+            (loses_state && (m_impl->transaction_depth > 0 || !policy.reconnect_enabled))) {
+            statistics.unrecoverable++;
+            return -1;
+        }
+        if (action != recovery_action_retry && replay == replay_kind_none) {
+            statistics.not_replayable++;
+            return -1;
+        }
+        if (attempt >= policy.max_retries) {
+            statistics.exhausted++;
+            return -1;
+        }
+
+        uint8_t reselect_capdu[k_max_short_capdu_length];
+        size_t reselect_capdu_size = 0;
+        if (loses_state && replay == replay_kind_in_current_df) {
+            reselect_capdu_size = impl_reselect_capdu_of(m_impl->selection, reselect_capdu, sizeof(reselect_capdu));
+            if (reselect_capdu_size == 0) {
+                statistics.not_replayable++;
+                return -1;
+            }
+        }
+
+        impl_wait_backoff(m_impl, attempt);
+        m_impl->last_error = SCARD_S_SUCCESS;
+
+        if (action == recovery_action_connect) {
+            statistics.connects++;
+            SCardDisconnect(m_impl->card_handle, SCARD_LEAVE_CARD);
+            m_impl->is_connected = false;
+            if (connect() != 0) {
+                continue;
+            }
+        } else if (loses_state) {
+            statistics.reconnects++;
+            if (reconnect(action == recovery_action_reconnect ? reset_type_none : reset_type_warm) != 0) {
+                continue;
+            }
+        }
+
+        if (reselect_capdu_size != 0) {
+            statistics.reselections++;
+            response_size = capacity;
+            if (impl_exchange(m_impl, reselect_capdu, reselect_capdu_size, response, response_size) != 0) {
+                continue;
+            }
+            ResponseAPDU rapdu = response_size <= k_max_rapdu_length ? ResponseAPDU(response, response_size)
+                                                                     : ResponseAPDU(response + response_size - 2, 2);
+            m_impl->selection.observe(reselect_capdu, reselect_capdu_size, rapdu);
+            if (rapdu.size() < 2 || !rapdu.sw_is(StatusWord::normal_processing, 0x00)) {
+                statistics.not_replayable++;
+                return -1;
+            }
+        }
+
+        if (loses_state) {
+            statistics.replays++;
+        } else {
+            statistics.retries++;
+        }
+        response_size = capacity;
+        if (impl_exchange(m_impl, capdu, capdu_size, response, response_size) == 0) {
+            statistics.recovered++;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+ResponseAPDU CardConnection::transmit(CommandAPDU &capdu) { return transmit(capdu.data(), capdu.size()); }
+
+ResponseAPDU CardConnection::transmit(const uint8_t *capdu, size_t capdu_size) {
+    ResponseAPDU rapdu;
+    if (m_impl->select_elision_enabled && m_impl->selection.elide(capdu, capdu_size, rapdu)) {
+        return rapdu;
+    }
+
+    if (m_impl->read_cache.lookup(m_impl->selection, capdu, capdu_size, rapdu)) {
+        m_impl->selection.observe(capdu, capdu_size, rapdu);
+        return rapdu;
+    }
+
+    impl_replay_pending_selection(m_impl, capdu, capdu_size);
+
+    uint8_t buffer[2048];
+    size_t length = sizeof(buffer);
+    uint64_t round_trips = m_impl->round_trips;
+    int32_t result = exchange(capdu, capdu_size, buffer, length);
+    round_trips = m_impl->round_trips - round_trips;
+    if (result != 0) { // transmission failure, the card may have been removed or reset
+        impl_invalidate_card_state(m_impl);
+        return rapdu;
+    }
+
+    // Longer responses (extended Le, chained 61xx) would lose SW1 SW2 in a ResponseAPDU
+    if (length > k_max_rapdu_length) {
+        std::cerr << "ERROR - winscard: response of " << length
+                  << " bytes beyond the short form, use transmit(capdu, capdu_size, response, response_size)"
+                  << std::endl;
+        return rapdu;
+    }
+
+    rapdu = ResponseAPDU(buffer, length);
+    m_impl->read_cache.observe(m_impl->selection, capdu, capdu_size, rapdu);
+    m_impl->selection.observe(capdu, capdu_size, rapdu, (uint32_t)round_trips);
 
     return rapdu;
 }
 
+int32_t CardConnection::transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) {
+    impl_replay_pending_selection(m_impl, capdu, capdu_size);
+
+    uint64_t round_trips = m_impl->round_trips;
+    int32_t result = exchange(capdu, capdu_size, response, response_size);
+    round_trips = m_impl->round_trips - round_trips;
+    if (result != 0) {
+        impl_invalidate_card_state(m_impl);
+        return -1;
+    }
+
+    if (ReadCache::is_write_command(capdu, capdu_size)) {
+        m_impl->read_cache.invalidate();
+    }
+
+    // Only a SELECT needs its response data recorded, other commands are tracked from the status word
+    bool is_select = (capdu_size >= 4 && capdu[1] == apdu::ins_select);
+    ResponseAPDU rapdu = is_select ? ResponseAPDU(response, response_size)
+                                   : ResponseAPDU(response + response_size - 2, 2);
+    m_impl->selection.observe(capdu, capdu_size, rapdu, (uint32_t)round_trips);
+
+    return 0;
+}
+
+int32_t CardConnection::begin_transmit(const uint8_t *capdu, size_t capdu_size,
+                                       const std::function<void()> &on_complete) {
+    if (m_impl->async == nullptr) {
+        auto async = (AsyncTransmitState *)TSG_ALLOC(sizeof(AsyncTransmitState));
+        if (async == nullptr) {
+            return -1;
+        }
+        tsg::Memory::construct_at(async);
+        m_impl->async = async;
+
+        // The connection is only used by this thread while an exchange is pending. It works on its own
+        // handle over the implementation, the calling handle being possibly a temporary.
+        CardConnectionImpl *impl = m_impl;
+        async->thread = std::thread([impl, async]() {
+            CardConnection connection;
+            connection.m_impl = impl;
+
+            std::unique_lock<std::mutex> lock(async->mutex);
+            while (true) {
+                async->condition.wait(lock, [async]() { return async->stop || (async->pending && !async->completed); });
+                if (async->stop) {
+                    return;
+                }
+
+                lock.unlock();
+                ResponseAPDU rapdu = connection.transmit(async->capdu.data(), async->capdu.size());
+                lock.lock();
+
+                async->rapdu = rapdu;
+                async->completed = true;
+                std::function<void()> on_complete = async->on_complete;
+                lock.unlock();
+                async->condition.notify_all();
+                if (on_complete) {
+                    on_complete();
+                }
+                lock.lock();
+            }
+        });
+    }
+
+    AsyncTransmitState *async = m_impl->async;
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        if (async->pending) {
+            return -1; // one exchange at a time
+        }
+        async->capdu.assign(capdu, capdu + capdu_size);
+        async->on_complete = on_complete;
+        async->completed = false;
+        async->pending = true;
+    }
+    async->condition.notify_all();
+
+    return 0;
+}
+
+bool CardConnection::is_transmit_pending() const {
+    if (m_impl == nullptr || m_impl->async == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_impl->async->mutex);
+    return m_impl->async->pending && !m_impl->async->completed;
+}
+
+ResponseAPDU CardConnection::end_transmit() {
+    if (m_impl->async == nullptr) {
+        return ResponseAPDU();
+    }
+
+    AsyncTransmitState *async = m_impl->async;
+    std::unique_lock<std::mutex> lock(async->mutex);
+    if (!async->pending) {
+        return ResponseAPDU();
+    }
+    async->condition.wait(lock, [async]() { return async->completed; });
+    async->pending = false;
+    async->on_complete = nullptr;
+
+    return async->rapdu;
+}
+
 ATR CardConnection::get_atr() { return m_impl->atr_bytes; }
 
 CardConnection::CommunicationProtocol CardConnection::get_communication_protocol() { return m_impl->protocol; }
@@ -265,7 +1021,258 @@ std::string CardConnection::get_terminal_name() { return (m_impl == nullptr ? ""
 
 bool CardConnection::is_connected() const { return (m_impl == nullptr ? false : m_impl->is_connected); }
 
+void CardConnection::set_share_mode(ShareMode share_mode) {
+    if (m_impl != nullptr) {
+        m_impl->share_mode = share_mode;
+    }
+}
+
+CardConnection::ShareMode CardConnection::get_share_mode() const {
+    return m_impl == nullptr ? share_mode_shared : m_impl->share_mode;
+}
+
+int32_t CardConnection::begin_transaction(uint32_t timeout_ms) {
+    if (m_impl == nullptr || !m_impl->is_connected) {
+        return -1;
+    }
+    if (m_impl->transaction_depth > 0) {
+        m_impl->transaction_depth++;
+        return 0;
+    }
+
+    // A virtual terminal has no other client, an exclusive connection already keeps them out
+    if (m_impl->terminal.virtual_terminal == nullptr && m_impl->share_mode != share_mode_exclusive) {
+        // SCardBeginTransaction has no timeout, it is only called once no other application holds the
+        // reader exclusively. A transaction of another shared client can still make it wait.
+        if (timeout_ms != k_wait_forever) {
+            bool waited = false;
+            int32_t result = impl_wait_reader_state(m_impl, SCARD_STATE_EXCLUSIVE, false, timeout_ms, waited);
+            if (result != 0) {
+                return result;
+            }
+        }
+
+        LONG rv = SCardBeginTransaction(m_impl->card_handle);
+        if (rv != SCARD_S_SUCCESS) {
+            std::cerr << "ERROR - winscard: " << rv << std::endl;
+            return -1;
+        }
+    }
+
+    m_impl->transaction_depth = 1;
+    m_impl->transaction_reset = reset_type_none;
+    return 0;
+}
+
+int32_t CardConnection::end_transaction(ResetType reset_type) {
+    if (m_impl == nullptr || m_impl->transaction_depth == 0) {
+        return -1;
+    }
+    if (reset_type > m_impl->transaction_reset) {
+        m_impl->transaction_reset = reset_type;
+    }
+    if (--m_impl->transaction_depth > 0) {
+        return 0;
+    }
+
+    ResetType reset = m_impl->transaction_reset;
+    m_impl->transaction_reset = reset_type_none;
+
+    if (m_impl->terminal.virtual_terminal != nullptr || m_impl->share_mode == share_mode_exclusive) {
+        return reset == reset_type_none ? 0 : reconnect(reset);
+    }
+
+    DWORD disposition = SCARD_LEAVE_CARD;
+    if (reset == reset_type_warm) {
+        disposition = SCARD_RESET_CARD;
+    } else if (reset == reset_type_cold) {
+        disposition = SCARD_UNPOWER_CARD;
+    }
+    LONG rv = SCardEndTransaction(m_impl->card_handle, disposition);
+    if (rv != SCARD_S_SUCCESS) {
+        std::cerr << "ERROR - winscard: " << rv << std::endl;
+        return -1;
+    }
+
+    if (reset != reset_type_none) {
+        impl_invalidate_card_state(m_impl);
+        impl_update_card_status(m_impl);
+        impl_record_connect(m_impl);
+    }
+    return 0;
+}
+
+uint32_t CardConnection::get_transaction_depth() const {
+    return m_impl == nullptr ? 0 : m_impl->transaction_depth;
+}
+
+ReaderCapabilities CardConnection::get_reader_capabilities() const {
+    if (m_impl == nullptr || m_impl->terminal.capabilities == nullptr) {
+        return ReaderCapabilities();
+    }
+    std::lock_guard<std::mutex> lock(m_impl->terminal.capabilities->mutex);
+    return m_impl->terminal.capabilities->capabilities;
+}
+
+size_t CardConnection::get_max_reader_ne() const { return m_impl == nullptr ? k_max_short_ne : m_impl->max_reader_ne; }
+
+int32_t CardConnection::control(uint32_t control_code, const uint8_t *in, size_t in_size, uint8_t *out,
+                                size_t &out_size) {
+    if (m_impl == nullptr || !m_impl->is_connected || m_impl->terminal.virtual_terminal != nullptr) {
+        out_size = 0;
+        return -1;
+    }
+
+    DWORD received = 0;
+    LONG rv = SCardControl(m_impl->card_handle, control_code, in, (DWORD)in_size, out, (DWORD)out_size, &received);
+    if (rv != SCARD_S_SUCCESS) {
+        std::cerr << "ERROR - winscard: " << rv << std::endl;
+        out_size = 0;
+        return -1;
+    }
+    out_size = received;
+    return 0;
+}
+
+int32_t CardConnection::check_card() {
+    if (m_impl == nullptr || !m_impl->is_connected) {
+        return -1;
+    }
+
+    if (m_impl->terminal.virtual_terminal != nullptr) {
+        return m_impl->terminal.virtual_terminal->is_card_present() ? 0 : -1;
+    }
+
+    uint8_t atr[k_max_atr_size];
+    DWORD atr_size = sizeof(atr);
+    DWORD reader_length = 0;
+    DWORD state = 0;
+    DWORD active_protocol = 0;
+    LONG rv = SCardStatus(m_impl->card_handle, NULL, &reader_length, &state, &active_protocol, atr, &atr_size);
+    if (rv == SCARD_S_SUCCESS) {
+        return 0;
+    }
+    if (rv == SCARD_W_RESET_CARD) {
+        return 1;
+    }
+    if (m_impl->contexts != nullptr && ContextManager::is_service_lost(rv)) {
+        m_impl->contexts->invalidate();
+    }
+    return -1;
+}
+
+int32_t CardConnection::wait_card_presence(bool present, uint32_t timeout_ms) {
+    if (m_impl == nullptr) {
+        return -1;
+    }
+
+    bool waited = false;
+    if (m_impl->terminal.virtual_terminal != nullptr) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (m_impl->terminal.virtual_terminal->is_card_present() != present) {
+            if (timeout_ms != k_wait_forever && std::chrono::steady_clock::now() >= deadline) {
+                return 1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            waited = true;
+        }
+    } else {
+        int32_t result = impl_wait_reader_state(m_impl, SCARD_STATE_PRESENT, present, timeout_ms, waited);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    if (present && waited) {
+        m_impl->card_detected = std::chrono::steady_clock::now();
+    }
+    return 0;
+}
+
+void CardConnection::set_recovery_policy(const RecoveryPolicy &policy) { m_impl->recovery_policy = policy; }
+
+RecoveryPolicy CardConnection::get_recovery_policy() const {
+    return m_impl == nullptr ? RecoveryPolicy() : m_impl->recovery_policy;
+}
+
+RecoveryStatistics CardConnection::get_recovery_statistics() const {
+    return m_impl == nullptr ? RecoveryStatistics() : m_impl->recovery_statistics;
+}
+
 bool CardConnection::is_valid() const { return m_impl == nullptr ? false : true; }
 
+void CardConnection::set_read_cache_enabled(bool enabled) { m_impl->read_cache.set_enabled(enabled); }
+
+bool CardConnection::is_read_cache_enabled() const {
+    return (m_impl == nullptr ? false : m_impl->read_cache.is_enabled());
+}
+
+void CardConnection::invalidate_read_cache() { m_impl->read_cache.invalidate(); }
+
+ReadCacheStatistics CardConnection::get_read_cache_statistics() const {
+    return (m_impl == nullptr ? ReadCacheStatistics() : m_impl->read_cache.get_statistics());
+}
+
+APDUMetricsSnapshot CardConnection::get_apdu_metrics() const {
+    return (m_impl == nullptr ? APDUMetricsSnapshot() : m_impl->metrics.get_snapshot());
+}
+
+int32_t CardConnection::get_apdu_latency(uint8_t ins, LatencySnapshot &snapshot) const {
+    return (m_impl == nullptr ? -1 : m_impl->metrics.get_instruction_snapshot(ins, snapshot));
+}
+
+int32_t CardConnection::start_recording(const char *path) {
+    if (m_impl == nullptr) {
+        return -1;
+    }
+    stop_recording();
+
+    auto recorder = (TraceWriter *)TSG_ALLOC(sizeof(TraceWriter));
+    if (recorder == nullptr) {
+        return -1;
+    }
+    tsg::Memory::construct_at(recorder);
+    if (recorder->open(path, m_impl->terminal.name.c_str()) != 0) {
+        tsg::Memory::destroy_at(recorder);
+        TSG_FREE(recorder, sizeof(TraceWriter));
+        return -1;
+    }
+    m_impl->recorder = recorder;
+
+    if (m_impl->is_connected) {
+        impl_record_connect(m_impl);
+    }
+    return 0;
+}
+
+int32_t CardConnection::stop_recording() {
+    if (m_impl == nullptr || m_impl->recorder == nullptr) {
+        return 0;
+    }
+    int32_t result = m_impl->recorder->close();
+    tsg::Memory::destroy_at(m_impl->recorder);
+    TSG_FREE(m_impl->recorder, sizeof(TraceWriter));
+    m_impl->recorder = nullptr;
+    return result;
+}
+
+bool CardConnection::is_recording() const { return (m_impl == nullptr ? false : m_impl->recorder != nullptr); }
+
+void CardConnection::set_select_elision_enabled(bool enabled) { m_impl->select_elision_enabled = enabled; }
+
+bool CardConnection::is_select_elision_enabled() const {
+    return (m_impl == nullptr ? false : m_impl->select_elision_enabled);
+}
+
+SelectionTracker CardConnection::get_selection() const {
+    return (m_impl == nullptr ? SelectionTracker() : m_impl->selection);
+}
+
+SelectionStatistics CardConnection::get_selection_statistics() const {
+    return (m_impl == nullptr ? SelectionStatistics() : m_impl->selection.get_statistics());
+}
+
+void CardConnection::set_apdu_trace_enabled(bool enabled) { m_impl->apdu_trace_enabled = enabled; }
+
 } // namespace smartcard
 } // namespace tsg
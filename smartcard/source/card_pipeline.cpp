@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/card_pipeline.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+struct PreparedCard {
+    uint64_t sequence;
+    std::vector<uint8_t> data;
+};
+
+struct CardPipelineImpl {
+    SmartCardProvider *provider{nullptr};
+    PipelineHandlers handlers;
+    PipelineOptions options;
+    size_t prepare_ahead{0};
+
+    std::vector<CardConnection> connections;
+    std::vector<std::thread> readers;
+    std::vector<std::thread> preparers;
+
+    mutable std::mutex mutex;
+    std::condition_variable prepared_available;
+    std::condition_variable prepare_space;
+    std::condition_variable done;
+    bool stopping{false};
+    bool running{false};
+
+    // Sorted by sequence, the preparation threads finishing out of order
+    std::deque<PreparedCard> prepared;
+    uint64_t next_sequence{0};
+    size_t preparing{0};
+
+    // Sequences handed to a card or whose preparation failed
+    uint64_t taken{0};
+    uint64_t finished{0};
+
+    uint64_t cards_completed{0};
+    uint64_t cards_failed{0};
+    uint64_t cards_rejected{0};
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+
+    // Written under 'mutex', the reader threads sharing them
+    LatencyHistogram stages[pipeline_stage_count];
+};
+
+namespace {
+
+bool impl_all_taken(const CardPipelineImpl *impl) {
+    return impl->options.card_count != 0 && impl->taken >= impl->options.card_count;
+}
+
+void impl_record_stage(CardPipelineImpl *impl, PipelineStage stage, std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->stages[stage].record((uint64_t)elapsed.count());
+}
+
+bool impl_is_stopping(CardPipelineImpl *impl) {
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    return impl->stopping || impl_all_taken(impl);
+}
+
+void impl_finish_card(CardPipelineImpl *impl, bool succeeded) {
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    if (succeeded) {
+        impl->cards_completed++;
+    } else {
+        impl->cards_failed++;
+    }
+    impl->finished++;
+    if (impl->options.card_count != 0 && impl->finished >= impl->options.card_count) {
+        impl->end = std::chrono::steady_clock::now();
+        impl->done.notify_all();
+    }
+}
+
+void impl_run_preparer(CardPipelineImpl *impl) {
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    while (!impl->stopping) {
+        if (impl->options.card_count != 0 && impl->next_sequence >= impl->options.card_count) {
+            break;
+        }
+        if (impl->prepared.size() + impl->preparing >= impl->prepare_ahead) {
+            impl->prepare_space.wait(lock);
+            continue;
+        }
+
+        PreparedCard card{impl->next_sequence++, {}};
+        impl->preparing++;
+        lock.unlock();
+        int32_t result = impl->handlers.prepare(card.sequence, card.data);
+        lock.lock();
+        impl->preparing--;
+
+        if (result != 0) {
+            std::cerr << "ERROR - pipeline: preparation of card " << card.sequence << " failed" << std::endl;
+            impl->taken++;
+            impl->cards_failed++;
+            impl->finished++;
+            if (impl->options.card_count != 0 && impl->finished >= impl->options.card_count) {
+                impl->end = std::chrono::steady_clock::now();
+                impl->done.notify_all();
+            }
+            impl->prepare_space.notify_one();
+            continue;
+        }
+
+        auto position = std::upper_bound(impl->prepared.begin(), impl->prepared.end(), card.sequence,
+                                         [](uint64_t sequence, const PreparedCard &c) { return sequence < c.sequence; });
+        impl->prepared.insert(position, std::move(card));
+        impl->prepared_available.notify_one();
+    }
+    impl->prepared_available.notify_all();
+}
+
+// Waits for the card to be gone before looking for the next one
+void impl_wait_removal(CardPipelineImpl *impl, CardConnection &connection) {
+    auto start = std::chrono::steady_clock::now();
+    int32_t presence;
+    while ((presence = connection.wait_card_presence(false, impl->options.poll_interval_ms)) != 0) {
+        {
+            std::lock_guard<std::mutex> lock(impl->mutex);
+            if (impl->stopping) {
+                return;
+            }
+        }
+        if (presence < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(impl->options.poll_interval_ms));
+        }
+    }
+    impl_record_stage(impl, pipeline_stage_removal, start);
+}
+
+void impl_reject_card(CardPipelineImpl *impl, CardConnection &connection, PipelineCard &card) {
+    if (connection.is_connected()) {
+        connection.disconnect();
+    }
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->cards_rejected++;
+    }
+    if (impl->handlers.eject) {
+        impl->handlers.eject(card, false);
+    }
+    impl_wait_removal(impl, connection);
+}
+
+void impl_run_reader(CardPipelineImpl *impl, size_t reader) {
+    CardConnection &connection = impl->connections[reader];
+    const PipelineHandlers &handlers = impl->handlers;
+
+    auto detect_start = std::chrono::steady_clock::now();
+    while (!impl_is_stopping(impl)) {
+        int32_t presence = connection.wait_card_presence(true, impl->options.poll_interval_ms);
+        if (presence != 0) {
+            if (presence < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(impl->options.poll_interval_ms));
+            }
+            continue;
+        }
+        impl_record_stage(impl, pipeline_stage_detect, detect_start);
+
+        PipelineCard card;
+        card.reader = reader;
+
+        auto start = std::chrono::steady_clock::now();
+        if (connection.connect() != 0) {
+            impl_reject_card(impl, connection, card);
+            detect_start = std::chrono::steady_clock::now();
+            continue;
+        }
+        impl_record_stage(impl, pipeline_stage_connect, start);
+
+        start = std::chrono::steady_clock::now();
+        card.atr = connection.get_atr();
+        if (handlers.identify && handlers.identify(card.atr, reader) != 0) {
+            impl_reject_card(impl, connection, card);
+            detect_start = std::chrono::steady_clock::now();
+            continue;
+        }
+        impl_record_stage(impl, pipeline_stage_identify, start);
+
+        start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(impl->mutex);
+            impl->prepared_available.wait(lock, [impl]() {
+                return impl->stopping || !impl->prepared.empty() || impl_all_taken(impl);
+            });
+            if (impl->prepared.empty()) {
+                lock.unlock();
+                connection.disconnect();
+                break;
+            }
+            card.sequence = impl->prepared.front().sequence;
+            card.data = std::move(impl->prepared.front().data);
+            impl->prepared.pop_front();
+            impl->taken++;
+            impl->prepare_space.notify_one();
+        }
+        impl_record_stage(impl, pipeline_stage_prepare_wait, start);
+
+        start = std::chrono::steady_clock::now();
+        int32_t result = handlers.run(connection, card);
+        impl_record_stage(impl, pipeline_stage_run, start);
+
+        if (result == 0 && handlers.verify) {
+            start = std::chrono::steady_clock::now();
+            result = handlers.verify(connection, card);
+            impl_record_stage(impl, pipeline_stage_verify, start);
+        }
+
+        start = std::chrono::steady_clock::now();
+        connection.disconnect();
+        if (handlers.eject) {
+            handlers.eject(card, result == 0);
+        }
+        impl_record_stage(impl, pipeline_stage_eject, start);
+        impl_finish_card(impl, result == 0);
+
+        impl_wait_removal(impl, connection);
+        detect_start = std::chrono::steady_clock::now();
+    }
+}
+
+void impl_join(CardPipelineImpl *impl) {
+    for (auto &thread : impl->readers) {
+        thread.join();
+    }
+    for (auto &thread : impl->preparers) {
+        thread.join();
+    }
+    impl->readers.clear();
+    impl->preparers.clear();
+
+    for (auto &connection : impl->connections) {
+        impl->provider->destroy_card_connection(connection);
+    }
+    impl->connections.clear();
+    impl->running = false;
+}
+
+} // namespace
+
+CardPipeline::CardPipeline() {
+    m_impl = (CardPipelineImpl *)TSG_ALLOC(sizeof(CardPipelineImpl));
+    tsg::Memory::construct_at(m_impl);
+}
+
+CardPipeline::~CardPipeline() {
+    if (m_impl->running) {
+        stop();
+        impl_join(m_impl);
+    }
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(CardPipelineImpl));
+}
+
+int32_t CardPipeline::start(SmartCardProvider &provider, const std::vector<std::string> &terminal_names,
+                            const PipelineHandlers &handlers, const PipelineOptions &options) {
+    if (m_impl->running || terminal_names.empty() || !handlers.prepare || !handlers.run) {
+        return -1;
+    }
+
+    for (auto &name : terminal_names) {
+        CardConnection connection = provider.create_card_connection(name);
+        if (!connection.is_valid()) {
+            std::cerr << "ERROR - pipeline: unknown terminal " << name << std::endl;
+            for (auto &created : m_impl->connections) {
+                provider.destroy_card_connection(created);
+            }
+            m_impl->connections.clear();
+            return -1;
+        }
+        connection.set_apdu_trace_enabled(false);
+        m_impl->connections.push_back(connection);
+    }
+
+    m_impl->provider = &provider;
+    m_impl->handlers = handlers;
+    m_impl->options = options;
+    m_impl->prepare_ahead = options.prepare_ahead != 0 ? options.prepare_ahead : 2 * terminal_names.size();
+    m_impl->stopping = false;
+    m_impl->prepared.clear();
+    m_impl->next_sequence = 0;
+    m_impl->preparing = 0;
+    m_impl->taken = 0;
+    m_impl->finished = 0;
+    m_impl->cards_completed = 0;
+    m_impl->cards_failed = 0;
+    m_impl->cards_rejected = 0;
+    for (auto &stage : m_impl->stages) {
+        tsg::Memory::destroy_at(&stage);
+        tsg::Memory::construct_at(&stage);
+    }
+    m_impl->start = std::chrono::steady_clock::now();
+    m_impl->running = true;
+
+    size_t prepare_threads = options.prepare_threads != 0 ? options.prepare_threads : 1;
+    for (size_t index = 0; index < prepare_threads; index++) {
+        m_impl->preparers.emplace_back(impl_run_preparer, m_impl);
+    }
+    for (size_t index = 0; index < m_impl->connections.size(); index++) {
+        m_impl->readers.emplace_back(impl_run_reader, m_impl, index);
+    }
+    return 0;
+}
+
+int32_t CardPipeline::wait() {
+    if (!m_impl->running) {
+        return -1;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_impl->mutex);
+        m_impl->done.wait(lock, [this]() {
+            return m_impl->stopping ||
+                   (m_impl->options.card_count != 0 && m_impl->finished >= m_impl->options.card_count);
+        });
+        m_impl->stopping = true;
+    }
+    m_impl->prepared_available.notify_all();
+    m_impl->prepare_space.notify_all();
+
+    impl_join(m_impl);
+    return 0;
+}
+
+void CardPipeline::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        if (!m_impl->stopping) {
+            m_impl->end = std::chrono::steady_clock::now();
+        }
+        m_impl->stopping = true;
+    }
+    m_impl->done.notify_all();
+    m_impl->prepared_available.notify_all();
+    m_impl->prepare_space.notify_all();
+}
+
+PipelineStatistics CardPipeline::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+
+    PipelineStatistics statistics;
+    statistics.cards_completed = m_impl->cards_completed;
+    statistics.cards_failed = m_impl->cards_failed;
+    statistics.cards_rejected = m_impl->cards_rejected;
+
+    bool ended = m_impl->stopping ||
+                 (m_impl->options.card_count != 0 && m_impl->finished >= m_impl->options.card_count);
+    auto end = ended ? m_impl->end : std::chrono::steady_clock::now();
+    if (m_impl->start != std::chrono::steady_clock::time_point()) {
+        statistics.elapsed_ns =
+            (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_impl->start).count();
+    }
+    for (size_t stage = 0; stage < pipeline_stage_count; stage++) {
+        statistics.stages[stage] = m_impl->stages[stage].snapshot();
+    }
+    return statistics;
+}
+
+} // namespace smartcard
+} // namespace tsg
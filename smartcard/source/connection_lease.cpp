@@ -0,0 +1,161 @@
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/connection_lease.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+struct LeaseSlot {
+    std::string terminal_name;
+    CardConnection connection;
+    bool leased{false};
+    bool reset_pending{false};
+};
+
+struct ConnectionLeaseManagerImpl {
+    SmartCardProvider *provider{nullptr};
+
+    mutable std::mutex mutex;
+
+    // A deque so that a slot being prepared outside the lock stays in place while others are added
+    std::deque<LeaseSlot> slots;
+    ConnectionLeaseStatistics statistics;
+};
+
+namespace {
+
+LeaseSlot *impl_find_slot(ConnectionLeaseManagerImpl *impl, const std::string &terminal_name) {
+    for (auto &slot : impl->slots) {
+        if (slot.terminal_name == terminal_name) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+// Brings the connection of a leased slot to a connected state on the card now in the terminal, called
+// outside the lock since this talks to the reader
+int32_t impl_prepare_connection(ConnectionLeaseManagerImpl *impl, LeaseSlot &slot, bool reset_pending) {
+    CardConnection &connection = slot.connection;
+    if (connection.is_connected()) {
+        int32_t status = connection.check_card();
+        if (status == 0 && !reset_pending) {
+            std::lock_guard<std::mutex> lock(impl->mutex);
+            impl->statistics.connects_avoided++;
+            return 0;
+        }
+        // Reset by another application, the connection only needs to acknowledge it
+        CardConnection::ResetType reset_type =
+            (status == 0) ? CardConnection::reset_type_warm : CardConnection::reset_type_none;
+        if (status >= 0) {
+            if (connection.reconnect(reset_type) == 0) {
+                std::lock_guard<std::mutex> lock(impl->mutex);
+                impl->statistics.reconnects++;
+                return 0;
+            }
+        }
+        // The card was removed, the next one needs a connection of its own. A handle the reader refuses to
+        // disconnect would stay connected, the slot starts over from a new connection then.
+        if (connection.disconnect() != 0) {
+            impl->provider->destroy_card_connection(connection);
+        }
+    }
+
+    if (!connection.is_valid()) {
+        connection = impl->provider->create_card_connection(slot.terminal_name);
+    }
+    if (!connection.is_valid() || connection.connect() != 0) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->statistics.connects++;
+    return 0;
+}
+
+} // namespace
+
+ConnectionLeaseManager::ConnectionLeaseManager(SmartCardProvider &provider) {
+    m_impl = (ConnectionLeaseManagerImpl *)TSG_ALLOC(sizeof(ConnectionLeaseManagerImpl));
+    tsg::Memory::construct_at(m_impl);
+    m_impl->provider = &provider;
+}
+
+ConnectionLeaseManager::~ConnectionLeaseManager() {
+    for (auto &slot : m_impl->slots) {
+        m_impl->provider->destroy_card_connection(slot.connection);
+    }
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(ConnectionLeaseManagerImpl));
+}
+
+int32_t ConnectionLeaseManager::acquire(const std::string &terminal_name, CardConnection &connection) {
+    LeaseSlot *slot = nullptr;
+    bool reset_pending = false;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        slot = impl_find_slot(m_impl, terminal_name);
+        if (slot == nullptr) {
+            CardConnection created = m_impl->provider->create_card_connection(terminal_name);
+            if (!created.is_valid()) {
+                std::cerr << "ERROR - lease: unknown terminal " << terminal_name << std::endl;
+                m_impl->statistics.failures++;
+                return -1;
+            }
+            m_impl->slots.emplace_back();
+            slot = &m_impl->slots.back();
+            slot->terminal_name = terminal_name;
+            slot->connection = created;
+        } else if (slot->leased) {
+            std::cerr << "ERROR - lease: " << terminal_name << " is already leased" << std::endl;
+            m_impl->statistics.failures++;
+            return -1;
+        }
+        slot->leased = true;
+        reset_pending = slot->reset_pending;
+        slot->reset_pending = false;
+        m_impl->statistics.leases++;
+    }
+
+    int32_t result = impl_prepare_connection(m_impl, *slot, reset_pending);
+
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    if (result != 0) {
+        slot->leased = false;
+        m_impl->statistics.failures++;
+        return -1;
+    }
+    connection = slot->connection;
+    return 0;
+}
+
+void ConnectionLeaseManager::release(CardConnection &connection, bool reset_card) {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    for (auto &slot : m_impl->slots) {
+        if (slot.leased && slot.terminal_name == connection.get_terminal_name()) {
+            slot.leased = false;
+            slot.reset_pending = reset_card;
+            break;
+        }
+    }
+    connection = CardConnection();
+}
+
+void ConnectionLeaseManager::close_idle() {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    for (auto &slot : m_impl->slots) {
+        if (!slot.leased && slot.connection.is_connected()) {
+            slot.connection.disconnect();
+        }
+    }
+}
+
+ConnectionLeaseStatistics ConnectionLeaseManager::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->statistics;
+}
+
+} // namespace smartcard
+} // namespace tsg
@@ -0,0 +1,103 @@
+#include "context_manager.hpp"
+#include <iostream>
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+std::atomic<uint64_t> g_next_manager_id{1};
+
+// Last context acquired by the thread, so that acquiring it again takes no lock
+struct CachedContext {
+    uint64_t manager_id{0};
+    uint64_t generation{0};
+    SCARDCONTEXT context{0};
+};
+
+thread_local CachedContext t_cached;
+
+} // namespace
+
+ContextManager::ContextManager() : m_id(g_next_manager_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+int32_t ContextManager::acquire(SCARDCONTEXT &context) {
+    uint64_t generation = m_generation.load(std::memory_order_acquire);
+    if (t_cached.manager_id == m_id && t_cached.generation == generation) {
+        context = t_cached.context;
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::thread::id thread = std::this_thread::get_id();
+
+    Entry *entry = nullptr;
+    for (auto &e : m_entries) {
+        if (e.thread == thread) {
+            entry = &e;
+            break;
+        }
+    }
+
+    if (entry == nullptr || entry->generation != generation) {
+        if (entry != nullptr) {
+            SCardReleaseContext(entry->context); // already gone with the previous service instance
+        }
+
+        SCARDCONTEXT new_context = 0;
+        LONG rv = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &new_context);
+        if (rv != SCARD_S_SUCCESS) {
+            if (rv == SCARD_E_NO_SERVICE) {
+                std::cerr << "ERROR - winscard: The smart card resource manager is not running." << std::endl;
+            } else {
+                std::cerr << "ERROR - winscard: " << rv << std::endl;
+            }
+            if (entry != nullptr) {
+                *entry = m_entries.back();
+                m_entries.pop_back();
+            }
+            return -1;
+        }
+
+        if (entry == nullptr) {
+            m_entries.push_back(Entry{thread, new_context, generation});
+            entry = &m_entries.back();
+        } else {
+            entry->context = new_context;
+            entry->generation = generation;
+        }
+    }
+
+    t_cached.manager_id = m_id;
+    t_cached.generation = generation;
+    t_cached.context = entry->context;
+    context = entry->context;
+    return 0;
+}
+
+void ContextManager::invalidate() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation.fetch_add(1, std::memory_order_acq_rel);
+    for (auto &entry : m_entries) {
+        SCardCancel(entry.context);
+    }
+}
+
+void ContextManager::cleanup() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation.fetch_add(1, std::memory_order_acq_rel);
+    for (auto &entry : m_entries) {
+        LONG rv = SCardReleaseContext(entry.context);
+        if (rv != SCARD_S_SUCCESS && !is_service_lost(rv)) {
+            std::cerr << "ERROR - winscard: " << rv << std::endl;
+        }
+    }
+    m_entries.clear();
+}
+
+bool ContextManager::is_service_lost(LONG rv) {
+    return rv == SCARD_E_NO_SERVICE || rv == SCARD_E_SERVICE_STOPPED;
+}
+
+} // namespace smartcard
+} // namespace tsg
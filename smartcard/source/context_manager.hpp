@@ -0,0 +1,58 @@
+#ifndef TSG_SMARTCARD_CONTEXT_MANAGER_HPP
+#define TSG_SMARTCARD_CONTEXT_MANAGER_HPP
+
+#include <WinSCard.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tsg {
+namespace smartcard {
+
+// One PC/SC context per thread, established on the thread's first acquire(). The resource manager
+// serializes the calls made on a context (and some stacks do not allow sharing one across threads),
+// threads working on their own readers therefore never wait on each other.
+//
+// When the service restarts every context becomes invalid: invalidate() cancels the calls blocked
+// on them and each thread establishes a new context on its next acquire(). Contexts of threads that
+// exited are only released by cleanup().
+class ContextManager {
+  public:
+    ContextManager();
+
+    ~ContextManager() { cleanup(); }
+
+    ContextManager(const ContextManager &) = delete;
+
+    ContextManager &operator=(const ContextManager &) = delete;
+
+    // Context of the calling thread, -1 when it cannot be established (e.g. no service)
+    int32_t acquire(SCARDCONTEXT &context);
+
+    void invalidate();
+
+    void cleanup();
+
+    // True for the errors telling that the resource manager went away along with its contexts. An
+    // invalid handle only concerns the card handle of one connection, which reconnects on its own.
+    static bool is_service_lost(LONG rv);
+
+  private:
+    struct Entry {
+        std::thread::id thread;
+        SCARDCONTEXT context;
+        uint64_t generation;
+    };
+
+    uint64_t m_id;
+    std::atomic<uint64_t> m_generation{1};
+    std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_CONTEXT_MANAGER_HPP
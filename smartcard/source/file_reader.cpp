@@ -0,0 +1,197 @@
+#include <cstring>
+#include <iostream>
+#include <tsg/smartcard/file_reader.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+// READ BINARY (B0) encodes the offset on 15 bits
+constexpr size_t k_max_read_binary_offset = 0x7FFF;
+
+// 6Cxx answers in a row to the same chunk before giving up on the card
+constexpr uint32_t k_max_wrong_le_retries = 3;
+
+} // namespace
+
+FileReader::FileReader(CardConnection &connection, const FileReadOptions &options)
+    : m_connection(connection), m_options(options) {}
+
+int32_t FileReader::read(uint8_t *buffer, size_t capacity, size_t &size) {
+    return read_chunks(buffer, capacity, nullptr, size);
+}
+
+int32_t FileReader::read(const FileReadSink &sink, size_t &size) { return read_chunks(nullptr, 0, &sink, size); }
+
+int32_t FileReader::read_chunks(uint8_t *buffer, size_t capacity, const FileReadSink *sink, size_t &size) {
+    size = 0;
+
+    size_t chunk_size = (m_chunk_size != 0 ? m_chunk_size : initial_chunk_size());
+    bool use_sfi = (m_options.sfi != 0);
+
+    // Length a 6Cxx answer asked for, used for the retried chunk only: it usually is the tail of the file
+    size_t exact_ne = 0;
+    uint32_t wrong_le_retries = 0;
+    while (true) {
+        if ((m_options.expected_size != 0 && size >= m_options.expected_size) ||
+            (buffer != nullptr && size >= capacity)) {
+            break;
+        }
+
+        if (size > (use_sfi ? 0xFF : k_max_read_binary_offset)) {
+            std::cerr << "ERROR - file reader: offset " << size << " out of READ BINARY range" << std::endl;
+            return -1;
+        }
+
+        size_t ne = (exact_ne != 0 ? exact_ne : chunk_size);
+        if (m_options.expected_size != 0 && m_options.expected_size - size < ne) {
+            ne = m_options.expected_size - size;
+        }
+        if (buffer != nullptr && capacity - size < ne) {
+            ne = capacity - size;
+        }
+
+        // Receive in place when the caller buffer also has room for SW1 SW2
+        uint8_t *response = nullptr;
+        size_t response_size = 0;
+        if (buffer != nullptr && capacity - size >= ne + 2) {
+            response = buffer + size;
+            response_size = capacity - size;
+        } else {
+            if (m_scratch.size() < ne + 2) {
+                m_scratch.resize(ne + 2);
+            }
+            response = m_scratch.data();
+            response_size = m_scratch.size();
+        }
+
+        if (read_chunk(use_sfi, size, ne, response, response_size) != 0) {
+            return -1;
+        }
+
+        uint8_t sw1 = response[response_size - 2];
+        uint8_t sw2 = response[response_size - 1];
+        size_t count = response_size - 2;
+
+        if (sw1 == 0x67 && sw2 == 0x00) {
+            if (!step_down(chunk_size)) {
+                std::cerr << "ERROR - file reader: wrong length at chunk size " << chunk_size << std::endl;
+                return -1;
+            }
+            continue;
+        }
+
+        if (sw1 == 0x6C) { // short forms are retried by the connection, only extended ones land here
+            size_t exact_size = (sw2 == 0x00 ? k_max_short_ne : sw2);
+            if (exact_size == ne || ++wrong_le_retries > k_max_wrong_le_retries) {
+                std::cerr << "ERROR - file reader: card keeps answering 6C" << std::hex << (int)sw2 << std::dec
+                          << " at chunk size " << ne << std::endl;
+                return -1;
+            }
+            exact_ne = exact_size;
+            m_statistics.chunk_fallbacks++;
+            continue;
+        }
+
+        if (sw1 == 0x6B && sw2 == 0x00) {
+            break; // offset beyond the end of the file
+        }
+
+        bool end_of_file = (sw1 == 0x62 && sw2 == 0x82);
+        if (!end_of_file && !(sw1 == 0x90 && sw2 == 0x00)) {
+            std::cerr << "ERROR - file reader: READ BINARY failed with " << std::hex << (int)sw1 << (int)sw2
+                      << std::dec << std::endl;
+            return -1;
+        }
+
+        if (count > ne) {
+            count = ne;
+        }
+
+        if (buffer != nullptr && response != buffer + size) {
+            memcpy(buffer + size, response, count);
+        }
+        if (sink != nullptr && count > 0 && (*sink)(response, count) != 0) {
+            return -1;
+        }
+
+        size += count;
+        use_sfi = false;
+        exact_ne = 0;
+        wrong_le_retries = 0;
+        m_statistics.bytes += count;
+
+        if (m_progress) {
+            m_progress(size, m_options.expected_size);
+        }
+
+        if (end_of_file || count < ne) {
+            break;
+        }
+    }
+
+    m_chunk_size = chunk_size;
+    m_statistics.chunk_size = chunk_size;
+
+    return 0;
+}
+
+int32_t FileReader::read_chunk(bool use_sfi, size_t offset, size_t ne, uint8_t *response, size_t &response_size) {
+    m_statistics.commands++;
+
+    if (use_sfi) {
+        if (ne > k_max_short_ne) {
+            auto capdu = apdu::read_binary_sfi<apdu_length_extended>(m_options.sfi, (uint8_t)offset, ne);
+            return m_connection.transmit(capdu.data(), capdu.size(), response, response_size);
+        }
+        auto capdu = apdu::read_binary_sfi(m_options.sfi, (uint8_t)offset, ne);
+        return m_connection.transmit(capdu.data(), capdu.size(), response, response_size);
+    }
+
+    if (ne > k_max_short_ne) {
+        auto capdu = apdu::read_binary<apdu_length_extended>((uint16_t)offset, ne);
+        return m_connection.transmit(capdu.data(), capdu.size(), response, response_size);
+    }
+    auto capdu = apdu::read_binary((uint16_t)offset, ne);
+    return m_connection.transmit(capdu.data(), capdu.size(), response, response_size);
+}
+
+size_t FileReader::initial_chunk_size() {
+    size_t chunk_size = k_max_short_ne;
+
+    ATR atr = m_connection.get_atr();
+    if (m_options.use_extended_length && atr.supports_extended_length() &&
+        m_connection.get_communication_protocol() == CardConnection::com_protocol_t_1) {
+        chunk_size = k_max_extended_ne;
+    }
+
+    // Readers reporting a smaller maximum would only fail the larger chunks
+    size_t max_reader_ne = m_connection.get_max_reader_ne();
+    if (chunk_size > max_reader_ne) {
+        chunk_size = max_reader_ne > k_max_short_ne ? max_reader_ne : k_max_short_ne;
+    }
+
+    if (m_options.max_chunk_size != 0 && m_options.max_chunk_size < chunk_size) {
+        chunk_size = m_options.max_chunk_size;
+    }
+
+    return chunk_size;
+}
+
+bool FileReader::step_down(size_t &chunk_size) {
+    m_statistics.chunk_fallbacks++;
+
+    if (chunk_size > k_max_short_ne) {
+        chunk_size = k_max_short_ne;
+    } else if (chunk_size == k_max_short_ne) {
+        chunk_size = k_max_short_ne - 1;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace smartcard
+} // namespace tsg
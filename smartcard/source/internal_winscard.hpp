@@ -2,20 +2,41 @@
 #define TSG_SMARTCARD_INTERNAL_WINSCARD_HPP
 
 #include <WinSCard.h>
+#include <chrono>
 #include <cstdint>
+#include <mutex>
 #include <string>
+#include <tsg/smartcard/reader_capabilities.hpp>
 
 namespace tsg {
 namespace smartcard {
 
+class ContextManager;
+class VirtualTerminal;
+
+// Owned by the provider, shared by every connection to the reader
+struct ReaderCapabilityCache {
+    std::mutex mutex;
+    ReaderCapabilities capabilities;
+};
+
 struct TerminalData {
-    uint32_t index;
+    // Stable across refresh(), see TerminalEvent
+    uint32_t id;
     std::string name;
+    VirtualTerminal *virtual_terminal{nullptr};
+    ReaderCapabilityCache *capabilities{nullptr};
 };
 
 struct CardConnectCI {
+    // The calling thread's context is taken from 'contexts' on connect, 'context' is used without one
     SCARDCONTEXT context;
+    ContextManager *contexts{nullptr};
     TerminalData terminal;
+
+    // When the card was seen present, the start of the time to first APDU; left unset the first
+    // connect is the start
+    std::chrono::steady_clock::time_point card_detected;
 };
 
 } // namespace smartcard
@@ -0,0 +1,353 @@
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/job_engine.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+struct JobReader {
+    CardConnection connection;
+    std::deque<Job> jobs;
+    std::thread thread;
+    ReaderJobStatistics statistics;
+    bool running_job{false};
+};
+
+// Jobs last milliseconds to seconds on a card while the queues are touched for nanoseconds, a single
+// lock over every deque costs nothing measurable and keeps stealing and back-pressure simple
+struct JobEngineImpl {
+    SmartCardProvider *provider{nullptr};
+    JobEngineOptions options;
+    std::deque<JobReader> readers;
+
+    mutable std::mutex mutex;
+    std::condition_variable work;
+    std::condition_variable space;
+    std::condition_variable idle;
+    bool stopping{false};
+    bool running{false};
+
+    uint64_t submitted{0};
+    uint64_t back_pressure_ns{0};
+};
+
+namespace {
+
+bool impl_is_idle(const JobEngineImpl *impl) {
+    for (auto &reader : impl->readers) {
+        if (!reader.jobs.empty() || reader.running_job) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reader a job goes to, SIZE_MAX when it names no reader of the engine
+size_t impl_target_of(const JobEngineImpl *impl, const Job &job) {
+    if (job.reader != SIZE_MAX) {
+        return job.reader < impl->readers.size() ? job.reader : SIZE_MAX;
+    }
+    if (job.affinity == job_affinity_reader) {
+        return SIZE_MAX;
+    }
+
+    size_t target = 0;
+    size_t target_load = SIZE_MAX;
+    for (size_t index = 0; index < impl->readers.size(); index++) {
+        const JobReader &reader = impl->readers[index];
+        size_t load = reader.jobs.size() + (reader.running_job ? 1 : 0);
+        if (load < target_load) {
+            target = index;
+            target_load = load;
+        }
+    }
+    return target;
+}
+
+// Takes the newest card-agnostic job of the most loaded other reader, leaving the victim the jobs
+// it is about to run
+bool impl_steal(JobEngineImpl *impl, size_t thief, Job &job) {
+    JobReader *victim = nullptr;
+    for (size_t index = 0; index < impl->readers.size(); index++) {
+        JobReader &reader = impl->readers[index];
+        if (index != thief && !reader.jobs.empty() && (victim == nullptr || reader.jobs.size() > victim->jobs.size())) {
+            victim = &reader;
+        }
+    }
+    if (victim == nullptr) {
+        return false;
+    }
+
+    for (auto it = victim->jobs.rbegin(); it != victim->jobs.rend(); ++it) {
+        if (it->affinity == job_affinity_any) {
+            job = std::move(*it);
+            victim->jobs.erase(std::next(it).base());
+            return true;
+        }
+    }
+    return false;
+}
+
+// Leaves the connection closed for the next job. A handle the reader refuses to disconnect would stay
+// connected, the reader starts over from a new connection then.
+void impl_close_connection(JobEngineImpl *impl, JobReader &reader) {
+    if (!reader.connection.is_connected() || reader.connection.disconnect() == 0) {
+        return;
+    }
+    impl->provider->destroy_card_connection(reader.connection);
+    reader.connection = impl->provider->create_card_connection(reader.statistics.terminal_name);
+    if (reader.connection.is_valid()) {
+        reader.connection.set_apdu_trace_enabled(false);
+    }
+}
+
+// Brings the connection onto the card now in the reader, cards of a rack being swapped between jobs
+int32_t impl_prepare_connection(JobEngineImpl *impl, JobReader &reader, uint64_t &connects, uint64_t &reconnects) {
+    CardConnection &connection = reader.connection;
+    if (connection.is_connected()) {
+        int32_t status = connection.check_card();
+        if (status == 0) {
+            return 0;
+        }
+        if (status == 1 && connection.reconnect(CardConnection::reset_type_none) == 0) {
+            reconnects++;
+            return 0;
+        }
+        impl_close_connection(impl, reader);
+    }
+
+    if (!reader.connection.is_valid() || reader.connection.connect() != 0) {
+        return -1;
+    }
+    connects++;
+    return 0;
+}
+
+void impl_run_worker(JobEngineImpl *impl, size_t index) {
+    JobReader &reader = impl->readers[index];
+
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    while (true) {
+        Job job;
+        bool found = false;
+        if (!reader.jobs.empty()) {
+            job = std::move(reader.jobs.front());
+            reader.jobs.pop_front();
+            found = true;
+        } else if (impl->options.work_stealing_enabled && impl_steal(impl, index, job)) {
+            reader.statistics.stolen++;
+            found = true;
+        }
+
+        if (!found) {
+            if (impl->stopping) {
+                break;
+            }
+            impl->work.wait(lock);
+            continue;
+        }
+
+        reader.running_job = true;
+        lock.unlock();
+        impl->space.notify_all();
+
+        auto start = std::chrono::steady_clock::now();
+        int32_t result = -1;
+        uint64_t connects = 0;
+        uint64_t reconnects = 0;
+        if (impl_prepare_connection(impl, reader, connects, reconnects) == 0) {
+            result = job.run(reader.connection, index);
+        }
+        // A failed job may leave the card in any state, e.g. a virtual terminal whose card was swapped
+        if (result != 0) {
+            impl_close_connection(impl, reader);
+        }
+        auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+        lock.lock();
+        reader.running_job = false;
+        reader.statistics.busy_ns += (uint64_t)busy.count();
+        reader.statistics.connects += connects;
+        reader.statistics.reconnects += reconnects;
+        if (result == 0) {
+            reader.statistics.completed++;
+        } else {
+            reader.statistics.failed++;
+        }
+        if (impl_is_idle(impl)) {
+            impl->idle.notify_all();
+        }
+    }
+}
+
+} // namespace
+
+JobEngine::JobEngine() {
+    m_impl = (JobEngineImpl *)TSG_ALLOC(sizeof(JobEngineImpl));
+    tsg::Memory::construct_at(m_impl);
+}
+
+JobEngine::~JobEngine() {
+    cleanup();
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(JobEngineImpl));
+}
+
+int32_t JobEngine::initialize(SmartCardProvider &provider, const std::vector<std::string> &terminal_names,
+                              const JobEngineOptions &options) {
+    if (m_impl->running || terminal_names.empty() || options.queue_capacity == 0) {
+        return -1;
+    }
+
+    m_impl->provider = &provider;
+    m_impl->options = options;
+    m_impl->stopping = false;
+    m_impl->submitted = 0;
+    m_impl->back_pressure_ns = 0;
+
+    for (auto &name : terminal_names) {
+        m_impl->readers.emplace_back();
+        JobReader &reader = m_impl->readers.back();
+        reader.connection = provider.create_card_connection(name);
+        reader.statistics.terminal_name = name;
+        if (!reader.connection.is_valid()) {
+            std::cerr << "ERROR - job engine: unknown terminal " << name << std::endl;
+            for (auto &created : m_impl->readers) {
+                provider.destroy_card_connection(created.connection);
+            }
+            m_impl->readers.clear();
+            return -1;
+        }
+        reader.connection.set_apdu_trace_enabled(false);
+    }
+
+    m_impl->running = true;
+    for (size_t index = 0; index < m_impl->readers.size(); index++) {
+        m_impl->readers[index].thread = std::thread(impl_run_worker, m_impl, index);
+    }
+    return 0;
+}
+
+int32_t JobEngine::cleanup() {
+    if (!m_impl->running) {
+        return 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->stopping = true;
+    }
+    m_impl->work.notify_all();
+    m_impl->space.notify_all();
+
+    for (auto &reader : m_impl->readers) {
+        reader.thread.join();
+    }
+    for (auto &reader : m_impl->readers) {
+        m_impl->provider->destroy_card_connection(reader.connection);
+    }
+    m_impl->readers.clear();
+    m_impl->running = false;
+    return 0;
+}
+
+int32_t JobEngine::submit(Job job) {
+    if (!job.run) {
+        return -1;
+    }
+
+    std::unique_lock<std::mutex> lock(m_impl->mutex);
+    std::chrono::steady_clock::time_point wait_start;
+    bool waited = false;
+    while (true) {
+        if (!m_impl->running || m_impl->stopping) {
+            return -1;
+        }
+        size_t target = impl_target_of(m_impl, job);
+        if (target == SIZE_MAX) {
+            return -1;
+        }
+
+        JobReader &reader = m_impl->readers[target];
+        if (reader.jobs.size() < m_impl->options.queue_capacity) {
+            reader.jobs.push_back(std::move(job));
+            m_impl->submitted++;
+            if (waited) {
+                m_impl->back_pressure_ns += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                std::chrono::steady_clock::now() - wait_start)
+                                                .count();
+            }
+            break;
+        }
+
+        if (!waited) {
+            wait_start = std::chrono::steady_clock::now();
+            waited = true;
+        }
+        m_impl->space.wait(lock);
+    }
+    lock.unlock();
+
+    // Idle workers of other readers may steal the job
+    m_impl->work.notify_all();
+    return 0;
+}
+
+int32_t JobEngine::try_submit(Job job) {
+    if (!job.run) {
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        if (!m_impl->running || m_impl->stopping) {
+            return -1;
+        }
+        size_t target = impl_target_of(m_impl, job);
+        if (target == SIZE_MAX || m_impl->readers[target].jobs.size() >= m_impl->options.queue_capacity) {
+            return -1;
+        }
+        m_impl->readers[target].jobs.push_back(std::move(job));
+        m_impl->submitted++;
+    }
+    m_impl->work.notify_all();
+    return 0;
+}
+
+void JobEngine::wait_idle() {
+    std::unique_lock<std::mutex> lock(m_impl->mutex);
+    m_impl->idle.wait(lock, [this]() { return impl_is_idle(m_impl); });
+}
+
+size_t JobEngine::get_reader_count() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->readers.size();
+}
+
+JobEngineStatistics JobEngine::get_statistics() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+
+    JobEngineStatistics statistics;
+    statistics.submitted = m_impl->submitted;
+    statistics.back_pressure_ns = m_impl->back_pressure_ns;
+    for (auto &reader : m_impl->readers) {
+        ReaderJobStatistics reader_statistics = reader.statistics;
+        reader_statistics.queued = reader.jobs.size();
+        statistics.completed += reader_statistics.completed;
+        statistics.failed += reader_statistics.failed;
+        statistics.stolen += reader_statistics.stolen;
+        statistics.connects += reader_statistics.connects;
+        statistics.reconnects += reader_statistics.reconnects;
+        statistics.readers.push_back(reader_statistics);
+    }
+    return statistics;
+}
+
+} // namespace smartcard
+} // namespace tsg
@@ -0,0 +1,352 @@
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <tsg/smartcard/apdu_builder.hpp>
+#include <tsg/smartcard/memory_terminal.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+int32_t respond_sw(uint16_t sw, uint8_t *response, size_t &response_size) {
+    if (response_size < 2) {
+        return -1;
+    }
+    response[0] = (uint8_t)(sw >> 8);
+    response[1] = (uint8_t)(sw & 0xFF);
+    response_size = 2;
+    return 0;
+}
+
+int32_t respond(const uint8_t *data, size_t data_size, uint16_t sw, uint8_t *response, size_t &response_size) {
+    if (response_size < data_size + 2) {
+        return -1; // as a reader would with an insufficient receive buffer
+    }
+    if (data_size > 0) {
+        memcpy(response, data, data_size);
+    }
+    response[data_size + 0] = (uint8_t)(sw >> 8);
+    response[data_size + 1] = (uint8_t)(sw & 0xFF);
+    response_size = data_size + 2;
+    return 0;
+}
+
+} // namespace
+
+MemoryTerminal::MemoryTerminal(const MemoryTerminalConfig &config) : m_config(config) {
+    m_applications.emplace_back(); // MF
+}
+
+void MemoryTerminal::add_application(const uint8_t *aid, size_t aid_size) {
+    MemoryApplication application;
+    application.aid.assign(aid, aid + aid_size);
+    m_applications.emplace_back(application);
+    m_edit_application = m_applications.size() - 1;
+}
+
+void MemoryTerminal::add_file(uint16_t file_id, uint8_t sfi, const uint8_t *content, size_t content_size) {
+    MemoryFile file;
+    file.file_id = file_id;
+    file.sfi = sfi;
+    file.content.assign(content, content + content_size);
+    m_applications[m_edit_application].files.emplace_back(file);
+}
+
+void MemoryTerminal::add_record(uint16_t file_id, const uint8_t *record, size_t record_size) {
+    for (auto &file : m_applications[m_edit_application].files) {
+        if (file.file_id == file_id) {
+            file.records.emplace_back(record, record + record_size);
+            return;
+        }
+    }
+}
+
+int32_t MemoryTerminal::power_on(CardConnection::ResetType, ATR &atr,
+                                 CardConnection::CommunicationProtocol &protocol) {
+    if (!m_card_present) {
+        return -1;
+    }
+
+    // Historical bytes: category 0x80, card capabilities (tag 7) with the extended length bit
+    uint8_t capabilities = m_config.extended_length ? 0x40 : 0x00;
+    uint8_t historical[] = {0x80, 0x73, 0x00, 0x00, capabilities};
+
+    uint8_t bytes[ATR().capacity()] = {};
+    size_t size = 0;
+    bytes[size++] = 0x3B;
+    if (m_config.protocol == CardConnection::com_protocol_t_1) {
+        bytes[size++] = 0x80 | sizeof(historical); // TD1 present
+        bytes[size++] = 0x80;                      // TD1: TD2 present, T=0
+        bytes[size++] = 0x01;                      // TD2: T=1
+        memcpy(&bytes[size], historical, sizeof(historical));
+        size += sizeof(historical);
+        uint8_t tck = 0;
+        for (size_t index = 1; index < size; index++) {
+            tck ^= bytes[index];
+        }
+        bytes[size++] = tck;
+    } else {
+        bytes[size++] = sizeof(historical);
+        memcpy(&bytes[size], historical, sizeof(historical));
+        size += sizeof(historical);
+    }
+
+    atr.reset(bytes, size);
+    protocol = m_config.protocol;
+
+    m_current_application = 0;
+    m_current_file = -1;
+    m_pending_response.clear();
+    m_powered = true;
+
+    return 0;
+}
+
+int32_t MemoryTerminal::power_off() {
+    m_powered = false;
+    return 0;
+}
+
+int32_t MemoryTerminal::transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) {
+    if (!m_card_present || !m_powered || capdu_size < 4) {
+        return -1;
+    }
+
+    m_command_count++;
+    int32_t result = process(capdu, capdu_size, response, response_size);
+    simulate_latency(capdu_size + (result == 0 ? response_size : 0));
+
+    return result;
+}
+
+int32_t MemoryTerminal::process(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) {
+    if (capdu[1] != apdu::ins_get_response) {
+        m_pending_response.clear();
+    }
+
+    switch (capdu[1]) {
+    case apdu::ins_select:
+        return select(capdu, capdu_size, response, response_size);
+
+    case apdu::ins_read_binary:
+        return read_binary(capdu, capdu_size, response, response_size);
+
+    case apdu::ins_read_record:
+        return read_record(capdu, capdu_size, response, response_size);
+
+    case apdu::ins_get_response:
+        return get_response(capdu, capdu_size, response, response_size);
+
+    case apdu::ins_verify:
+        return respond_sw(0x9000, response, response_size);
+
+    default:
+        return respond_sw(0x6D00, response, response_size);
+    }
+}
+
+int32_t MemoryTerminal::select(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) {
+    if (capdu_size < 5 || capdu[4] == 0x00 || capdu_size < 5 + (size_t)capdu[4]) {
+        return respond_sw(0x6700, response, response_size);
+    }
+
+    const uint8_t *data = &capdu[5];
+    size_t data_size = capdu[4];
+
+    switch (capdu[2]) {
+    case apdu::select_p1_df_name: {
+        for (size_t index = 1; index < m_applications.size(); index++) {
+            auto &aid = m_applications[index].aid;
+            if (aid.size() == data_size && memcmp(aid.data(), data, data_size) == 0) {
+                m_current_application = index;
+                m_current_file = -1;
+
+                if ((capdu[3] & 0x0C) == apdu::select_p2_no_response_data) {
+                    return respond_sw(0x9000, response, response_size);
+                }
+
+                m_pending_response = {0x6F, (uint8_t)(data_size + 2), 0x84, (uint8_t)data_size};
+                m_pending_response.insert(m_pending_response.end(), data, data + data_size);
+
+                if (m_config.protocol == CardConnection::com_protocol_t_0) {
+                    return respond_sw((uint16_t)(0x6100 | m_pending_response.size()), response, response_size);
+                }
+                int32_t result = respond(m_pending_response.data(), m_pending_response.size(), 0x9000, response,
+                                         response_size);
+                m_pending_response.clear();
+                return result;
+            }
+        }
+        return respond_sw(0x6A82, response, response_size);
+    }
+
+    case apdu::select_p1_file_id:
+    case apdu::select_p1_ef_under_current_df:
+    case apdu::select_p1_path_from_mf: {
+        if (data_size % 2 != 0) {
+            return respond_sw(0x6A86, response, response_size);
+        }
+        uint16_t file_id = (uint16_t)((data[data_size - 2] << 8) | data[data_size - 1]);
+        if (file_id == 0x3F00) {
+            m_current_application = 0;
+            m_current_file = -1;
+            return respond_sw(0x9000, response, response_size);
+        }
+        int32_t index = find_file(file_id);
+        if (index < 0) {
+            return respond_sw(0x6A82, response, response_size);
+        }
+        m_current_file = index;
+        return respond_sw(0x9000, response, response_size);
+    }
+
+    default:
+        return respond_sw(0x6A86, response, response_size);
+    }
+}
+
+int32_t MemoryTerminal::read_binary(const uint8_t *capdu, size_t capdu_size, uint8_t *response,
+                                    size_t &response_size) {
+    size_t offset = 0;
+    if ((capdu[2] & 0x80) != 0) {
+        int32_t index = find_file_by_sfi(capdu[2] & 0x1F);
+        if (index < 0) {
+            return respond_sw(0x6A82, response, response_size);
+        }
+        m_current_file = index;
+        offset = capdu[3];
+    } else {
+        offset = ((size_t)capdu[2] << 8) | capdu[3];
+    }
+
+    if (m_current_file < 0) {
+        return respond_sw(0x6986, response, response_size);
+    }
+
+    size_t ne = 0;
+    uint16_t sw = 0;
+    if (!expected_length_of(capdu, capdu_size, ne, sw)) {
+        return respond_sw(sw, response, response_size);
+    }
+
+    auto &content = m_applications[m_current_application].files[m_current_file].content;
+    if (offset > content.size() || (offset == content.size() && ne > 0)) {
+        return respond_sw(0x6B00, response, response_size);
+    }
+
+    size_t count = (content.size() - offset) < ne ? (content.size() - offset) : ne;
+    return respond(content.data() + offset, count, count < ne ? 0x6282 : 0x9000, response, response_size);
+}
+
+int32_t MemoryTerminal::read_record(const uint8_t *capdu, size_t capdu_size, uint8_t *response,
+                                    size_t &response_size) {
+    uint8_t sfi = (capdu[3] >> 3) & 0x1F;
+    if (sfi != 0) {
+        int32_t index = find_file_by_sfi(sfi);
+        if (index < 0) {
+            return respond_sw(0x6A82, response, response_size);
+        }
+        m_current_file = index;
+    }
+
+    if (m_current_file < 0) {
+        return respond_sw(0x6986, response, response_size);
+    }
+
+    size_t ne = 0;
+    uint16_t sw = 0;
+    if (!expected_length_of(capdu, capdu_size, ne, sw)) {
+        return respond_sw(sw, response, response_size);
+    }
+
+    auto &records = m_applications[m_current_application].files[m_current_file].records;
+    if (capdu[2] == 0 || capdu[2] > records.size()) {
+        return respond_sw(0x6A83, response, response_size);
+    }
+
+    auto &record = records[capdu[2] - 1];
+    if (record.size() > ne) {
+        return respond_sw((uint16_t)(0x6C00 | (record.size() & 0xFF)), response, response_size);
+    }
+    return respond(record.data(), record.size(), 0x9000, response, response_size);
+}
+
+int32_t MemoryTerminal::get_response(const uint8_t *capdu, size_t capdu_size, uint8_t *response,
+                                     size_t &response_size) {
+    if (m_pending_response.empty()) {
+        return respond_sw(0x6985, response, response_size);
+    }
+
+    size_t ne = 0;
+    uint16_t sw = 0;
+    if (!expected_length_of(capdu, capdu_size, ne, sw)) {
+        return respond_sw(sw, response, response_size);
+    }
+
+    size_t count = m_pending_response.size() < ne ? m_pending_response.size() : ne;
+    size_t remaining = m_pending_response.size() - count;
+    uint16_t status = remaining == 0 ? 0x9000 : (uint16_t)(0x6100 | (remaining > 0xFF ? 0x00 : remaining));
+    int32_t result = respond(m_pending_response.data(), count, status, response, response_size);
+    m_pending_response.erase(m_pending_response.begin(), m_pending_response.begin() + count);
+    return result;
+}
+
+// Ne of a case 2 command, short (CLA INS P1 P2 Le) or extended (CLA INS P1 P2 00 Le1 Le2)
+bool MemoryTerminal::expected_length_of(const uint8_t *capdu, size_t capdu_size, size_t &ne, uint16_t &sw) {
+    if (capdu_size == 5) {
+        ne = capdu[4] == 0x00 ? k_max_short_ne : capdu[4];
+        if (ne > m_config.max_short_ne) {
+            sw = 0x6700;
+            return false;
+        }
+        return true;
+    }
+
+    if (capdu_size == 7 && capdu[4] == 0x00) {
+        if (!m_config.extended_length) {
+            sw = 0x6700;
+            return false;
+        }
+        ne = ((size_t)capdu[5] << 8) | capdu[6];
+        ne = ne == 0 ? k_max_extended_ne : ne;
+        if (ne > m_config.max_extended_ne) {
+            sw = 0x6700;
+            return false;
+        }
+        return true;
+    }
+
+    sw = 0x6700;
+    return false;
+}
+
+int32_t MemoryTerminal::find_file(uint16_t file_id) const {
+    auto &files = m_applications[m_current_application].files;
+    for (size_t index = 0; index < files.size(); index++) {
+        if (files[index].file_id == file_id) {
+            return (int32_t)index;
+        }
+    }
+    return -1;
+}
+
+int32_t MemoryTerminal::find_file_by_sfi(uint8_t sfi) const {
+    auto &files = m_applications[m_current_application].files;
+    for (size_t index = 0; index < files.size(); index++) {
+        if (files[index].sfi == sfi) {
+            return (int32_t)index;
+        }
+    }
+    return -1;
+}
+
+void MemoryTerminal::simulate_latency(size_t bytes) {
+    uint64_t latency_ns = (uint64_t)m_config.command_latency_us * 1000 + (uint64_t)m_config.byte_latency_ns * bytes;
+    if (latency_ns > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(latency_ns));
+    }
+}
+
+} // namespace smartcard
+} // namespace tsg
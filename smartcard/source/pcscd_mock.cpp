@@ -0,0 +1,622 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/pcscd_mock.hpp>
+#include <tsg/smartcard/virtual_terminal.hpp>
+#include <unistd.h>
+#include <vector>
+
+#include "pcscd_protocol.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+struct MockReader {
+    std::string name;
+    VirtualTerminal *terminal{nullptr};
+
+    // Serializes the terminal between the sessions and guards the state below
+    std::mutex mutex;
+    bool is_powered{false};
+    ATR atr;
+    uint32_t protocol{pcscd_protocol_t1};
+    int32_t sharing{0};
+    int32_t transaction_card{0};
+    uint32_t event_counter{0};
+};
+
+struct MockCard {
+    MockReader *reader{nullptr};
+    uint32_t context{0};
+    bool is_exclusive{false};
+};
+
+struct MockSession {
+    int fd{-1};
+    std::thread thread;
+    std::atomic<bool> finished{false};
+
+    // Only used by the session thread
+    bool has_version{false};
+    std::vector<uint32_t> contexts;
+    std::map<int32_t, MockCard> cards;
+    std::vector<uint8_t> command;
+    std::vector<uint8_t> response;
+};
+
+struct PcscdMockImpl {
+    // Fixed while running
+    std::list<MockReader> readers;
+
+    std::string socket_path;
+    int listen_fd{-1};
+
+    // Written to by stop() to wake the accept thread up
+    int wake_fds[2]{-1, -1};
+
+    std::atomic<bool> running{false};
+    std::thread accept_thread;
+
+    // Guards the sessions list
+    std::mutex mutex;
+    std::list<MockSession> sessions;
+
+    // Contexts and card handles
+    std::atomic<uint32_t> next_handle{1};
+
+    std::atomic<uint64_t> sessions_count{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> transmits{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+namespace {
+
+uint32_t impl_to_pcscd_protocol(CardConnection::CommunicationProtocol protocol) {
+    return protocol == CardConnection::com_protocol_t_0 ? pcscd_protocol_t0 : pcscd_protocol_t1;
+}
+
+// Called with the reader locked
+uint32_t impl_power_on(MockReader *reader, CardConnection::ResetType reset_type) {
+    CardConnection::CommunicationProtocol protocol;
+    if (reader->terminal->power_on(reset_type, reader->atr, protocol) != 0) {
+        reader->is_powered = false;
+        return pcscd_f_comm_error;
+    }
+    reader->protocol = impl_to_pcscd_protocol(protocol);
+    reader->is_powered = true;
+    reader->event_counter++;
+    return pcscd_success;
+}
+
+// Called with the reader locked
+uint32_t impl_apply_disposition(MockReader *reader, uint32_t disposition) {
+    if (disposition == pcscd_reset_card) {
+        return impl_power_on(reader, CardConnection::reset_type_warm);
+    }
+    if (disposition == pcscd_unpower_card && reader->is_powered) {
+        reader->terminal->power_off();
+        reader->is_powered = false;
+        reader->event_counter++;
+    }
+    return pcscd_success;
+}
+
+MockReader *impl_find_reader(PcscdMockImpl *impl, const char *name) {
+    for (auto &reader : impl->readers) {
+        if (strncmp(reader.name.c_str(), name, k_pcscd_max_reader_name) == 0) {
+            return &reader;
+        }
+    }
+    return nullptr;
+}
+
+MockCard *impl_find_card(MockSession *session, int32_t card) {
+    auto it = session->cards.find(card);
+    return it != session->cards.end() ? &it->second : nullptr;
+}
+
+bool impl_has_context(MockSession *session, uint32_t context) {
+    for (uint32_t other : session->contexts) {
+        if (other == context) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t impl_disconnect(MockSession *session, int32_t card, uint32_t disposition) {
+    MockCard *mock_card = impl_find_card(session, card);
+    if (mock_card == nullptr) {
+        return pcscd_e_invalid_handle;
+    }
+
+    MockReader *reader = mock_card->reader;
+    uint32_t rv;
+    {
+        std::lock_guard<std::mutex> lock(reader->mutex);
+        reader->sharing = mock_card->is_exclusive ? 0 : reader->sharing - 1;
+        if (reader->transaction_card == card) {
+            reader->transaction_card = 0;
+        }
+        rv = impl_apply_disposition(reader, disposition);
+    }
+    session->cards.erase(card);
+    return rv;
+}
+
+uint32_t impl_connect(PcscdMockImpl *impl, MockSession *session, PcscdConnect &message) {
+    message.reader[k_pcscd_max_reader_name - 1] = 0;
+    if (!impl_has_context(session, message.context)) {
+        return pcscd_e_invalid_handle;
+    }
+    MockReader *reader = impl_find_reader(impl, message.reader);
+    if (reader == nullptr) {
+        return pcscd_e_unknown_reader;
+    }
+    if (message.share_mode != pcscd_share_shared && message.share_mode != pcscd_share_exclusive) {
+        return pcscd_e_unsupported_feature;
+    }
+
+    bool is_exclusive = message.share_mode == pcscd_share_exclusive;
+    std::lock_guard<std::mutex> lock(reader->mutex);
+    if (!reader->terminal->is_card_present()) {
+        reader->is_powered = false;
+        return pcscd_e_no_smartcard;
+    }
+    if (reader->sharing == k_pcscd_sharing_exclusive || (is_exclusive && reader->sharing > 0)) {
+        return pcscd_e_sharing_violation;
+    }
+    if (!reader->is_powered) {
+        uint32_t rv = impl_power_on(reader, CardConnection::reset_type_cold);
+        if (rv != pcscd_success) {
+            return rv;
+        }
+    }
+    if ((message.preferred_protocols & reader->protocol) == 0) {
+        return pcscd_e_proto_mismatch;
+    }
+
+    reader->sharing = is_exclusive ? k_pcscd_sharing_exclusive : reader->sharing + 1;
+    message.card = (int32_t)impl->next_handle++;
+    message.active_protocol = reader->protocol;
+    session->cards[message.card] = MockCard{reader, message.context, is_exclusive};
+    return pcscd_success;
+}
+
+uint32_t impl_reconnect(MockSession *session, PcscdReconnect &message) {
+    MockCard *card = impl_find_card(session, message.card);
+    if (card == nullptr) {
+        return pcscd_e_invalid_handle;
+    }
+
+    MockReader *reader = card->reader;
+    std::lock_guard<std::mutex> lock(reader->mutex);
+    if (!reader->terminal->is_card_present()) {
+        reader->is_powered = false;
+        return pcscd_e_no_smartcard;
+    }
+    uint32_t rv = pcscd_success;
+    if (message.initialization == pcscd_unpower_card) {
+        rv = impl_power_on(reader, CardConnection::reset_type_cold);
+    } else if (message.initialization == pcscd_reset_card || !reader->is_powered) {
+        rv = impl_power_on(reader, CardConnection::reset_type_warm);
+    }
+    if (rv != pcscd_success) {
+        return rv;
+    }
+    if ((message.preferred_protocols & reader->protocol) == 0) {
+        return pcscd_e_proto_mismatch;
+    }
+    message.active_protocol = reader->protocol;
+    return pcscd_success;
+}
+
+uint32_t impl_begin_transaction(MockSession *session, PcscdCard &message) {
+    MockCard *card = impl_find_card(session, message.card);
+    if (card == nullptr) {
+        return pcscd_e_invalid_handle;
+    }
+    std::lock_guard<std::mutex> lock(card->reader->mutex);
+    if (card->reader->transaction_card != 0 && card->reader->transaction_card != message.card) {
+        return pcscd_e_sharing_violation;
+    }
+    card->reader->transaction_card = message.card;
+    return pcscd_success;
+}
+
+uint32_t impl_end_transaction(MockSession *session, PcscdCardDisposition &message) {
+    MockCard *card = impl_find_card(session, message.card);
+    if (card == nullptr) {
+        return pcscd_e_invalid_handle;
+    }
+    std::lock_guard<std::mutex> lock(card->reader->mutex);
+    if (card->reader->transaction_card != message.card) {
+        return pcscd_e_not_transacted;
+    }
+    card->reader->transaction_card = 0;
+    return impl_apply_disposition(card->reader, message.disposition);
+}
+
+uint32_t impl_release_context(MockSession *session, uint32_t context) {
+    if (!impl_has_context(session, context)) {
+        return pcscd_e_invalid_handle;
+    }
+    std::vector<int32_t> cards;
+    for (auto &entry : session->cards) {
+        if (entry.second.context == context) {
+            cards.push_back(entry.first);
+        }
+    }
+    for (int32_t card : cards) {
+        impl_disconnect(session, card, pcscd_leave_card);
+    }
+    for (auto it = session->contexts.begin(); it != session->contexts.end(); ++it) {
+        if (*it == context) {
+            session->contexts.erase(it);
+            break;
+        }
+    }
+    return pcscd_success;
+}
+
+int32_t impl_send_reader_states(PcscdMockImpl *impl, MockSession *session) {
+    PcscdReaderState states[k_pcscd_max_readers] = {};
+    size_t index = 0;
+    for (auto &reader : impl->readers) {
+        if (index == k_pcscd_max_readers) {
+            break;
+        }
+        PcscdReaderState &state = states[index++];
+        memcpy(state.name, reader.name.c_str(), reader.name.size());
+
+        std::lock_guard<std::mutex> lock(reader.mutex);
+        if (!reader.terminal->is_card_present()) {
+            reader.is_powered = false;
+            state.state = pcscd_state_absent;
+        } else if (reader.is_powered) {
+            state.state = pcscd_state_present | pcscd_state_powered | pcscd_state_specific;
+            state.atr_size = (uint32_t)std::min(reader.atr.size(), k_pcscd_max_atr_size);
+            memcpy(state.atr, reader.atr.data(), state.atr_size);
+            state.protocol = reader.protocol;
+        } else {
+            state.state = pcscd_state_present;
+        }
+        state.event_counter = reader.event_counter;
+        state.sharing = reader.sharing;
+    }
+
+    iovec vector = {states, sizeof(states)};
+    return pcscd_write(session->fd, &vector, 1);
+}
+
+int32_t impl_transmit(PcscdMockImpl *impl, MockSession *session, const PcscdHeader &header) {
+    PcscdTransmit message;
+    if (header.size != sizeof(message) || pcscd_read(session->fd, &message, sizeof(message)) != 0 ||
+        message.send_length > k_pcscd_max_buffer_size_extended ||
+        pcscd_read(session->fd, session->command.data(), message.send_length) != 0) {
+        std::cerr << "ERROR - pcscd mock: invalid transmit request" << std::endl;
+        return -1;
+    }
+
+    size_t response_size = std::min((size_t)message.receive_length, k_pcscd_max_buffer_size_extended);
+    message.receive_length = 0;
+    message.rv = pcscd_success;
+    MockCard *card = impl_find_card(session, message.card);
+    if (card == nullptr) {
+        message.rv = pcscd_e_invalid_handle;
+    } else {
+        impl->transmits++;
+        std::lock_guard<std::mutex> lock(card->reader->mutex);
+        if (card->reader->transaction_card != 0 && card->reader->transaction_card != message.card) {
+            message.rv = pcscd_e_sharing_violation;
+        } else if (!card->reader->is_powered || !card->reader->terminal->is_card_present()) {
+            message.rv = pcscd_e_no_smartcard;
+        } else if (card->reader->terminal->transmit(session->command.data(), message.send_length,
+                                                    session->response.data(), response_size) != 0) {
+            message.rv = pcscd_f_comm_error;
+        } else {
+            message.receive_length = (uint32_t)response_size;
+        }
+    }
+
+    if (message.rv != pcscd_success) {
+        impl->errors++;
+    }
+    iovec vectors[2] = {{&message, sizeof(message)}, {session->response.data(), message.receive_length}};
+    return pcscd_write(session->fd, vectors, 2);
+}
+
+// Reads a fixed size request, lets 'handler' answer it in place and sends it back
+template <typename Message, typename Handler>
+int32_t impl_serve(PcscdMockImpl *impl, MockSession *session, const PcscdHeader &header, Handler handler) {
+    Message message;
+    if (header.size != sizeof(message) || pcscd_read(session->fd, &message, sizeof(message)) != 0) {
+        std::cerr << "ERROR - pcscd mock: invalid request " << header.command << std::endl;
+        return -1;
+    }
+    message.rv = handler(message);
+    if (message.rv != pcscd_success) {
+        impl->errors++;
+    }
+    iovec vector = {&message, sizeof(message)};
+    return pcscd_write(session->fd, &vector, 1);
+}
+
+int32_t impl_handle_request(PcscdMockImpl *impl, MockSession *session, const PcscdHeader &header) {
+    if (header.command == pcscd_command_version) {
+        return impl_serve<PcscdVersion>(impl, session, header, [&](PcscdVersion &message) {
+            bool is_supported = message.major == k_pcscd_protocol_major && message.minor == k_pcscd_protocol_minor;
+            session->has_version = is_supported;
+            message.major = k_pcscd_protocol_major;
+            message.minor = k_pcscd_protocol_minor;
+            return is_supported ? pcscd_success : pcscd_e_no_service;
+        });
+    }
+    if (!session->has_version) {
+        std::cerr << "ERROR - pcscd mock: request " << header.command << " before the version" << std::endl;
+        return -1;
+    }
+
+    switch (header.command) {
+    case pcscd_command_establish_context:
+        return impl_serve<PcscdEstablish>(impl, session, header, [&](PcscdEstablish &message) {
+            message.context = impl->next_handle++;
+            session->contexts.push_back(message.context);
+            return pcscd_success;
+        });
+
+    case pcscd_command_release_context:
+        return impl_serve<PcscdRelease>(impl, session, header, [&](PcscdRelease &message) {
+            return impl_release_context(session, message.context);
+        });
+
+    case pcscd_command_get_readers_state:
+        return impl_send_reader_states(impl, session);
+
+    case pcscd_command_connect:
+        return impl_serve<PcscdConnect>(impl, session, header,
+                                        [&](PcscdConnect &message) { return impl_connect(impl, session, message); });
+
+    case pcscd_command_reconnect:
+        return impl_serve<PcscdReconnect>(impl, session, header,
+                                          [&](PcscdReconnect &message) { return impl_reconnect(session, message); });
+
+    case pcscd_command_disconnect:
+        return impl_serve<PcscdCardDisposition>(impl, session, header, [&](PcscdCardDisposition &message) {
+            return impl_disconnect(session, message.card, message.disposition);
+        });
+
+    case pcscd_command_begin_transaction:
+        return impl_serve<PcscdCard>(impl, session, header,
+                                     [&](PcscdCard &message) { return impl_begin_transaction(session, message); });
+
+    case pcscd_command_end_transaction:
+        return impl_serve<PcscdCardDisposition>(impl, session, header, [&](PcscdCardDisposition &message) {
+            return impl_end_transaction(session, message);
+        });
+
+    case pcscd_command_transmit:
+        return impl_transmit(impl, session, header);
+
+    default:
+        // Like pcscd, an unknown command ends the session, its size being untrusted
+        std::cerr << "ERROR - pcscd mock: unsupported command " << header.command << std::endl;
+        return -1;
+    }
+}
+
+void impl_serve_session(PcscdMockImpl *impl, MockSession *session) {
+    session->command.resize(k_pcscd_max_buffer_size_extended);
+    session->response.resize(k_pcscd_max_buffer_size_extended);
+
+    while (true) {
+        PcscdHeader header;
+        if (pcscd_read(session->fd, &header, sizeof(header)) != 0) {
+            break;
+        }
+        impl->requests++;
+        if (impl_handle_request(impl, session, header) != 0) {
+            impl->errors++;
+            break;
+        }
+    }
+
+    // Cards left connected by the client, like pcscd does for a client gone
+    while (!session->cards.empty()) {
+        impl_disconnect(session, session->cards.begin()->first, pcscd_leave_card);
+    }
+    session->contexts.clear();
+    session->finished = true;
+}
+
+void impl_close_session(MockSession *session) {
+    session->thread.join();
+    close(session->fd);
+    session->fd = -1;
+}
+
+void impl_reap_sessions(PcscdMockImpl *impl) {
+    for (auto it = impl->sessions.begin(); it != impl->sessions.end();) {
+        if (it->finished) {
+            impl_close_session(&*it);
+            it = impl->sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void impl_accept(PcscdMockImpl *impl) {
+    pollfd descriptors[2] = {};
+    descriptors[0].fd = impl->listen_fd;
+    descriptors[0].events = POLLIN;
+    descriptors[1].fd = impl->wake_fds[0];
+    descriptors[1].events = POLLIN;
+
+    while (impl->running) {
+        if (poll(descriptors, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "ERROR - pcscd mock: poll " << strerror(errno) << std::endl;
+            break;
+        }
+        if (descriptors[1].revents != 0) {
+            break;
+        }
+        if ((descriptors[0].revents & POLLIN) == 0) {
+            continue;
+        }
+
+        int fd = accept(impl->listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                std::cerr << "ERROR - pcscd mock: accept " << strerror(errno) << std::endl;
+            }
+            continue;
+        }
+#ifdef SO_NOSIGPIPE
+        int enabled = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl_reap_sessions(impl);
+        impl->sessions.emplace_back();
+        MockSession *session = &impl->sessions.back();
+        session->fd = fd;
+        session->thread = std::thread(impl_serve_session, impl, session);
+        impl->sessions_count++;
+    }
+}
+
+void impl_close_fds(PcscdMockImpl *impl) {
+    for (int *fd : {&impl->listen_fd, &impl->wake_fds[0], &impl->wake_fds[1]}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+} // namespace
+
+PcscdMock::PcscdMock() {
+    m_impl = (PcscdMockImpl *)TSG_ALLOC(sizeof(PcscdMockImpl));
+    tsg::Memory::construct_at(m_impl);
+}
+
+PcscdMock::~PcscdMock() {
+    stop();
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(PcscdMockImpl));
+}
+
+int32_t PcscdMock::add_reader(const std::string &name, VirtualTerminal *terminal) {
+    if (m_impl->running) {
+        std::cerr << "ERROR - pcscd mock: readers are added before start()" << std::endl;
+        return -1;
+    }
+    if (name.empty() || name.size() >= k_pcscd_max_reader_name || terminal == nullptr ||
+        m_impl->readers.size() == k_pcscd_max_readers || impl_find_reader(m_impl, name.c_str()) != nullptr) {
+        std::cerr << "ERROR - pcscd mock: cannot add reader " << name << std::endl;
+        return -1;
+    }
+    m_impl->readers.emplace_back();
+    m_impl->readers.back().name = name;
+    m_impl->readers.back().terminal = terminal;
+    return 0;
+}
+
+int32_t PcscdMock::start(const char *socket_path) {
+    if (m_impl->running) {
+        std::cerr << "ERROR - pcscd mock: already listening on " << m_impl->socket_path << std::endl;
+        return -1;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        std::cerr << "ERROR - pcscd mock: socket path too long " << socket_path << std::endl;
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    if (pipe(m_impl->wake_fds) != 0) {
+        std::cerr << "ERROR - pcscd mock: pipe " << strerror(errno) << std::endl;
+        return -1;
+    }
+    m_impl->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_impl->listen_fd < 0) {
+        std::cerr << "ERROR - pcscd mock: socket " << strerror(errno) << std::endl;
+        impl_close_fds(m_impl);
+        return -1;
+    }
+
+    unlink(socket_path);
+    if (bind(m_impl->listen_fd, (const sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(m_impl->listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "ERROR - pcscd mock: cannot listen on " << socket_path << " " << strerror(errno) << std::endl;
+        impl_close_fds(m_impl);
+        return -1;
+    }
+
+    m_impl->socket_path = socket_path;
+    m_impl->running = true;
+    m_impl->accept_thread = std::thread(impl_accept, m_impl);
+    return 0;
+}
+
+void PcscdMock::stop() {
+    if (!m_impl->running) {
+        return;
+    }
+    m_impl->running = false;
+
+    uint8_t wake = 1;
+    if (write(m_impl->wake_fds[1], &wake, 1) != 1) {
+        std::cerr << "ERROR - pcscd mock: cannot wake the accept thread " << strerror(errno) << std::endl;
+    }
+    m_impl->accept_thread.join();
+
+    // No session is added anymore, the sockets being closed once their thread ended
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        for (auto &session : m_impl->sessions) {
+            shutdown(session.fd, SHUT_RDWR);
+        }
+    }
+    for (auto &session : m_impl->sessions) {
+        impl_close_session(&session);
+    }
+    m_impl->sessions.clear();
+
+    impl_close_fds(m_impl);
+    unlink(m_impl->socket_path.c_str());
+}
+
+bool PcscdMock::is_running() const { return m_impl->running; }
+
+PcscdMockStatistics PcscdMock::get_statistics() const {
+    PcscdMockStatistics statistics;
+    statistics.sessions = m_impl->sessions_count;
+    statistics.requests = m_impl->requests;
+    statistics.transmits = m_impl->transmits;
+    statistics.errors = m_impl->errors;
+    return statistics;
+}
+
+} // namespace smartcard
+} // namespace tsg
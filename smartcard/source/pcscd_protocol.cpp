@@ -0,0 +1,86 @@
+#include "pcscd_protocol.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+constexpr int k_send_flags = MSG_NOSIGNAL;
+#else
+constexpr int k_send_flags = 0;
+#endif
+
+} // namespace
+
+const char *pcscd_socket_path() {
+    const char *path = getenv("PCSCLITE_CSOCK_NAME");
+    return (path != nullptr && path[0] != 0) ? path : k_pcscd_socket_path;
+}
+
+int32_t pcscd_write(int fd, iovec *vectors, int count) {
+    msghdr message = {};
+    message.msg_iov = vectors;
+    message.msg_iovlen = count;
+    while (message.msg_iovlen > 0) {
+        ssize_t result = sendmsg(fd, &message, k_send_flags);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "ERROR - pcscd: send " << strerror(errno) << std::endl;
+            return -1;
+        }
+
+        // Skips what was sent, usually everything at once
+        size_t sent = (size_t)result;
+        while (message.msg_iovlen > 0 && sent >= message.msg_iov->iov_len) {
+            sent -= message.msg_iov->iov_len;
+            message.msg_iov++;
+            message.msg_iovlen--;
+        }
+        if (message.msg_iovlen > 0) {
+            message.msg_iov->iov_base = (uint8_t *)message.msg_iov->iov_base + sent;
+            message.msg_iov->iov_len -= sent;
+        }
+    }
+    return 0;
+}
+
+int32_t pcscd_read(int fd, void *bytes, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ssize_t result = recv(fd, (uint8_t *)bytes + received, size - received, 0);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "ERROR - pcscd: recv " << strerror(errno) << std::endl;
+            return -1;
+        }
+        if (result == 0) {
+            return received == 0 ? 1 : -1;
+        }
+        received += (size_t)result;
+    }
+    return 0;
+}
+
+int32_t pcscd_call(int fd, uint32_t command, void *message, size_t message_size) {
+    PcscdHeader header = {(uint32_t)message_size, command};
+    iovec vectors[2] = {{&header, sizeof(header)}, {message, message_size}};
+    if (pcscd_write(fd, vectors, 2) != 0) {
+        return -1;
+    }
+    return pcscd_read(fd, message, message_size) == 0 ? 0 : -1;
+}
+
+} // namespace smartcard
+} // namespace tsg
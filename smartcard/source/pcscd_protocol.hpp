@@ -0,0 +1,176 @@
+#ifndef TSG_SMARTCARD_PCSCD_PROTOCOL_HPP
+#define TSG_SMARTCARD_PCSCD_PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+
+// Subset of the protocol spoken by pcscd on its Unix domain socket (pcsc-lite winscard_msg.h), shared by
+// PcscdTerminal and PcscdMock. A request is a PcscdHeader followed by the command structure, and for
+// a transmit by the command bytes. The response is the structure sent back, followed for a successful
+// transmit by the response bytes. Structures use the native layout, client and daemon running on the
+// same host. The names are prefixed so as not to clash with the WinSCard.h macros.
+
+namespace tsg {
+namespace smartcard {
+
+constexpr const char *k_pcscd_socket_path = "/run/pcscd/pcscd.comm";
+
+constexpr int32_t k_pcscd_protocol_major = 4;
+constexpr int32_t k_pcscd_protocol_minor = 4;
+
+constexpr size_t k_pcscd_max_reader_name = 128;
+constexpr size_t k_pcscd_max_atr_size = 33;
+constexpr size_t k_pcscd_max_readers = 16;
+constexpr size_t k_pcscd_max_buffer_size_extended = 4 + 3 + (1 << 16) + 3 + 2;
+
+enum PcscdCommand : uint32_t {
+    pcscd_command_establish_context = 0x01,
+    pcscd_command_release_context = 0x02,
+    pcscd_command_connect = 0x04,
+    pcscd_command_reconnect = 0x05,
+    pcscd_command_disconnect = 0x06,
+    pcscd_command_begin_transaction = 0x07,
+    pcscd_command_end_transaction = 0x08,
+    pcscd_command_transmit = 0x09,
+    pcscd_command_status = 0x0B,
+    pcscd_command_version = 0x11,
+    pcscd_command_get_readers_state = 0x12,
+};
+
+enum PcscdResult : uint32_t {
+    pcscd_success = 0x00000000,
+    pcscd_e_invalid_handle = 0x80100003,
+    pcscd_e_invalid_parameter = 0x80100004,
+    pcscd_e_insufficient_buffer = 0x80100008,
+    pcscd_e_unknown_reader = 0x80100009,
+    pcscd_e_sharing_violation = 0x8010000B,
+    pcscd_e_no_smartcard = 0x8010000C,
+    pcscd_e_proto_mismatch = 0x8010000F,
+    pcscd_e_invalid_value = 0x80100011,
+    pcscd_f_comm_error = 0x80100013,
+    pcscd_e_not_transacted = 0x80100016,
+    pcscd_e_no_service = 0x8010001D,
+    pcscd_e_unsupported_feature = 0x80100022,
+};
+
+enum PcscdShareMode : uint32_t {
+    pcscd_share_exclusive = 1,
+    pcscd_share_shared = 2,
+    pcscd_share_direct = 3,
+};
+
+enum PcscdDisposition : uint32_t {
+    pcscd_leave_card = 0,
+    pcscd_reset_card = 1,
+    pcscd_unpower_card = 2,
+};
+
+enum PcscdProtocol : uint32_t {
+    pcscd_protocol_t0 = 0x0001,
+    pcscd_protocol_t1 = 0x0002,
+};
+
+// PcscdReaderState::state bits
+enum PcscdReaderStateFlags : uint32_t {
+    pcscd_state_absent = 0x0002,
+    pcscd_state_present = 0x0004,
+    pcscd_state_powered = 0x0010,
+    pcscd_state_specific = 0x0040,
+};
+
+// PcscdReaderState::sharing, otherwise the number of shared handles
+constexpr int32_t k_pcscd_sharing_exclusive = -1;
+
+struct PcscdHeader {
+    uint32_t size;
+    uint32_t command;
+};
+
+struct PcscdVersion {
+    int32_t major;
+    int32_t minor;
+    uint32_t rv;
+};
+
+struct PcscdEstablish {
+    uint32_t scope;
+    uint32_t context;
+    uint32_t rv;
+};
+
+struct PcscdRelease {
+    uint32_t context;
+    uint32_t rv;
+};
+
+struct PcscdConnect {
+    uint32_t context;
+    char reader[k_pcscd_max_reader_name];
+    uint32_t share_mode;
+    uint32_t preferred_protocols;
+    int32_t card;
+    uint32_t active_protocol;
+    uint32_t rv;
+};
+
+struct PcscdReconnect {
+    int32_t card;
+    uint32_t share_mode;
+    uint32_t preferred_protocols;
+    uint32_t initialization;
+    uint32_t active_protocol;
+    uint32_t rv;
+};
+
+// Disconnect and end transaction
+struct PcscdCardDisposition {
+    int32_t card;
+    uint32_t disposition;
+    uint32_t rv;
+};
+
+// Begin transaction and status, the card state being read from the readers state
+struct PcscdCard {
+    int32_t card;
+    uint32_t rv;
+};
+
+struct PcscdTransmit {
+    int32_t card;
+    uint32_t send_pci_protocol;
+    uint32_t send_pci_length;
+    uint32_t send_length;
+    uint32_t receive_pci_protocol;
+    uint32_t receive_pci_length;
+    uint32_t receive_length;
+    uint32_t rv;
+};
+
+// Element of the table sent in response to pcscd_command_get_readers_state, unused when 'name' is empty
+struct PcscdReaderState {
+    char name[k_pcscd_max_reader_name];
+    uint32_t event_counter;
+    uint32_t state;
+    int32_t sharing;
+    uint8_t atr[k_pcscd_max_atr_size];
+    uint32_t atr_size;
+    uint32_t protocol;
+};
+
+// Socket of the daemon, PCSCLITE_CSOCK_NAME overriding the default like for libpcsclite
+const char *pcscd_socket_path();
+
+// Writes every vector, 0 once done, -1 on error
+int32_t pcscd_write(int fd, iovec *vectors, int count);
+
+// Reads exactly 'size' bytes, 1 when the peer closed before the first one, -1 on error
+int32_t pcscd_read(int fd, void *bytes, size_t size);
+
+// Writes a request and reads the structure sent back in place
+int32_t pcscd_call(int fd, uint32_t command, void *message, size_t message_size);
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_PCSCD_PROTOCOL_HPP
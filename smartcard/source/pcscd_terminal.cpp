@@ -0,0 +1,328 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/pcscd_terminal.hpp>
+#include <unistd.h>
+
+#include "pcscd_protocol.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+struct PcscdTerminalImpl {
+    int fd{-1};
+    uint32_t context{0};
+    int32_t card{0};
+    bool is_connected{false};
+    uint32_t active_protocol{pcscd_protocol_t1};
+    uint32_t share_mode{pcscd_share_shared};
+    char reader[k_pcscd_max_reader_name]{};
+    uint32_t last_error{0};
+
+    // Preallocated, the table being the largest message
+    PcscdReaderState states[k_pcscd_max_readers];
+};
+
+namespace {
+
+void impl_close_socket(PcscdTerminalImpl *impl) {
+    if (impl->fd >= 0) {
+        close(impl->fd);
+        impl->fd = -1;
+    }
+    impl->is_connected = false;
+}
+
+// Call whose failure to reach the daemon loses the sync with it
+int32_t impl_call(PcscdTerminalImpl *impl, uint32_t command, void *message, size_t message_size) {
+    if (impl->fd < 0) {
+        return -1;
+    }
+    if (pcscd_call(impl->fd, command, message, message_size) != 0) {
+        std::cerr << "ERROR - pcscd: connection to the daemon lost" << std::endl;
+        impl_close_socket(impl);
+        return -1;
+    }
+    return 0;
+}
+
+int32_t impl_check(PcscdTerminalImpl *impl, const char *what, uint32_t rv) {
+    if (rv != pcscd_success) {
+        std::cerr << "ERROR - pcscd: " << what << " 0x" << std::hex << rv << std::dec << std::endl;
+        impl->last_error = rv;
+        return -1;
+    }
+    return 0;
+}
+
+int32_t impl_open(PcscdTerminalImpl *impl, const std::string &socket_path, int32_t protocol_minor) {
+    const char *path = socket_path.empty() ? pcscd_socket_path() : socket_path.c_str();
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        std::cerr << "ERROR - pcscd: socket path too long " << path << std::endl;
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    impl->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (impl->fd < 0) {
+        std::cerr << "ERROR - pcscd: socket " << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (connect(impl->fd, (const sockaddr *)&address, sizeof(address)) != 0) {
+        std::cerr << "ERROR - pcscd: cannot connect to " << path << " " << strerror(errno) << std::endl;
+        impl_close_socket(impl);
+        return -1;
+    }
+#ifdef SO_NOSIGPIPE
+    int enabled = 1;
+    setsockopt(impl->fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+
+    PcscdVersion version = {k_pcscd_protocol_major, protocol_minor, pcscd_success};
+    if (impl_call(impl, pcscd_command_version, &version, sizeof(version)) != 0) {
+        return -1;
+    }
+    if (version.rv != pcscd_success) {
+        std::cerr << "ERROR - pcscd: protocol " << k_pcscd_protocol_major << "." << protocol_minor
+                  << " refused by the daemon speaking " << version.major << "." << version.minor << std::endl;
+        impl->last_error = version.rv;
+        impl_close_socket(impl);
+        return -1;
+    }
+
+    PcscdEstablish establish = {0, 0, pcscd_success};
+    if (impl_call(impl, pcscd_command_establish_context, &establish, sizeof(establish)) != 0) {
+        return -1;
+    }
+    if (impl_check(impl, "establish context", establish.rv) != 0) {
+        impl_close_socket(impl);
+        return -1;
+    }
+    impl->context = establish.context;
+    return 0;
+}
+
+void impl_release(PcscdTerminalImpl *impl) {
+    if (impl->fd < 0) {
+        return;
+    }
+    PcscdRelease release = {impl->context, pcscd_success};
+    impl_call(impl, pcscd_command_release_context, &release, sizeof(release));
+    impl_close_socket(impl);
+}
+
+int32_t impl_get_reader_states(PcscdTerminalImpl *impl) {
+    if (impl->fd < 0) {
+        return -1;
+    }
+    PcscdHeader header = {0, pcscd_command_get_readers_state};
+    iovec vector = {&header, sizeof(header)};
+    if (pcscd_write(impl->fd, &vector, 1) != 0 || pcscd_read(impl->fd, impl->states, sizeof(impl->states)) != 0) {
+        std::cerr << "ERROR - pcscd: connection to the daemon lost" << std::endl;
+        impl_close_socket(impl);
+        return -1;
+    }
+    return 0;
+}
+
+PcscdReaderState *impl_find_reader_state(PcscdTerminalImpl *impl) {
+    if (impl_get_reader_states(impl) != 0) {
+        return nullptr;
+    }
+    for (auto &state : impl->states) {
+        if (strncmp(state.name, impl->reader, k_pcscd_max_reader_name) == 0) {
+            return &state;
+        }
+    }
+    std::cerr << "ERROR - pcscd: reader " << impl->reader << " gone" << std::endl;
+    return nullptr;
+}
+
+uint32_t impl_to_disposition(CardConnection::ResetType reset_type) {
+    switch (reset_type) {
+    case CardConnection::reset_type_warm:
+        return pcscd_reset_card;
+    case CardConnection::reset_type_cold:
+        return pcscd_unpower_card;
+    default:
+        return pcscd_leave_card;
+    }
+}
+
+} // namespace
+
+PcscdTerminal::PcscdTerminal() {
+    m_impl = (PcscdTerminalImpl *)TSG_ALLOC(sizeof(PcscdTerminalImpl));
+    tsg::Memory::construct_at(m_impl);
+}
+
+PcscdTerminal::~PcscdTerminal() {
+    close();
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(PcscdTerminalImpl));
+}
+
+int32_t PcscdTerminal::open(const std::string &reader_name, const PcscdTerminalConfig &config) {
+    close();
+    if (reader_name.size() >= k_pcscd_max_reader_name) {
+        std::cerr << "ERROR - pcscd: reader name too long " << reader_name << std::endl;
+        return -1;
+    }
+    memset(m_impl->reader, 0, sizeof(m_impl->reader));
+    memcpy(m_impl->reader, reader_name.c_str(), reader_name.size());
+    m_impl->share_mode =
+        config.share_mode == CardConnection::share_mode_exclusive ? pcscd_share_exclusive : pcscd_share_shared;
+    m_impl->last_error = 0;
+    return impl_open(m_impl, config.socket_path, config.protocol_minor);
+}
+
+void PcscdTerminal::close() {
+    power_off();
+    impl_release(m_impl);
+}
+
+bool PcscdTerminal::is_open() const { return m_impl->fd >= 0; }
+
+int32_t PcscdTerminal::list_readers(const std::string &socket_path, std::vector<std::string> &names) {
+    names.clear();
+
+    PcscdTerminal terminal;
+    PcscdTerminalImpl *impl = terminal.m_impl;
+    if (impl_open(impl, socket_path, k_pcscd_protocol_minor) != 0 || impl_get_reader_states(impl) != 0) {
+        return -1;
+    }
+    for (auto &state : impl->states) {
+        if (state.name[0] != 0) {
+            names.emplace_back(state.name, strnlen(state.name, k_pcscd_max_reader_name));
+        }
+    }
+    return 0;
+}
+
+uint32_t PcscdTerminal::get_last_error() const { return m_impl->last_error; }
+
+int32_t PcscdTerminal::begin_transaction() {
+    PcscdCard message = {m_impl->card, pcscd_success};
+    if (!m_impl->is_connected || impl_call(m_impl, pcscd_command_begin_transaction, &message, sizeof(message)) != 0) {
+        return -1;
+    }
+    return impl_check(m_impl, "begin transaction", message.rv);
+}
+
+int32_t PcscdTerminal::end_transaction(CardConnection::ResetType reset_type) {
+    PcscdCardDisposition message = {m_impl->card, impl_to_disposition(reset_type), pcscd_success};
+    if (!m_impl->is_connected || impl_call(m_impl, pcscd_command_end_transaction, &message, sizeof(message)) != 0) {
+        return -1;
+    }
+    return impl_check(m_impl, "end transaction", message.rv);
+}
+
+bool PcscdTerminal::is_card_present() {
+    PcscdReaderState *state = impl_find_reader_state(m_impl);
+    return state != nullptr && (state->state & pcscd_state_present) != 0;
+}
+
+int32_t PcscdTerminal::power_on(CardConnection::ResetType reset_type, ATR &atr,
+                                CardConnection::CommunicationProtocol &protocol) {
+    if (m_impl->fd < 0) {
+        return -1;
+    }
+
+    uint32_t active_protocol = 0;
+    if (!m_impl->is_connected) {
+        PcscdConnect message = {};
+        message.context = m_impl->context;
+        memcpy(message.reader, m_impl->reader, sizeof(message.reader));
+        message.share_mode = m_impl->share_mode;
+        message.preferred_protocols = pcscd_protocol_t0 | pcscd_protocol_t1;
+        if (impl_call(m_impl, pcscd_command_connect, &message, sizeof(message)) != 0 ||
+            impl_check(m_impl, "connect", message.rv) != 0) {
+            return -1;
+        }
+        m_impl->card = message.card;
+        m_impl->is_connected = true;
+        active_protocol = message.active_protocol;
+    } else {
+        PcscdReconnect message = {};
+        message.card = m_impl->card;
+        message.share_mode = m_impl->share_mode;
+        message.preferred_protocols = pcscd_protocol_t0 | pcscd_protocol_t1;
+        message.initialization = impl_to_disposition(reset_type);
+        if (impl_call(m_impl, pcscd_command_reconnect, &message, sizeof(message)) != 0 ||
+            impl_check(m_impl, "reconnect", message.rv) != 0) {
+            return -1;
+        }
+        active_protocol = message.active_protocol;
+    }
+
+    m_impl->active_protocol = active_protocol;
+
+    // The ATR is published in the readers state rather than returned by the connection
+    PcscdReaderState *state = impl_find_reader_state(m_impl);
+    if (state == nullptr || state->atr_size > k_pcscd_max_atr_size || state->atr_size > ATR().capacity()) {
+        return -1;
+    }
+    atr = ATR(state->atr, state->atr_size);
+    protocol = active_protocol == pcscd_protocol_t0 ? CardConnection::com_protocol_t_0
+                                                    : CardConnection::com_protocol_t_1;
+    return 0;
+}
+
+int32_t PcscdTerminal::power_off() {
+    if (!m_impl->is_connected) {
+        return 0;
+    }
+    m_impl->is_connected = false;
+
+    PcscdCardDisposition message = {m_impl->card, pcscd_leave_card, pcscd_success};
+    if (impl_call(m_impl, pcscd_command_disconnect, &message, sizeof(message)) != 0) {
+        return -1;
+    }
+    return impl_check(m_impl, "disconnect", message.rv);
+}
+
+int32_t PcscdTerminal::transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) {
+    size_t capacity = response_size;
+    response_size = 0;
+    if (!m_impl->is_connected || m_impl->fd < 0 || capdu_size > k_pcscd_max_buffer_size_extended) {
+        return -1;
+    }
+    if (capacity > k_pcscd_max_buffer_size_extended) {
+        capacity = k_pcscd_max_buffer_size_extended;
+    }
+
+    // Command and response go through the socket without an intermediate buffer
+    PcscdHeader header = {sizeof(PcscdTransmit), pcscd_command_transmit};
+    PcscdTransmit message = {};
+    message.card = m_impl->card;
+    message.send_pci_protocol = m_impl->active_protocol;
+    message.send_pci_length = 8;
+    message.send_length = (uint32_t)capdu_size;
+    message.receive_pci_protocol = m_impl->active_protocol;
+    message.receive_pci_length = 8;
+    message.receive_length = (uint32_t)capacity;
+    iovec vectors[3] = {{&header, sizeof(header)}, {&message, sizeof(message)}, {(void *)capdu, capdu_size}};
+    if (pcscd_write(m_impl->fd, vectors, 3) != 0 || pcscd_read(m_impl->fd, &message, sizeof(message)) != 0) {
+        std::cerr << "ERROR - pcscd: connection to the daemon lost" << std::endl;
+        impl_close_socket(m_impl);
+        return -1;
+    }
+    if (impl_check(m_impl, "transmit", message.rv) != 0) {
+        return -1;
+    }
+    if (message.receive_length > capacity || pcscd_read(m_impl->fd, response, message.receive_length) != 0) {
+        std::cerr << "ERROR - pcscd: invalid transmit response" << std::endl;
+        impl_close_socket(m_impl);
+        return -1;
+    }
+    response_size = message.receive_length;
+    return 0;
+}
+
+} // namespace smartcard
+} // namespace tsg
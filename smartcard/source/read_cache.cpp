@@ -0,0 +1,155 @@
+#include <cstring>
+#include <tsg/smartcard/apdu_builder.hpp>
+#include <tsg/smartcard/read_cache.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+void ReadCache::set_enabled(bool enabled) {
+    if (!enabled) {
+        m_entries.clear();
+    }
+    m_enabled = enabled;
+}
+
+bool ReadCache::lookup(const SelectionTracker &selection, const uint8_t *capdu, size_t capdu_size,
+                       ResponseAPDU &rapdu) {
+    if (!m_enabled || !is_cacheable_command(capdu, capdu_size)) {
+        return false;
+    }
+
+    if (!selection.is_known()) {
+        m_statistics.misses++;
+        return false;
+    }
+
+    key_of(selection, capdu, capdu_size);
+    auto it = m_entries.find(m_key);
+    if (it == m_entries.end()) {
+        m_statistics.misses++;
+        return false;
+    }
+
+    m_statistics.hits++;
+    rapdu = it->second;
+    if (SelectionTracker::short_ef_identifier_of(capdu, capdu_size) != 0) {
+        m_pending_selection.assign((const char *)capdu, capdu_size);
+    }
+    return true;
+}
+
+void ReadCache::observe(const SelectionTracker &selection, const uint8_t *capdu, size_t capdu_size,
+                        const ResponseAPDU &rapdu) {
+    if (!m_enabled) {
+        return;
+    }
+
+    if (rapdu.size() < 2 || is_write_command(capdu, capdu_size)) {
+        invalidate();
+        return;
+    }
+
+    if (!selection.is_known() || !is_cacheable_command(capdu, capdu_size) || m_entries.size() >= k_max_entries) {
+        return;
+    }
+
+    if (!rapdu.sw_is(StatusWord::normal_processing, 0x00)) {
+        return;
+    }
+
+    key_of(selection, capdu, capdu_size);
+    m_entries[m_key] = rapdu;
+    m_statistics.stores++;
+}
+
+void ReadCache::invalidate() {
+    m_pending_selection.clear();
+    if (!m_entries.empty()) {
+        m_entries.clear();
+        m_statistics.invalidations++;
+    }
+}
+
+bool ReadCache::take_pending_selection(const uint8_t *capdu, size_t capdu_size, uint8_t *pending,
+                                       size_t &pending_size) {
+    if (m_pending_selection.empty() || capdu_size < 4 || SelectionTracker::logical_channel_of(capdu[0]) != 0) {
+        return false;
+    }
+
+    if (capdu[1] == apdu::ins_select || SelectionTracker::short_ef_identifier_of(capdu, capdu_size) != 0) {
+        m_pending_selection.clear(); // the command sets the current EF itself
+        return false;
+    }
+
+    if (!SelectionTracker::references_current_ef(capdu, capdu_size) || m_pending_selection.size() > pending_size) {
+        return false;
+    }
+
+    memcpy(pending, m_pending_selection.data(), m_pending_selection.size());
+    pending_size = m_pending_selection.size();
+    m_pending_selection.clear();
+    return true;
+}
+
+bool ReadCache::is_cacheable_command(const uint8_t *capdu, size_t capdu_size) {
+    if (capdu_size < 4) {
+        return false;
+    }
+
+    uint8_t cla = capdu[0];
+    if (SelectionTracker::logical_channel_of(cla) != 0 || ((cla & 0x40) == 0 && (cla & 0x0C) != 0)) {
+        return false; // other logical channel or secure messaging
+    }
+
+    switch (capdu[1]) {
+    case apdu::ins_read_binary:
+    case apdu::ins_read_binary_odd:
+    case apdu::ins_read_record:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool ReadCache::is_write_command(const uint8_t *capdu, size_t capdu_size) {
+    if (capdu_size < 4) {
+        return false;
+    }
+
+    switch (capdu[1]) {
+    case 0x04: // DEACTIVATE FILE
+    case 0x0C: // ERASE RECORD
+    case 0x0E: // ERASE BINARY
+    case 0x0F:
+    case 0x44: // ACTIVATE FILE
+    case 0xD0: // WRITE BINARY
+    case 0xD1:
+    case 0xD2: // WRITE RECORD
+    case 0xD6: // UPDATE BINARY
+    case 0xD7:
+    case 0xDA: // PUT DATA
+    case 0xDB:
+    case 0xDC: // UPDATE RECORD
+    case 0xDD:
+    case 0xE0: // CREATE FILE
+    case 0xE2: // APPEND RECORD
+    case 0xE4: // DELETE FILE
+    case 0xE6: // TERMINATE DF
+    case 0xE8: // TERMINATE EF
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ReadCache::key_of(const SelectionTracker &selection, const uint8_t *capdu, size_t capdu_size) {
+    // Commands referencing a short EF identifier do not depend on the current EF
+    size_t path_size = (SelectionTracker::short_ef_identifier_of(capdu, capdu_size) != 0) ? selection.df_path_size()
+                                                                                          : selection.path_size();
+    m_key.assign(1, (char)path_size);
+    m_key.append((const char *)selection.path(), path_size);
+    m_key.append((const char *)capdu, capdu_size);
+}
+
+} // namespace smartcard
+} // namespace tsg
@@ -0,0 +1,466 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/reader_server.hpp>
+#include <tsg/smartcard/smartcard_provider.hpp>
+#include <unistd.h>
+#include <vector>
+
+#include "remote_channel.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+// Largest response of a single command, data and status word
+constexpr size_t k_max_response_size = k_max_extended_ne + 2;
+
+// Responses to pipelined requests are held back while more requests are buffered, up to this size
+constexpr size_t k_max_pending_output = 256 * 1024;
+
+} // namespace
+
+struct ServerSession {
+    RemoteChannel channel;
+    std::thread thread;
+    CardConnection connection;
+    std::string reader;
+    std::atomic<bool> finished{false};
+};
+
+struct ReaderServerImpl {
+    SmartCardProvider *provider{nullptr};
+
+    std::string socket_path;
+    int listen_fd{-1};
+
+    // Written to by stop() to wake the accept thread up
+    int wake_fds[2]{-1, -1};
+
+    std::atomic<bool> running{false};
+    std::thread accept_thread;
+
+    // Guards the provider, the sessions list and the readers attached
+    std::mutex mutex;
+    std::list<ServerSession> sessions;
+
+    std::atomic<uint64_t> sessions_count{0};
+    std::atomic<uint64_t> shared_memory_sessions{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> transmits{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> flushes{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+namespace {
+
+uint8_t *impl_begin_response(ServerSession *session, uint8_t type, uint32_t sequence, size_t max_payload_size) {
+    return session->channel.begin_frame(type | k_remote_response_flag, sequence, 1 + max_payload_size);
+}
+
+int32_t impl_send_status(ServerSession *session, uint8_t type, uint32_t sequence, RemoteStatus status) {
+    uint8_t payload = status;
+    session->channel.append_frame(type | k_remote_response_flag, sequence, &payload, 1);
+    return status == remote_status_ok ? 0 : -1;
+}
+
+int32_t impl_list_readers(ReaderServerImpl *impl, ServerSession *session, uint32_t sequence) {
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->provider->get_terminal_names(names);
+    }
+
+    size_t size = 1;
+    for (auto &name : names) {
+        size += name.size() + 1;
+    }
+    uint8_t *payload = impl_begin_response(session, remote_message_list_readers, sequence, size);
+    size_t offset = 0;
+    payload[offset++] = remote_status_ok;
+    for (auto &name : names) {
+        memcpy(&payload[offset], name.c_str(), name.size() + 1);
+        offset += name.size() + 1;
+    }
+    payload[offset++] = 0;
+    session->channel.end_frame(offset);
+    return 0;
+}
+
+int32_t impl_attach(ReaderServerImpl *impl, ServerSession *session, uint32_t sequence, const uint8_t *payload,
+                    size_t payload_size) {
+    std::string name((const char *)payload, payload_size);
+    if (session->connection.is_valid()) {
+        std::cerr << "ERROR - server: session already attached to " << session->reader << std::endl;
+        return impl_send_status(session, remote_message_attach, sequence, remote_status_error);
+    }
+
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    for (auto &other : impl->sessions) {
+        if (&other != session && other.reader == name) {
+            std::cerr << "ERROR - server: " << name << " is attached to another session" << std::endl;
+            return impl_send_status(session, remote_message_attach, sequence, remote_status_error);
+        }
+    }
+
+    CardConnection connection = impl->provider->create_card_connection(name);
+    if (!connection.is_valid()) {
+        std::cerr << "ERROR - server: unknown reader " << name << std::endl;
+        return impl_send_status(session, remote_message_attach, sequence, remote_status_error);
+    }
+    // Traced by the client's own connection
+    connection.set_apdu_trace_enabled(false);
+    session->connection = connection;
+    session->reader = name;
+    return impl_send_status(session, remote_message_attach, sequence, remote_status_ok);
+}
+
+int32_t impl_open_shared_memory(ReaderServerImpl *impl, ServerSession *session, uint32_t sequence) {
+    int descriptor = session->channel.take_descriptor();
+    if (descriptor < 0) {
+        std::cerr << "ERROR - server: shared memory requested without its descriptor" << std::endl;
+        return impl_send_status(session, remote_message_open_shared_memory, sequence, remote_status_error);
+    }
+    int32_t result = session->channel.open_shared_memory(descriptor);
+    close(descriptor);
+    if (result != 0) {
+        return impl_send_status(session, remote_message_open_shared_memory, sequence, remote_status_error);
+    }
+
+    // The response still goes through the socket, the client switching once it reads it
+    impl_send_status(session, remote_message_open_shared_memory, sequence, remote_status_ok);
+    if (session->channel.flush() != 0) {
+        return -1;
+    }
+    session->channel.start_shared_memory();
+    impl->shared_memory_sessions++;
+    return 0;
+}
+
+int32_t impl_power_on(ServerSession *session, uint32_t sequence, const uint8_t *payload, size_t payload_size) {
+    CardConnection &connection = session->connection;
+    uint8_t reset_byte = payload_size > 0 ? payload[0] : 0;
+    if (reset_byte > CardConnection::reset_type_cold) {
+        std::cerr << "ERROR - server: unknown reset type " << (uint32_t)reset_byte << std::endl;
+        return impl_send_status(session, remote_message_power_on, sequence, remote_status_error);
+    }
+    auto reset_type = (CardConnection::ResetType)reset_byte;
+    int32_t result = connection.is_connected() ? connection.reconnect(reset_type) : connection.connect();
+    if (result != 0) {
+        return impl_send_status(session, remote_message_power_on, sequence, remote_status_error);
+    }
+
+    ATR atr = connection.get_atr();
+    uint8_t *response = impl_begin_response(session, remote_message_power_on, sequence, 1 + atr.size());
+    response[0] = remote_status_ok;
+    response[1] = (uint8_t)connection.get_communication_protocol();
+    memcpy(&response[2], atr.data(), atr.size());
+    session->channel.end_frame(2 + atr.size());
+    return 0;
+}
+
+int32_t impl_transmit(ReaderServerImpl *impl, ServerSession *session, uint32_t sequence, const uint8_t *capdu,
+                      size_t capdu_size) {
+    uint8_t *response = impl_begin_response(session, remote_message_transmit, sequence, k_max_response_size);
+    size_t response_size = k_max_response_size;
+    impl->transmits++;
+    if (session->connection.transmit(capdu, capdu_size, response + 1, response_size) != 0) {
+        response[0] = remote_status_error;
+        session->channel.end_frame(1);
+        return -1;
+    }
+    response[0] = remote_status_ok;
+    session->channel.end_frame(1 + response_size);
+    return 0;
+}
+
+int32_t impl_transmit_batch(ReaderServerImpl *impl, ServerSession *session, uint32_t sequence,
+                            const uint8_t *payload, size_t payload_size) {
+    if (payload_size < 2) {
+        return impl_send_status(session, remote_message_transmit_batch, sequence, remote_status_error);
+    }
+    uint16_t count = remote_load_u16(payload);
+    impl->batches++;
+
+    size_t capacity = k_remote_max_payload_size - 1;
+    uint8_t *response = impl_begin_response(session, remote_message_transmit_batch, sequence, capacity);
+    size_t response_offset = 3;
+    size_t offset = 2;
+    uint16_t completed = 0;
+    for (; completed < count; completed++) {
+        if (offset + 4 > payload_size || offset + 4 + remote_load_u32(&payload[offset]) > payload_size) {
+            break;
+        }
+        size_t capdu_size = remote_load_u32(&payload[offset]);
+        const uint8_t *capdu = &payload[offset + 4];
+        offset += 4 + capdu_size;
+
+        if (response_offset + 4 + 2 > 1 + capacity) {
+            break;
+        }
+        size_t response_size = 1 + capacity - response_offset - 4;
+        if (response_size > k_max_response_size) {
+            response_size = k_max_response_size;
+        }
+        impl->transmits++;
+        if (session->connection.transmit(capdu, capdu_size, &response[response_offset + 4], response_size) != 0) {
+            break;
+        }
+        remote_store_u32(&response[response_offset], (uint32_t)response_size);
+        response_offset += 4 + response_size;
+    }
+
+    response[0] = (completed == count) ? remote_status_ok : remote_status_error;
+    remote_store_u16(&response[1], completed);
+    session->channel.end_frame(response_offset);
+    return completed == count ? 0 : -1;
+}
+
+int32_t impl_handle_request(ReaderServerImpl *impl, ServerSession *session, uint8_t type, uint32_t sequence,
+                            const uint8_t *payload, size_t payload_size) {
+    if (type == remote_message_list_readers) {
+        return impl_list_readers(impl, session, sequence);
+    }
+    if (type == remote_message_attach) {
+        return impl_attach(impl, session, sequence, payload, payload_size);
+    }
+    if (type == remote_message_open_shared_memory && !session->channel.is_shared_memory_started()) {
+        return impl_open_shared_memory(impl, session, sequence);
+    }
+    if (!session->connection.is_valid()) {
+        std::cerr << "ERROR - server: request " << (int)type << " before attaching a reader" << std::endl;
+        return impl_send_status(session, type, sequence, remote_status_error);
+    }
+
+    switch (type) {
+    case remote_message_card_present: {
+        uint8_t response[2] = {remote_status_ok, 0};
+        response[1] = session->connection.wait_card_presence(true, 0) == 0 ? 1 : 0;
+        session->channel.append_frame(type | k_remote_response_flag, sequence, response, sizeof(response));
+        return 0;
+    }
+
+    case remote_message_power_on:
+        return impl_power_on(session, sequence, payload, payload_size);
+
+    case remote_message_power_off: {
+        int32_t result = session->connection.is_connected() ? session->connection.disconnect() : 0;
+        return impl_send_status(session, type, sequence, result == 0 ? remote_status_ok : remote_status_error);
+    }
+
+    case remote_message_transmit:
+        return impl_transmit(impl, session, sequence, payload, payload_size);
+
+    case remote_message_transmit_batch:
+        return impl_transmit_batch(impl, session, sequence, payload, payload_size);
+
+    default:
+        std::cerr << "ERROR - server: unknown request " << (int)type << std::endl;
+        return impl_send_status(session, type, sequence, remote_status_error);
+    }
+}
+
+void impl_serve_session(ReaderServerImpl *impl, ServerSession *session) {
+    while (true) {
+        uint8_t type = 0;
+        uint32_t sequence = 0;
+        const uint8_t *payload = nullptr;
+        size_t payload_size = 0;
+        if (session->channel.read_frame(type, sequence, payload, payload_size) != 0) {
+            break;
+        }
+
+        impl->requests++;
+        if (impl_handle_request(impl, session, type, sequence, payload, payload_size) != 0) {
+            impl->errors++;
+        }
+
+        // Pipelined requests already received are handled before answering them all at once
+        if (session->channel.get_pending_output() < k_max_pending_output && session->channel.has_input()) {
+            continue;
+        }
+        impl->flushes++;
+        if (session->channel.flush() != 0) {
+            break;
+        }
+    }
+
+    if (session->connection.is_valid()) {
+        if (session->connection.is_connected()) {
+            session->connection.disconnect();
+        }
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->provider->destroy_card_connection(session->connection);
+        session->reader.clear();
+    }
+    session->finished = true;
+}
+
+void impl_reap_sessions(ReaderServerImpl *impl) {
+    for (auto it = impl->sessions.begin(); it != impl->sessions.end();) {
+        if (it->finished) {
+            it->thread.join();
+            it = impl->sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void impl_accept(ReaderServerImpl *impl) {
+    pollfd descriptors[2] = {};
+    descriptors[0].fd = impl->listen_fd;
+    descriptors[0].events = POLLIN;
+    descriptors[1].fd = impl->wake_fds[0];
+    descriptors[1].events = POLLIN;
+
+    while (impl->running) {
+        if (poll(descriptors, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "ERROR - server: poll " << strerror(errno) << std::endl;
+            break;
+        }
+        if (descriptors[1].revents != 0) {
+            break;
+        }
+        if ((descriptors[0].revents & POLLIN) == 0) {
+            continue;
+        }
+
+        int fd = accept(impl->listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                std::cerr << "ERROR - server: accept " << strerror(errno) << std::endl;
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl_reap_sessions(impl);
+        impl->sessions.emplace_back();
+        ServerSession *session = &impl->sessions.back();
+        session->channel.attach(fd);
+        session->thread = std::thread(impl_serve_session, impl, session);
+        impl->sessions_count++;
+    }
+}
+
+void impl_close_fds(ReaderServerImpl *impl) {
+    for (int *fd : {&impl->listen_fd, &impl->wake_fds[0], &impl->wake_fds[1]}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+} // namespace
+
+ReaderServer::ReaderServer(SmartCardProvider &provider) {
+    m_impl = (ReaderServerImpl *)TSG_ALLOC(sizeof(ReaderServerImpl));
+    tsg::Memory::construct_at(m_impl);
+    m_impl->provider = &provider;
+}
+
+ReaderServer::~ReaderServer() {
+    stop();
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(ReaderServerImpl));
+}
+
+int32_t ReaderServer::start(const char *socket_path) {
+    if (m_impl->running) {
+        std::cerr << "ERROR - server: already listening on " << m_impl->socket_path << std::endl;
+        return -1;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        std::cerr << "ERROR - server: socket path too long " << socket_path << std::endl;
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    if (pipe(m_impl->wake_fds) != 0) {
+        std::cerr << "ERROR - server: pipe " << strerror(errno) << std::endl;
+        return -1;
+    }
+    m_impl->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_impl->listen_fd < 0) {
+        std::cerr << "ERROR - server: socket " << strerror(errno) << std::endl;
+        impl_close_fds(m_impl);
+        return -1;
+    }
+
+    unlink(socket_path);
+    if (bind(m_impl->listen_fd, (const sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(m_impl->listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "ERROR - server: cannot listen on " << socket_path << " " << strerror(errno) << std::endl;
+        impl_close_fds(m_impl);
+        return -1;
+    }
+
+    m_impl->socket_path = socket_path;
+    m_impl->running = true;
+    m_impl->accept_thread = std::thread(impl_accept, m_impl);
+    return 0;
+}
+
+void ReaderServer::stop() {
+    if (!m_impl->running) {
+        return;
+    }
+    m_impl->running = false;
+
+    uint8_t wake = 1;
+    if (write(m_impl->wake_fds[1], &wake, 1) != 1) {
+        std::cerr << "ERROR - server: cannot wake the accept thread " << strerror(errno) << std::endl;
+    }
+    m_impl->accept_thread.join();
+
+    // No session is added anymore, the list stays in place while the sessions end
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        for (auto &session : m_impl->sessions) {
+            session.channel.shutdown();
+        }
+    }
+    for (auto &session : m_impl->sessions) {
+        session.thread.join();
+    }
+    m_impl->sessions.clear();
+
+    impl_close_fds(m_impl);
+    unlink(m_impl->socket_path.c_str());
+}
+
+bool ReaderServer::is_running() const { return m_impl->running; }
+
+ReaderServerStatistics ReaderServer::get_statistics() const {
+    ReaderServerStatistics statistics;
+    statistics.sessions = m_impl->sessions_count;
+    statistics.shared_memory_sessions = m_impl->shared_memory_sessions;
+    statistics.requests = m_impl->requests;
+    statistics.transmits = m_impl->transmits;
+    statistics.batches = m_impl->batches;
+    statistics.flushes = m_impl->flushes;
+    statistics.errors = m_impl->errors;
+    return statistics;
+}
+
+} // namespace smartcard
+} // namespace tsg
@@ -0,0 +1,109 @@
+#include <WinSCard.h>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <thread>
+#include <tsg/smartcard/apdu_builder.hpp>
+#include <tsg/smartcard/recovery_policy.hpp>
+#include <tsg/smartcard/selection_tracker.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+// Seeded per thread, so that threads failing together draw different backoffs
+std::minstd_rand &impl_thread_generator() {
+    thread_local std::minstd_rand generator(
+        (uint32_t)(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                   (size_t)std::chrono::steady_clock::now().time_since_epoch().count()));
+    return generator;
+}
+
+} // namespace
+
+RecoveryAction classify_pcsc_error(uint32_t error) {
+    switch ((LONG)error) {
+    case SCARD_S_SUCCESS:
+        return recovery_action_none;
+
+    case SCARD_E_SHARING_VIOLATION:
+    case SCARD_E_NOT_READY:
+        return recovery_action_retry;
+
+    case SCARD_E_TIMEOUT:
+    case SCARD_E_COMM_DATA_LOST:
+    case SCARD_F_COMM_ERROR:
+    case SCARD_E_NOT_TRANSACTED:
+        return recovery_action_retry_replayable;
+
+    case SCARD_W_RESET_CARD:
+        return recovery_action_reconnect;
+
+    case SCARD_W_UNPOWERED_CARD:
+    case SCARD_W_UNRESPONSIVE_CARD:
+        return recovery_action_reconnect_reset;
+
+    case SCARD_E_INVALID_HANDLE:
+    case SCARD_E_NO_SERVICE:
+    case SCARD_E_SERVICE_STOPPED:
+        return recovery_action_connect;
+
+    default:
+        return recovery_action_fail;
+    }
+}
+
+ReplayKind replay_kind_of(const uint8_t *capdu, size_t capdu_size) {
+    // Secure messaging and chaining bind a command to the ones around it, other logical channels are
+    // closed by a reset
+    if (capdu_size < 4 || (capdu[0] & 0x80) != 0 || (capdu[0] & 0x1C) != 0 ||
+        SelectionTracker::logical_channel_of(capdu[0]) != 0) {
+        return replay_kind_none;
+    }
+
+    switch (capdu[1]) {
+    case apdu::ins_select: {
+        uint8_t p1 = capdu[2];
+        bool selects_mf = p1 == apdu::select_p1_file_id && capdu_size >= 7 && capdu[4] == 2 && capdu[5] == 0x3F &&
+                          capdu[6] == 0x00;
+        if (p1 == apdu::select_p1_df_name || p1 == apdu::select_p1_path_from_mf || selects_mf) {
+            return replay_kind_direct;
+        }
+        return replay_kind_none;
+    }
+
+    case apdu::ins_read_binary:
+    case apdu::ins_read_record:
+        return SelectionTracker::short_ef_identifier_of(capdu, capdu_size) != 0 ? replay_kind_in_current_df
+                                                                                : replay_kind_none;
+
+    case apdu::ins_get_data:
+    case 0xCB: // GET DATA, odd instruction
+        return replay_kind_in_current_df;
+
+    default:
+        return replay_kind_none;
+    }
+}
+
+uint32_t compute_backoff_ms(const RecoveryPolicy &policy, uint32_t attempt) {
+    uint64_t backoff = policy.initial_backoff_ms;
+    for (uint32_t index = 0; index < attempt && backoff < policy.max_backoff_ms; index++) {
+        backoff *= 2;
+    }
+    if (backoff > policy.max_backoff_ms) {
+        backoff = policy.max_backoff_ms;
+    }
+
+    uint32_t jitter_percent = policy.jitter_percent > 100 ? 100 : policy.jitter_percent;
+    uint64_t jitter = backoff * jitter_percent / 100;
+    if (jitter == 0) {
+        return (uint32_t)backoff;
+    }
+    std::uniform_int_distribution<uint64_t> distribution(0, jitter);
+    return (uint32_t)(backoff - distribution(impl_thread_generator()));
+}
+
+} // namespace smartcard
+} // namespace tsg
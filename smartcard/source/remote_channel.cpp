@@ -0,0 +1,563 @@
+#include "remote_channel.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+constexpr int k_send_flags = MSG_NOSIGNAL; // a peer gone is reported as EPIPE, not SIGPIPE
+#else
+constexpr int k_send_flags = 0;
+#endif
+
+constexpr size_t k_min_input_capacity = 64 * 1024;
+
+constexpr uint32_t k_shared_memory_magic = 0x54534752; // "TSGR"
+constexpr uint32_t k_min_ring_capacity = 4 * 1024;
+constexpr uint32_t k_max_ring_capacity = 64 * 1024 * 1024;
+
+// Polls of a ring before sleeping on it, a response to a command on a virtual reader usually being
+// there within them. Spinning only delays the peer on a single processor.
+constexpr int k_ring_spin_count = 4000;
+
+int impl_ring_spin_count() {
+    static const int spin_count = std::thread::hardware_concurrency() > 1 ? k_ring_spin_count : 0;
+    return spin_count;
+}
+
+// Sleeps on a ring are bounded so that the socket of a peer gone is noticed
+constexpr long k_ring_wait_timeout_ms = 50;
+
+void impl_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+#ifdef __linux__
+// Shared futexes, the rings being mapped in two processes
+void impl_futex_wait(std::atomic<uint32_t> *word, uint32_t value) {
+    timespec timeout = {};
+    timeout.tv_nsec = k_ring_wait_timeout_ms * 1000000;
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, value, &timeout, nullptr, 0);
+}
+
+void impl_futex_wake(std::atomic<uint32_t> *word) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#endif
+
+size_t impl_shared_memory_size(uint32_t ring_capacity) {
+    return sizeof(SharedMemoryHeader) + 2 * (size_t)ring_capacity;
+}
+
+uint8_t *impl_ring_data(SharedMemoryHeader *shared, uint32_t ring_capacity, int ring) {
+    return (uint8_t *)shared + sizeof(SharedMemoryHeader) + (size_t)ring * ring_capacity;
+}
+
+} // namespace
+
+void RemoteChannel::attach(int fd) {
+    close();
+    m_fd = fd;
+#ifdef SO_NOSIGPIPE
+    int enabled = 1;
+    setsockopt(m_fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+}
+
+int32_t RemoteChannel::connect(const char *path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        std::cerr << "ERROR - remote: socket path too long " << path << std::endl;
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "ERROR - remote: socket " << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (::connect(fd, (const sockaddr *)&address, sizeof(address)) != 0) {
+        std::cerr << "ERROR - remote: cannot connect to " << path << " " << strerror(errno) << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    attach(fd);
+    return 0;
+}
+
+void RemoteChannel::close() {
+    unmap_shared_memory();
+    if (m_received_descriptor >= 0) {
+        ::close(m_received_descriptor);
+        m_received_descriptor = -1;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_output_size = 0;
+    m_input_offset = 0;
+    m_input_size = 0;
+}
+
+void RemoteChannel::shutdown() {
+    if (m_fd >= 0) {
+        ::shutdown(m_fd, SHUT_RDWR);
+    }
+}
+
+uint8_t *RemoteChannel::begin_frame(uint8_t type, uint32_t sequence, size_t max_payload_size) {
+    m_frame_offset = m_output_size;
+    size_t required = m_output_size + k_remote_header_size + max_payload_size;
+    if (m_output.size() < required) {
+        m_output.resize(required);
+    }
+
+    uint8_t *header = &m_output[m_frame_offset];
+    header[4] = type;
+    remote_store_u32(&header[5], sequence);
+    return header + k_remote_header_size;
+}
+
+void RemoteChannel::end_frame(size_t payload_size) {
+    remote_store_u32(&m_output[m_frame_offset], (uint32_t)payload_size);
+    m_output_size = m_frame_offset + k_remote_header_size + payload_size;
+}
+
+void RemoteChannel::append_frame(uint8_t type, uint32_t sequence, const uint8_t *payload, size_t payload_size) {
+    uint8_t *frame_payload = begin_frame(type, sequence, payload_size);
+    if (payload_size > 0) {
+        memcpy(frame_payload, payload, payload_size);
+    }
+    end_frame(payload_size);
+}
+
+int32_t RemoteChannel::flush() {
+    if (m_shared_started) {
+        int32_t result = ring_write(m_output.data(), m_output_size);
+        m_output_size = 0;
+        return result;
+    }
+
+    size_t sent = 0;
+    while (sent < m_output_size) {
+        ssize_t result = send(m_fd, &m_output[sent], m_output_size - sent, k_send_flags);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "ERROR - remote: send " << strerror(errno) << std::endl;
+            m_output_size = 0;
+            return -1;
+        }
+        sent += (size_t)result;
+    }
+    m_output_size = 0;
+    return 0;
+}
+
+int32_t RemoteChannel::fill(size_t size) {
+    if (m_input_size - m_input_offset >= size) {
+        return 0;
+    }
+
+    // Unconsumed bytes move to the front, the buffer only growing for frames larger than it
+    size_t buffered = m_input_size - m_input_offset;
+    if (m_input_offset > 0 && buffered > 0) {
+        memmove(&m_input[0], &m_input[m_input_offset], buffered);
+    }
+    m_input_offset = 0;
+    m_input_size = buffered;
+    if (m_input.size() < size || m_input.size() < k_min_input_capacity) {
+        m_input.resize(size > k_min_input_capacity ? size : k_min_input_capacity);
+    }
+
+    while (m_input_size < size) {
+        size_t received = 0;
+        if (receive(&m_input[m_input_size], m_input.size() - m_input_size, received) != 0) {
+            return -1;
+        }
+        if (received == 0) {
+            return m_input_size == 0 ? 1 : -1;
+        }
+        m_input_size += received;
+    }
+    return 0;
+}
+
+int32_t RemoteChannel::receive(uint8_t *bytes, size_t capacity, size_t &received) {
+    if (m_shared_started) {
+        return ring_read(bytes, capacity, received);
+    }
+
+    // A descriptor passed by the peer comes as ancillary data of the bytes sent with it
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))];
+    iovec vector = {bytes, capacity};
+    msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t result;
+    do {
+        result = recvmsg(m_fd, &message, 0);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        std::cerr << "ERROR - remote: recv " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            int descriptor = -1;
+            memcpy(&descriptor, CMSG_DATA(header), sizeof(descriptor));
+            if (m_received_descriptor >= 0) {
+                ::close(m_received_descriptor);
+            }
+            m_received_descriptor = descriptor;
+        }
+    }
+    received = (size_t)result;
+    return 0;
+}
+
+int32_t RemoteChannel::read_frame(uint8_t &type, uint32_t &sequence, const uint8_t *&payload, size_t &payload_size) {
+    if (m_fd < 0) {
+        return -1;
+    }
+
+    int32_t result = fill(k_remote_header_size);
+    if (result != 0) {
+        return result;
+    }
+
+    const uint8_t *header = &m_input[m_input_offset];
+    size_t size = remote_load_u32(header);
+    if (size > k_remote_max_payload_size) {
+        std::cerr << "ERROR - remote: frame of " << size << " bytes" << std::endl;
+        return -1;
+    }
+    if (fill(k_remote_header_size + size) != 0) {
+        return -1;
+    }
+
+    header = &m_input[m_input_offset];
+    type = header[4];
+    sequence = remote_load_u32(&header[5]);
+    payload = header + k_remote_header_size;
+    payload_size = size;
+    m_input_offset += k_remote_header_size + size;
+    return 0;
+}
+
+bool RemoteChannel::has_input() const {
+    size_t buffered = m_input_size - m_input_offset;
+    if (buffered >= k_remote_header_size &&
+        buffered >= k_remote_header_size + remote_load_u32(&m_input[m_input_offset])) {
+        return true;
+    }
+
+    if (m_shared_started) {
+        SharedRingControl &ring = m_shared->rings[m_shared_creator ? 1 : 0];
+        return ring.head.load(std::memory_order_acquire) != ring.tail.load(std::memory_order_relaxed);
+    }
+
+    pollfd descriptor = {};
+    descriptor.fd = m_fd;
+    descriptor.events = POLLIN;
+    return poll(&descriptor, 1, 0) > 0;
+}
+
+int32_t RemoteChannel::flush_with_descriptor(int descriptor) {
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))] = {};
+    iovec vector = {m_output.data(), m_output_size};
+    msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &descriptor, sizeof(descriptor));
+
+    ssize_t result;
+    do {
+        result = sendmsg(m_fd, &message, k_send_flags);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        std::cerr << "ERROR - remote: sendmsg " << strerror(errno) << std::endl;
+        m_output_size = 0;
+        return -1;
+    }
+
+    // The descriptor went with the first bytes, the rest is a plain send
+    size_t sent = (size_t)result;
+    memmove(m_output.data(), &m_output[sent], m_output_size - sent);
+    m_output_size -= sent;
+    return flush();
+}
+
+int RemoteChannel::take_descriptor() {
+    int descriptor = m_received_descriptor;
+    m_received_descriptor = -1;
+    return descriptor;
+}
+
+int32_t RemoteChannel::create_shared_memory(uint32_t ring_capacity, int &descriptor) {
+    descriptor = -1;
+#ifdef __linux__
+    if (ring_capacity < k_min_ring_capacity || ring_capacity > k_max_ring_capacity ||
+        (ring_capacity & (ring_capacity - 1)) != 0) {
+        std::cerr << "ERROR - remote: ring capacity " << ring_capacity << " not a power of two in ["
+                  << k_min_ring_capacity << ", " << k_max_ring_capacity << "]" << std::endl;
+        return -1;
+    }
+
+    int fd = (int)syscall(SYS_memfd_create, "tsg_remote_rings", 1U /* MFD_CLOEXEC */);
+    if (fd < 0) {
+        std::cerr << "ERROR - remote: memfd_create " << strerror(errno) << std::endl;
+        return -1;
+    }
+    size_t size = impl_shared_memory_size(ring_capacity);
+    if (ftruncate(fd, (off_t)size) != 0) {
+        std::cerr << "ERROR - remote: ftruncate " << strerror(errno) << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        std::cerr << "ERROR - remote: mmap " << strerror(errno) << std::endl;
+        ::close(fd);
+        return -1;
+    }
+
+    // The memory is zero filled: positions, flags and 'closed' start at 0
+    unmap_shared_memory();
+    m_shared = (SharedMemoryHeader *)address;
+    m_shared_size = size;
+    m_shared_creator = true;
+    m_ring_capacity = ring_capacity;
+    m_shared->ring_capacity = ring_capacity;
+    m_shared->magic = k_shared_memory_magic;
+    descriptor = fd;
+    return 0;
+#else
+    (void)ring_capacity;
+    std::cerr << "ERROR - remote: shared memory transport not available" << std::endl;
+    return -1;
+#endif
+}
+
+int32_t RemoteChannel::open_shared_memory(int descriptor) {
+#ifdef __linux__
+    struct stat status = {};
+    if (fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(SharedMemoryHeader)) {
+        std::cerr << "ERROR - remote: invalid shared memory" << std::endl;
+        return -1;
+    }
+    size_t size = (size_t)status.st_size;
+    void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (address == MAP_FAILED) {
+        std::cerr << "ERROR - remote: mmap " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    auto shared = (SharedMemoryHeader *)address;
+    uint32_t capacity = shared->ring_capacity;
+    if (shared->magic != k_shared_memory_magic || capacity < k_min_ring_capacity ||
+        capacity > k_max_ring_capacity || (capacity & (capacity - 1)) != 0 ||
+        impl_shared_memory_size(capacity) != size) {
+        std::cerr << "ERROR - remote: invalid shared memory" << std::endl;
+        munmap(address, size);
+        return -1;
+    }
+
+    unmap_shared_memory();
+    m_shared = shared;
+    m_shared_size = size;
+    m_shared_creator = false;
+    m_ring_capacity = capacity; // the peer could still change the header
+    return 0;
+#else
+    (void)descriptor;
+    std::cerr << "ERROR - remote: shared memory transport not available" << std::endl;
+    return -1;
+#endif
+}
+
+void RemoteChannel::start_shared_memory() { m_shared_started = m_shared != nullptr; }
+
+void RemoteChannel::unmap_shared_memory() {
+#ifdef __linux__
+    if (m_shared == nullptr) {
+        return;
+    }
+    // Wakes the peer up, whichever ring it waits on
+    m_shared->closed.store(1, std::memory_order_seq_cst);
+    for (auto &ring : m_shared->rings) {
+        impl_futex_wake(&ring.head);
+        impl_futex_wake(&ring.tail);
+    }
+    munmap(m_shared, m_shared_size);
+#endif
+    m_shared = nullptr;
+    m_shared_size = 0;
+    m_ring_capacity = 0;
+    m_shared_started = false;
+}
+
+bool RemoteChannel::is_peer_gone() const {
+    if (m_shared->closed.load(std::memory_order_acquire) != 0) {
+        return true;
+    }
+    // Nothing is sent on the socket anymore, it only becomes readable once closed
+    pollfd descriptor = {};
+    descriptor.fd = m_fd;
+    descriptor.events = POLLIN;
+    return poll(&descriptor, 1, 0) != 0;
+}
+
+// Positions only move forward by at most the capacity, anything else means the peer misbehaves. The
+// session ends, the peer seeing it closed.
+void RemoteChannel::close_corrupted_ring() {
+    std::cerr << "ERROR - remote: shared memory ring positions out of bounds" << std::endl;
+    m_shared->closed.store(1, std::memory_order_seq_cst);
+}
+
+int32_t RemoteChannel::ring_wait(std::atomic<uint32_t> &position, uint32_t value, std::atomic<uint32_t> &waiting) {
+    for (int spin = 0, count = impl_ring_spin_count(); spin < count; spin++) {
+        if (position.load(std::memory_order_acquire) != value) {
+            return 0;
+        }
+        impl_cpu_relax();
+    }
+
+#ifdef __linux__
+    while (true) {
+        // Either the peer sees the flag after moving the position, or the position is seen moved here
+        waiting.store(1, std::memory_order_seq_cst);
+        if (position.load(std::memory_order_seq_cst) == value && !is_peer_gone()) {
+            impl_futex_wait(&position, value);
+        }
+        waiting.store(0, std::memory_order_relaxed);
+
+        if (position.load(std::memory_order_acquire) != value) {
+            return 0;
+        }
+        if (is_peer_gone()) {
+            return 1;
+        }
+    }
+#else
+    (void)waiting;
+    return 1;
+#endif
+}
+
+int32_t RemoteChannel::ring_write(const uint8_t *bytes, size_t size) {
+    SharedRingControl &ring = m_shared->rings[m_shared_creator ? 0 : 1];
+    uint8_t *data = impl_ring_data(m_shared, m_ring_capacity, m_shared_creator ? 0 : 1);
+    uint32_t capacity = m_ring_capacity;
+
+    // Frames larger than the ring go through it in several parts
+    while (size > 0) {
+        uint32_t head = ring.head.load(std::memory_order_relaxed);
+        uint32_t tail = ring.tail.load(std::memory_order_acquire);
+        if (head - tail > capacity) {
+            close_corrupted_ring();
+            return -1;
+        }
+        uint32_t available = capacity - (head - tail);
+        if (available == 0) {
+            if (ring_wait(ring.tail, tail, ring.producer_waiting) != 0) {
+                std::cerr << "ERROR - remote: peer gone" << std::endl;
+                return -1;
+            }
+            continue;
+        }
+
+        size_t count = size < available ? size : available;
+        size_t offset = head & (capacity - 1);
+        size_t first = count < capacity - offset ? count : capacity - offset;
+        memcpy(&data[offset], bytes, first);
+        memcpy(data, bytes + first, count - first);
+        ring.head.store(head + (uint32_t)count, std::memory_order_seq_cst);
+#ifdef __linux__
+        if (ring.consumer_waiting.load(std::memory_order_seq_cst) != 0) {
+            impl_futex_wake(&ring.head);
+        }
+#endif
+        bytes += count;
+        size -= count;
+    }
+    return 0;
+}
+
+int32_t RemoteChannel::ring_read(uint8_t *bytes, size_t capacity, size_t &received) {
+    SharedRingControl &ring = m_shared->rings[m_shared_creator ? 1 : 0];
+    const uint8_t *data = impl_ring_data(m_shared, m_ring_capacity, m_shared_creator ? 1 : 0);
+    uint32_t ring_capacity = m_ring_capacity;
+
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint32_t head = ring.head.load(std::memory_order_acquire);
+    while (head == tail) {
+        // A peer gone reads as the end of the stream, like a closed socket
+        if (ring_wait(ring.head, tail, ring.consumer_waiting) != 0) {
+            received = 0;
+            return 0;
+        }
+        head = ring.head.load(std::memory_order_acquire);
+    }
+
+    size_t count = head - tail;
+    if (count > ring_capacity) {
+        close_corrupted_ring();
+        return -1;
+    }
+    if (count > capacity) {
+        count = capacity;
+    }
+    size_t offset = tail & (ring_capacity - 1);
+    size_t first = count < ring_capacity - offset ? count : ring_capacity - offset;
+    memcpy(bytes, &data[offset], first);
+    memcpy(bytes + first, data, count - first);
+    ring.tail.store(tail + (uint32_t)count, std::memory_order_seq_cst);
+#ifdef __linux__
+    if (ring.producer_waiting.load(std::memory_order_seq_cst) != 0) {
+        impl_futex_wake(&ring.tail);
+    }
+#endif
+    received = count;
+    return 0;
+}
+
+} // namespace smartcard
+} // namespace tsg
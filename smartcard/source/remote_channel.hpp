@@ -0,0 +1,191 @@
+#ifndef TSG_SMARTCARD_REMOTE_CHANNEL_HPP
+#define TSG_SMARTCARD_REMOTE_CHANNEL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tsg {
+namespace smartcard {
+
+// Framing shared by ReaderServer and RemoteTerminal over a Unix domain socket. Each frame is a 9 byte
+// header (payload size as u32, message type as u8, sequence as u32, little-endian) followed by the
+// payload. A response carries the type of its request with k_remote_response_flag set, the sequence
+// of the request and a payload starting with a remote_status byte. Requests are answered in order,
+// a client may therefore send several before reading the responses.
+constexpr size_t k_remote_header_size = 9;
+constexpr size_t k_remote_max_payload_size = 1 << 20;
+constexpr uint8_t k_remote_response_flag = 0x80;
+
+enum RemoteMessageType : uint8_t {
+    // -> names of the readers, each NUL terminated, the list ending with an empty name
+    remote_message_list_readers = 0x01,
+    // reader name -> attaches the session to the reader, one session per reader
+    remote_message_attach = 0x02,
+    // -> u8 1 when a card is present
+    remote_message_card_present = 0x03,
+    // u8 reset type -> u8 protocol, ATR
+    remote_message_power_on = 0x04,
+    remote_message_power_off = 0x05,
+    // C-APDU -> R-APDU
+    remote_message_transmit = 0x06,
+    // u16 count, then u32 size and C-APDU for each -> u16 count answered, then u32 size and R-APDU
+    // for each. The batch stops at the first command failing.
+    remote_message_transmit_batch = 0x07,
+    // u32 ring capacity, the shared memory passed along with the request -> the following frames go
+    // through the rings instead of the socket
+    remote_message_open_shared_memory = 0x08,
+};
+
+enum RemoteStatus : uint8_t {
+    remote_status_ok = 0x00,
+    remote_status_error = 0x01,
+};
+
+inline void remote_store_u16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+inline void remote_store_u32(uint8_t *bytes, uint32_t value) {
+    for (size_t index = 0; index < 4; index++) {
+        bytes[index] = (uint8_t)(value >> (8 * index));
+    }
+}
+
+inline uint16_t remote_load_u16(const uint8_t *bytes) { return (uint16_t)(bytes[0] | (bytes[1] << 8)); }
+
+inline uint32_t remote_load_u32(const uint8_t *bytes) {
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+constexpr uint32_t k_remote_default_ring_capacity = 256 * 1024;
+
+// Byte queue with a single producer and a single consumer, in shared memory. Positions only grow
+// (modulo 2^32), the capacity being a power of two. A side about to sleep sets its waiting flag and
+// sleeps on the position the other side moves, which wakes it only when the flag is set.
+struct SharedRingControl {
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+    alignas(64) std::atomic<uint32_t> consumer_waiting;
+    std::atomic<uint32_t> producer_waiting;
+};
+
+// Start of the shared memory, followed by the data of the client to server ring then of the server
+// to client ring
+struct SharedMemoryHeader {
+    uint32_t magic;
+    uint32_t ring_capacity;
+    std::atomic<uint32_t> closed;
+    SharedRingControl rings[2];
+};
+
+// Buffered frame transport over a connected stream socket. Frames are appended to the output buffer
+// and sent together by flush(), so that pipelined requests and their responses cost one system call
+// per burst rather than one per frame.
+//
+// Once both sides started the shared memory, frames go through two rings instead of the socket (Linux
+// only): a flush or a read then only costs a system call when the other side sleeps. The socket stays
+// open, its closing telling a side waiting on a ring that the peer is gone.
+class RemoteChannel {
+  public:
+    RemoteChannel() {}
+
+    ~RemoteChannel() { close(); }
+
+    RemoteChannel(const RemoteChannel &) = delete;
+
+    RemoteChannel &operator=(const RemoteChannel &) = delete;
+
+    // Takes ownership of the socket
+    void attach(int fd);
+
+    // Connects to the socket at 'path'
+    int32_t connect(const char *path);
+
+    void close();
+
+    // Wakes up a thread blocked reading the channel, which then sees the peer closing
+    void shutdown();
+
+    bool is_open() const { return m_fd >= 0; }
+
+    // Reserves a frame of at most 'max_payload_size' bytes, whose payload is written in place before
+    // end_frame() gives its final size
+    uint8_t *begin_frame(uint8_t type, uint32_t sequence, size_t max_payload_size);
+
+    void end_frame(size_t payload_size);
+
+    void append_frame(uint8_t type, uint32_t sequence, const uint8_t *payload, size_t payload_size);
+
+    size_t get_pending_output() const { return m_output_size; }
+
+    int32_t flush();
+
+    // Next frame, its payload staying valid until the next call. Returns 1 when the peer closed the
+    // channel between frames, -1 on error.
+    int32_t read_frame(uint8_t &type, uint32_t &sequence, const uint8_t *&payload, size_t &payload_size);
+
+    // Whether a frame can be read without waiting for the peer
+    bool has_input() const;
+
+    // Sends the output buffer along with a file descriptor
+    int32_t flush_with_descriptor(int descriptor);
+
+    // Descriptor received with the frames read so far, -1 when none was
+    int take_descriptor();
+
+    // Client side, maps new shared memory whose descriptor is then passed to the server
+    int32_t create_shared_memory(uint32_t ring_capacity, int &descriptor);
+
+    // Server side, maps the shared memory received from the client
+    int32_t open_shared_memory(int descriptor);
+
+    // Frames flushed and read from now on go through the rings
+    void start_shared_memory();
+
+    bool is_shared_memory_started() const { return m_shared_started; }
+
+  private:
+    int32_t fill(size_t size);
+
+    int32_t receive(uint8_t *bytes, size_t capacity, size_t &received);
+
+    int32_t ring_write(const uint8_t *bytes, size_t size);
+
+    int32_t ring_read(uint8_t *bytes, size_t capacity, size_t &received);
+
+    // Waits for 'position' to move from 'value', 1 when the peer is gone
+    int32_t ring_wait(std::atomic<uint32_t> &position, uint32_t value, std::atomic<uint32_t> &waiting);
+
+    bool is_peer_gone() const;
+
+    void close_corrupted_ring();
+
+    void unmap_shared_memory();
+
+    int m_fd{-1};
+    int m_received_descriptor{-1};
+
+    SharedMemoryHeader *m_shared{nullptr};
+    size_t m_shared_size{0};
+    uint32_t m_ring_capacity{0}; // copied once validated, never read back from the shared header
+    bool m_shared_started{false};
+    bool m_shared_creator{false};
+
+    // Buffers keep their size, only the bytes before m_output_size and between m_input_offset and
+    // m_input_size being in use
+    std::vector<uint8_t> m_output;
+    size_t m_output_size{0};
+    size_t m_frame_offset{0};
+
+    std::vector<uint8_t> m_input;
+    size_t m_input_offset{0};
+    size_t m_input_size{0};
+};
+
+} // namespace smartcard
+} // namespace tsg
+
+#endif // TSG_SMARTCARD_REMOTE_CHANNEL_HPP
@@ -0,0 +1,315 @@
+#include <cstring>
+#include <iostream>
+#include <tsg/base/memory.hpp>
+#include <tsg/smartcard/remote_terminal.hpp>
+#include <unistd.h>
+
+#include "remote_channel.hpp"
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+// Queued commands are sent once this much is waiting, bounding the output buffer
+constexpr size_t k_max_queued_output = 64 * 1024;
+
+} // namespace
+
+struct RemoteTerminalImpl {
+    RemoteChannel channel;
+    uint32_t next_sequence{1};
+
+    // Commands sent by send_transmit() whose response was not received yet
+    uint32_t pending{0};
+};
+
+namespace {
+
+// Response to the oldest request in flight, its payload without the status byte
+int32_t impl_receive(RemoteTerminalImpl *impl, uint8_t type, const uint8_t *&payload, size_t &payload_size) {
+    uint8_t response_type = 0;
+    uint32_t sequence = 0;
+    if (impl->channel.read_frame(response_type, sequence, payload, payload_size) != 0) {
+        std::cerr << "ERROR - remote: connection to the server lost" << std::endl;
+        impl->channel.close();
+        return -1;
+    }
+
+    uint32_t expected_sequence = impl->next_sequence - impl->pending - 1;
+    if (response_type != (type | k_remote_response_flag) || sequence != expected_sequence || payload_size < 1) {
+        std::cerr << "ERROR - remote: unexpected response " << (int)response_type << " to request "
+                  << expected_sequence << std::endl;
+        impl->channel.close();
+        return -1;
+    }
+
+    bool succeeded = payload[0] == remote_status_ok;
+    payload++;
+    payload_size--;
+    return succeeded ? 0 : -1;
+}
+
+int32_t impl_request(RemoteTerminalImpl *impl, uint8_t type, const uint8_t *request, size_t request_size,
+                     const uint8_t *&payload, size_t &payload_size) {
+    if (!impl->channel.is_open() || impl->pending != 0) {
+        return -1;
+    }
+
+    impl->channel.append_frame(type, impl->next_sequence++, request, request_size);
+    if (impl->channel.flush() != 0) {
+        impl->channel.close();
+        return -1;
+    }
+    return impl_receive(impl, type, payload, payload_size);
+}
+
+int32_t impl_copy_response(const uint8_t *payload, size_t payload_size, uint8_t *response, size_t &response_size) {
+    if (payload_size > response_size) {
+        std::cerr << "ERROR - remote: response of " << payload_size << " bytes for a buffer of " << response_size
+                  << std::endl;
+        response_size = 0;
+        return -1;
+    }
+    memcpy(response, payload, payload_size);
+    response_size = payload_size;
+    return 0;
+}
+
+} // namespace
+
+RemoteTerminal::RemoteTerminal() {
+    m_impl = (RemoteTerminalImpl *)TSG_ALLOC(sizeof(RemoteTerminalImpl));
+    tsg::Memory::construct_at(m_impl);
+}
+
+RemoteTerminal::~RemoteTerminal() {
+    tsg::Memory::destroy_at(m_impl);
+    TSG_FREE(m_impl, sizeof(RemoteTerminalImpl));
+}
+
+int32_t RemoteTerminal::open(const char *socket_path, const std::string &reader_name) {
+    close();
+    if (m_impl->channel.connect(socket_path) != 0) {
+        return -1;
+    }
+
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    if (impl_request(m_impl, remote_message_attach, (const uint8_t *)reader_name.c_str(), reader_name.size(),
+                     payload, payload_size) != 0) {
+        std::cerr << "ERROR - remote: cannot attach to " << reader_name << std::endl;
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+void RemoteTerminal::close() {
+    m_impl->channel.close();
+    m_impl->pending = 0;
+}
+
+bool RemoteTerminal::is_open() const { return m_impl->channel.is_open(); }
+
+int32_t RemoteTerminal::use_shared_memory(uint32_t ring_capacity) {
+    RemoteChannel &channel = m_impl->channel;
+    if (!channel.is_open() || m_impl->pending != 0) {
+        return -1;
+    }
+    if (channel.is_shared_memory_started()) {
+        return 0;
+    }
+
+    int descriptor = -1;
+    if (channel.create_shared_memory(ring_capacity, descriptor) != 0) {
+        return -1;
+    }
+    uint8_t request[4];
+    remote_store_u32(request, ring_capacity);
+    channel.append_frame(remote_message_open_shared_memory, m_impl->next_sequence++, request, sizeof(request));
+    int32_t result = channel.flush_with_descriptor(descriptor);
+    ::close(descriptor);
+    if (result != 0) {
+        close();
+        return -1;
+    }
+
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    if (impl_receive(m_impl, remote_message_open_shared_memory, payload, payload_size) != 0) {
+        // Still on the socket when the server refused
+        std::cerr << "ERROR - remote: shared memory refused by the server" << std::endl;
+        return -1;
+    }
+    channel.start_shared_memory();
+    return 0;
+}
+
+int32_t RemoteTerminal::list_readers(const char *socket_path, std::vector<std::string> &names) {
+    names.clear();
+
+    RemoteTerminalImpl impl;
+    if (impl.channel.connect(socket_path) != 0) {
+        return -1;
+    }
+
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    if (impl_request(&impl, remote_message_list_readers, nullptr, 0, payload, payload_size) != 0) {
+        return -1;
+    }
+    size_t offset = 0;
+    while (offset < payload_size && payload[offset] != 0) {
+        size_t length = strnlen((const char *)&payload[offset], payload_size - offset);
+        names.emplace_back((const char *)&payload[offset], length);
+        offset += length + 1;
+    }
+    return 0;
+}
+
+bool RemoteTerminal::is_card_present() {
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    if (impl_request(m_impl, remote_message_card_present, nullptr, 0, payload, payload_size) != 0 ||
+        payload_size < 1) {
+        return false;
+    }
+    return payload[0] != 0;
+}
+
+int32_t RemoteTerminal::power_on(CardConnection::ResetType reset_type, ATR &atr,
+                                 CardConnection::CommunicationProtocol &protocol) {
+    uint8_t request = (uint8_t)reset_type;
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    if (impl_request(m_impl, remote_message_power_on, &request, 1, payload, payload_size) != 0 ||
+        payload_size < 1 || payload_size - 1 > ATR().capacity()) {
+        return -1;
+    }
+
+    uint8_t bytes[ATR().capacity()];
+    memcpy(bytes, &payload[1], payload_size - 1);
+    atr = ATR(bytes, payload_size - 1);
+    protocol = (CardConnection::CommunicationProtocol)payload[0];
+    return 0;
+}
+
+int32_t RemoteTerminal::power_off() {
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    return impl_request(m_impl, remote_message_power_off, nullptr, 0, payload, payload_size);
+}
+
+int32_t RemoteTerminal::transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response, size_t &response_size) {
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    if (impl_request(m_impl, remote_message_transmit, capdu, capdu_size, payload, payload_size) != 0) {
+        response_size = 0;
+        return -1;
+    }
+    return impl_copy_response(payload, payload_size, response, response_size);
+}
+
+int32_t RemoteTerminal::send_transmit(const uint8_t *capdu, size_t capdu_size) {
+    if (!m_impl->channel.is_open()) {
+        return -1;
+    }
+
+    m_impl->channel.append_frame(remote_message_transmit, m_impl->next_sequence++, capdu, capdu_size);
+    m_impl->pending++;
+    if (m_impl->channel.get_pending_output() >= k_max_queued_output) {
+        return flush();
+    }
+    return 0;
+}
+
+int32_t RemoteTerminal::flush() {
+    if (!m_impl->channel.is_open()) {
+        return -1;
+    }
+    if (m_impl->channel.get_pending_output() > 0 && m_impl->channel.flush() != 0) {
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+int32_t RemoteTerminal::receive_transmit(uint8_t *response, size_t &response_size) {
+    if (m_impl->pending == 0 || flush() != 0) {
+        response_size = 0;
+        return -1;
+    }
+
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    m_impl->pending--;
+    if (impl_receive(m_impl, remote_message_transmit, payload, payload_size) != 0) {
+        if (!m_impl->channel.is_open()) {
+            m_impl->pending = 0;
+        }
+        response_size = 0;
+        return -1;
+    }
+    return impl_copy_response(payload, payload_size, response, response_size);
+}
+
+uint32_t RemoteTerminal::get_pending_count() const { return m_impl->pending; }
+
+int32_t RemoteTerminal::transmit_batch(RemoteCommand *commands, size_t count, size_t &completed) {
+    completed = 0;
+    if (!m_impl->channel.is_open() || m_impl->pending != 0 || count > UINT16_MAX) {
+        return -1;
+    }
+
+    size_t request_size = 2;
+    for (size_t index = 0; index < count; index++) {
+        request_size += 4 + commands[index].capdu_size;
+    }
+    if (request_size > k_remote_max_payload_size) {
+        std::cerr << "ERROR - remote: batch of " << request_size << " bytes" << std::endl;
+        return -1;
+    }
+
+    uint8_t *request = m_impl->channel.begin_frame(remote_message_transmit_batch, m_impl->next_sequence++,
+                                                   request_size);
+    remote_store_u16(request, (uint16_t)count);
+    size_t offset = 2;
+    for (size_t index = 0; index < count; index++) {
+        remote_store_u32(&request[offset], (uint32_t)commands[index].capdu_size);
+        memcpy(&request[offset + 4], commands[index].capdu, commands[index].capdu_size);
+        offset += 4 + commands[index].capdu_size;
+    }
+    m_impl->channel.end_frame(request_size);
+    if (m_impl->channel.flush() != 0) {
+        close();
+        return -1;
+    }
+
+    // A partly answered batch has an error status but its responses are still read
+    const uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+    int32_t result = impl_receive(m_impl, remote_message_transmit_batch, payload, payload_size);
+    if (!m_impl->channel.is_open() || payload_size < 2) {
+        return -1;
+    }
+
+    size_t answered = remote_load_u16(payload);
+    offset = 2;
+    for (size_t index = 0; index < answered && index < count; index++) {
+        if (offset + 4 > payload_size || offset + 4 + remote_load_u32(&payload[offset]) > payload_size) {
+            return -1;
+        }
+        size_t response_size = remote_load_u32(&payload[offset]);
+        if (impl_copy_response(&payload[offset + 4], response_size, commands[index].response,
+                               commands[index].response_size) != 0) {
+            return -1;
+        }
+        offset += 4 + response_size;
+        completed++;
+    }
+    return (result == 0 && completed == count) ? 0 : -1;
+}
+
+} // namespace smartcard
+} // namespace tsg
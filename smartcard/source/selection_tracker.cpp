@@ -0,0 +1,225 @@
+#include <cstring>
+#include <tsg/smartcard/apdu_builder.hpp>
+#include <tsg/smartcard/selection_tracker.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+bool is_selection_successful(const ResponseAPDU &rapdu) {
+    if (rapdu.size() < 2) {
+        return false;
+    }
+    uint8_t sw1 = rapdu.get_sw1();
+    return (sw1 == StatusWord::normal_processing && rapdu.get_sw2() == 0x00) ||
+           sw1 == StatusWord::response_bytes_still_available || sw1 == StatusWord::warning_state_unchanged;
+}
+
+// Lc and command data of a short or extended case 3/4 command, data_size is zero otherwise
+void command_data_of(const uint8_t *capdu, size_t capdu_size, const uint8_t *&data, size_t &data_size) {
+    data = nullptr;
+    data_size = 0;
+    if (capdu_size <= 5) {
+        return;
+    }
+    if (capdu[4] != 0x00) {
+        data_size = capdu[4];
+        data = &capdu[5];
+    } else if (capdu_size > 7) {
+        data_size = ((size_t)capdu[5] << 8) | capdu[6];
+        data = &capdu[7];
+    }
+    if (data != nullptr && (size_t)(data - capdu) + data_size > capdu_size) {
+        data = nullptr;
+        data_size = 0;
+    }
+}
+
+} // namespace
+
+uint8_t SelectionTracker::short_ef_identifier_of(const uint8_t *capdu, size_t capdu_size) {
+    if (capdu_size < 4) {
+        return 0;
+    }
+
+    switch (capdu[1]) {
+    case 0xB0: // READ BINARY
+    case 0xD0: // WRITE BINARY
+    case 0xD6: // UPDATE BINARY
+    case 0x0E: // ERASE BINARY
+        return (capdu[2] & 0x80) ? (capdu[2] & 0x1F) : 0;
+
+    case 0xB2: // READ RECORD
+    case 0xD2: // WRITE RECORD
+    case 0xDC: // UPDATE RECORD
+    case 0xE2: // APPEND RECORD
+    case 0x0C: // ERASE RECORD
+        return (capdu[3] >> 3) & 0x1F;
+
+    default:
+        return 0;
+    }
+}
+
+bool SelectionTracker::references_current_ef(const uint8_t *capdu, size_t capdu_size) {
+    if (capdu_size < 4) {
+        return false;
+    }
+
+    switch (capdu[1]) {
+    case 0xB0:
+    case 0xD0:
+    case 0xD6:
+    case 0x0E:
+    case 0xB2:
+    case 0xD2:
+    case 0xDC:
+    case 0xE2:
+    case 0x0C:
+        return short_ef_identifier_of(capdu, capdu_size) == 0;
+
+    case 0xB1: // odd instruction variants carry a file identifier, 0000 denoting the current EF
+    case 0xD7:
+    case 0x0F:
+        return (capdu[2] == 0x00 && capdu[3] == 0x00);
+
+    default:
+        return false;
+    }
+}
+
+uint8_t SelectionTracker::logical_channel_of(uint8_t cla) {
+    if ((cla & 0x40) != 0) {
+        return 4 + (cla & 0x0F); // further interindustry class
+    }
+    return cla & 0x03;
+}
+
+void SelectionTracker::observe(const uint8_t *capdu, size_t capdu_size, const ResponseAPDU &rapdu,
+                               uint32_t round_trips) {
+    if (capdu_size < 4 || logical_channel_of(capdu[0]) != 0) {
+        return;
+    }
+
+    if (capdu[1] != apdu::ins_select) {
+        uint8_t sfi = short_ef_identifier_of(capdu, capdu_size);
+        if (sfi != 0 && m_known && is_selection_successful(rapdu)) {
+            append_entry(entry_kind_ef, 0x80, &sfi, 1);
+        }
+        return;
+    }
+
+    uint8_t p1 = capdu[2];
+    uint8_t p2 = capdu[3];
+
+    m_statistics.selects++;
+
+    // Failed selections and 'next occurrence' selections leave a selection we cannot name
+    if (!is_selection_successful(rapdu) || (p2 & 0x03) != apdu::select_p2_first_or_only) {
+        invalidate();
+        return;
+    }
+
+    const uint8_t *data = nullptr;
+    size_t data_size = 0;
+    command_data_of(capdu, capdu_size, data, data_size);
+
+    bool selects_mf = (p1 == apdu::select_p1_file_id) &&
+                      (data_size == 0 || (data_size == 2 && data[0] == 0x3F && data[1] == 0x00));
+
+    switch (p1) {
+    case apdu::select_p1_df_name:
+    case apdu::select_p1_path_from_mf: {
+        reset_path();
+        append_entry(entry_kind_df, p1, data, data_size);
+    } break;
+
+    case apdu::select_p1_ef_under_current_df: {
+        append_entry(entry_kind_ef, p1, data, data_size);
+    } break;
+
+    default: {
+        if (selects_mf) {
+            reset_path();
+        }
+        append_entry(entry_kind_df, p1, data, data_size);
+    } break;
+    }
+
+    if (m_known && capdu_size <= sizeof(m_select_capdu)) {
+        memcpy(m_select_capdu, capdu, capdu_size);
+        m_select_capdu_size = capdu_size;
+        m_select_rapdu = rapdu;
+        m_select_round_trips = round_trips;
+    }
+}
+
+bool SelectionTracker::elide(const uint8_t *capdu, size_t capdu_size, ResponseAPDU &rapdu) {
+    if (!m_known || m_select_capdu_size == 0 || capdu_size != m_select_capdu_size ||
+        memcmp(capdu, m_select_capdu, capdu_size) != 0) {
+        return false;
+    }
+
+    m_statistics.selects++;
+    m_statistics.selects_elided++;
+    m_statistics.round_trips_saved += m_select_round_trips;
+    rapdu = m_select_rapdu;
+    return true;
+}
+
+bool SelectionTracker::selected_application(const uint8_t *&aid, size_t &aid_size) const {
+    if (!m_known || m_path_size < 3 || m_path[1] != apdu::select_p1_df_name) {
+        return false;
+    }
+
+    aid = &m_path[3];
+    aid_size = m_path[2];
+    return true;
+}
+
+void SelectionTracker::invalidate() {
+    if (m_known) {
+        m_statistics.invalidations++;
+    }
+    m_select_capdu_size = 0;
+    m_path_size = 0;
+    m_last_entry_offset = 0;
+    m_last_entry_is_ef = false;
+    m_known = false;
+}
+
+void SelectionTracker::reset_path() {
+    m_select_capdu_size = 0;
+    m_path_size = 0;
+    m_last_entry_offset = 0;
+    m_last_entry_is_ef = false;
+    m_known = true;
+}
+
+void SelectionTracker::append_entry(EntryKind kind, uint8_t p1, const uint8_t *data, size_t data_size) {
+    if (!m_known) {
+        return;
+    }
+
+    size_t offset = (kind == entry_kind_ef && m_last_entry_is_ef) ? m_last_entry_offset : m_path_size;
+    if (offset + 3 + data_size > k_max_path_size) {
+        invalidate();
+        return;
+    }
+
+    m_path[offset + 0] = kind;
+    m_path[offset + 1] = p1;
+    m_path[offset + 2] = (uint8_t)data_size;
+    if (data_size > 0) {
+        memcpy(&m_path[offset + 3], data, data_size);
+    }
+
+    m_select_capdu_size = 0;
+    m_last_entry_offset = offset;
+    m_last_entry_is_ef = (kind == entry_kind_ef);
+    m_path_size = offset + 3 + data_size;
+}
+
+} // namespace smartcard
+} // namespace tsg
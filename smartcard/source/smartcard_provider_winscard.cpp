@@ -1,9 +1,14 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <map>
 #include <string>
 #include <tsg/base/memory.hpp>
 #include <tsg/smartcard/smartcard_provider.hpp>
+#include <tsg/smartcard/virtual_terminal.hpp>
 #include <vector>
 
+#include "context_manager.hpp"
 #include "internal_winscard.hpp"
 
 namespace tsg {
@@ -12,10 +17,137 @@ namespace smartcard {
 namespace priv {
 
 struct ProviderImpl {
-    SCARDCONTEXT context;
+    ContextManager contexts;
     std::vector<TerminalData> terminals;
+    std::vector<TerminalData> virtual_terminals;
+
+    // Kept across refresh() so that a reader is only discovered once
+    std::map<std::string, ReaderCapabilityCache> capabilities;
+
+    // Ids by terminal name, handed out in the order terminals first appear
+    std::map<std::string, uint32_t> terminal_ids;
+    uint32_t next_terminal_id{0};
+
+    TerminalListener terminal_listener;
 };
 
+uint32_t impl_get_terminal_id(ProviderImpl *impl, const std::string &name) {
+    auto it = impl->terminal_ids.find(name);
+    if (it != impl->terminal_ids.end()) {
+        return it->second;
+    }
+    uint32_t id = impl->next_terminal_id++;
+    impl->terminal_ids.emplace(name, id);
+    return id;
+}
+
+bool impl_is_same_terminal(const TerminalData &a, const TerminalData &b) {
+    return a.name == b.name && a.virtual_terminal == b.virtual_terminal;
+}
+
+// Whether the current list already holds the readers of 'reader_list' (a multi-string, nullptr for
+// none) followed by the virtual terminals, in that order
+bool impl_is_list_unchanged(ProviderImpl *impl, const char *reader_list) {
+    size_t index = 0;
+    for (const char *reader = reader_list; reader != nullptr && *reader; reader += strlen(reader) + 1) {
+        if (index >= impl->terminals.size() || impl->terminals[index].virtual_terminal != nullptr ||
+            impl->terminals[index].name != reader) {
+            return false;
+        }
+        index++;
+    }
+    for (auto &t : impl->virtual_terminals) {
+        if (index >= impl->terminals.size() || !impl_is_same_terminal(impl->terminals[index], t)) {
+            return false;
+        }
+        index++;
+    }
+    return index == impl->terminals.size();
+}
+
+bool impl_contains_terminal(const std::vector<TerminalData> &terminals, const TerminalData &terminal) {
+    for (auto &t : terminals) {
+        if (impl_is_same_terminal(t, terminal)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void impl_notify_terminal(ProviderImpl *impl, TerminalEventType type, const TerminalData &terminal) {
+    std::cerr << "[" << terminal.id << "] " << terminal.name << (type == terminal_event_added ? "" : " (removed)")
+              << std::endl;
+    if (impl->terminal_listener) {
+        TerminalEvent event;
+        event.type = type;
+        event.id = terminal.id;
+        event.name = terminal.name;
+        event.virtual_terminal = terminal.virtual_terminal != nullptr;
+        impl->terminal_listener(event);
+    }
+}
+
+// Replaces the list with the readers of 'reader_list' and the virtual terminals when it differs,
+// reporting the terminals removed then the ones added
+void impl_update_terminals(ProviderImpl *impl, const char *reader_list) {
+    if (impl_is_list_unchanged(impl, reader_list)) {
+        return;
+    }
+
+    std::vector<TerminalData> terminals;
+    terminals.reserve(impl->terminals.size() + 1);
+    for (const char *reader = reader_list; reader != nullptr && *reader; reader += strlen(reader) + 1) {
+        TerminalData terminal;
+        terminal.name = reader;
+        terminal.id = impl_get_terminal_id(impl, terminal.name);
+        terminal.capabilities = &impl->capabilities[terminal.name];
+        terminals.emplace_back(terminal);
+    }
+    for (auto &t : impl->virtual_terminals) {
+        TerminalData terminal = t;
+        terminal.id = impl_get_terminal_id(impl, terminal.name);
+        terminals.emplace_back(terminal);
+    }
+
+    impl->terminals.swap(terminals);
+
+    // 'terminals' now holds the previous list
+    for (auto &t : terminals) {
+        if (!impl_contains_terminal(impl->terminals, t)) {
+            impl_notify_terminal(impl, terminal_event_removed, t);
+        }
+    }
+    for (auto &t : impl->terminals) {
+        if (!impl_contains_terminal(terminals, t)) {
+            impl_notify_terminal(impl, terminal_event_added, t);
+        }
+    }
+}
+
+bool impl_is_card_present(ProviderImpl *impl, TerminalData &t) {
+    if (t.virtual_terminal != nullptr) {
+        return t.virtual_terminal->is_card_present();
+    }
+
+    SCARDCONTEXT context;
+    if (impl->contexts.acquire(context) != 0) {
+        return false;
+    }
+
+    SCARD_READERSTATE reader_state = {};
+    reader_state.szReader = t.name.c_str();
+    LONG rv = SCardGetStatusChange(context, 2000, &reader_state, 1);
+    if (rv != SCARD_S_SUCCESS) {
+        if (ContextManager::is_service_lost(rv)) {
+            impl->contexts.invalidate();
+        }
+        std::cerr << "ERROR - winscard: " << rv << std::endl;
+        return false;
+    }
+
+    return (reader_state.cbAtr > 0) ? true : false;
+}
+
 } // namespace priv
 
 SmartCardProvider::SmartCardProvider() {
@@ -29,13 +161,8 @@ SmartCardProvider::~SmartCardProvider() {
 }
 
 int32_t SmartCardProvider::initialize() {
-    LONG rv = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &m_impl->context);
-    if (rv != SCARD_S_SUCCESS) {
-        if (rv == SCARD_E_NO_SERVICE) {
-            std::cerr << "ERROR - winscard: The smart card resource manager is not running." << std::endl;
-        } else {
-            std::cerr << "ERROR - winscard: " << rv << std::endl;
-        }
+    SCARDCONTEXT context;
+    if (m_impl->contexts.acquire(context) != 0) {
         return -1;
     }
     std::cout << "WinSCard Context established" << std::endl;
@@ -44,34 +171,38 @@ int32_t SmartCardProvider::initialize() {
 }
 
 int32_t SmartCardProvider::cleanup() {
-    LONG rv = SCardReleaseContext(m_impl->context);
-    if (rv != SCARD_S_SUCCESS) {
-        std::cerr << "ERROR - winscard: " << rv << std::endl;
-        return -1;
-    }
+    m_impl->contexts.cleanup();
     std::cout << "WinSCard Context released" << std::endl;
     return 0;
 }
 
 CardConnection SmartCardProvider::create_card_connection() {
-    bool card_found;
     for (auto &t : m_impl->terminals) {
-        SCARD_READERSTATE reader_state = {};
-        reader_state.szReader = t.name.c_str();
-        LONG rv = SCardGetStatusChange(m_impl->context, 2000, &reader_state, 1);
-        if (rv != SCARD_S_SUCCESS) {
-            std::cerr << "ERROR - winscard: " << rv << std::endl;
-            card_found = false;
+        if (priv::impl_is_card_present(m_impl, t)) {
+            CardConnectCI ccci;
+            ccci.context = 0;
+            ccci.contexts = &m_impl->contexts;
+            ccci.terminal = t;
+            ccci.card_detected = std::chrono::steady_clock::now();
+            CardConnection cc;
+            cc.initialize(ccci);
+            return cc;
         }
+    }
 
-        card_found = (reader_state.cbAtr > 0) ? true : false;
-        if (card_found) {
+    return CardConnection();
+}
+
+CardConnection SmartCardProvider::create_card_connection(const std::string &terminal_name) {
+    for (auto &t : m_impl->terminals) {
+        if (t.name == terminal_name) {
             CardConnectCI ccci;
-            ccci.context = m_impl->context;
+            ccci.context = 0;
+            ccci.contexts = &m_impl->contexts;
             ccci.terminal = t;
             CardConnection cc;
             cc.initialize(ccci);
-            return std::move(cc);
+            return cc;
         }
     }
 
@@ -89,44 +220,90 @@ void SmartCardProvider::destroy_card_connection(CardConnection &cc) {
 }
 
 void SmartCardProvider::refresh() {
-    if (!m_impl->terminals.empty()) {
-        m_impl->terminals.clear();
+    SCARDCONTEXT context;
+    if (m_impl->contexts.acquire(context) != 0) {
+        priv::impl_update_terminals(m_impl, nullptr);
+        return;
     }
 
     TCHAR *reader_list_ptr = nullptr;
     DWORD len = SCARD_AUTOALLOCATE;
 
-    LONG rv = SCardListReaders(m_impl->context, nullptr, (LPTSTR)&reader_list_ptr, &len);
+    LONG rv = SCardListReaders(context, nullptr, (LPTSTR)&reader_list_ptr, &len);
+    if (ContextManager::is_service_lost(rv)) {
+        // The service restarted since the context was established
+        m_impl->contexts.invalidate();
+        if (m_impl->contexts.acquire(context) == 0) {
+            rv = SCardListReaders(context, nullptr, (LPTSTR)&reader_list_ptr, &len);
+        }
+    }
     if (rv != SCARD_S_SUCCESS) {
         if (rv == SCARD_E_NO_READERS_AVAILABLE) {
             std::cerr << "No card reader found" << std::endl;
         } else {
             std::cerr << "ERROR - winscard: " << rv << std::endl;
         }
+        priv::impl_update_terminals(m_impl, nullptr);
         return;
     }
 
-    TCHAR *pszReader = reader_list_ptr;
-    uint32_t index = 0;
-    while (*pszReader) {
-        TerminalData terminal{index, pszReader};
-        m_impl->terminals.emplace_back(terminal);
-        pszReader += strlen(pszReader) + 1;
-        index++;
-    }
+    priv::impl_update_terminals(m_impl, reader_list_ptr);
 
-    rv = SCardFreeMemory(m_impl->context, reader_list_ptr);
+    rv = SCardFreeMemory(context, reader_list_ptr);
     if (rv != SCARD_S_SUCCESS) {
         std::cerr << "ERROR - winscard: " << rv << std::endl;
-        return;
     }
+}
 
-    int i = 0;
-    for (auto &terminal : m_impl->terminals) {
-        std::cerr << "[" << i << "] " << terminal.name << std::endl;
-        i++;
+void SmartCardProvider::set_terminal_listener(TerminalListener listener) {
+    m_impl->terminal_listener = std::move(listener);
+}
+
+void SmartCardProvider::get_terminal_names(std::vector<std::string> &names) const {
+    names.clear();
+    for (auto &t : m_impl->terminals) {
+        names.push_back(t.name);
     }
 }
 
+int32_t SmartCardProvider::get_terminal_id(const std::string &terminal_name, uint32_t &id) {
+    for (auto &t : m_impl->terminals) {
+        if (t.name == terminal_name) {
+            id = t.id;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int32_t SmartCardProvider::get_reader_capabilities(const std::string &terminal_name,
+                                                   ReaderCapabilities &capabilities) {
+    for (auto &t : m_impl->terminals) {
+        if (t.name == terminal_name) {
+            if (t.capabilities == nullptr) {
+                capabilities = ReaderCapabilities();
+                return 0;
+            }
+            std::lock_guard<std::mutex> lock(t.capabilities->mutex);
+            capabilities = t.capabilities->capabilities;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void SmartCardProvider::add_virtual_terminal(const std::string &name, VirtualTerminal *terminal) {
+    TerminalData data;
+    data.id = 0;
+    data.name = name;
+    data.virtual_terminal = terminal;
+    m_impl->virtual_terminals.emplace_back(data);
+}
+
+void SmartCardProvider::remove_virtual_terminal(const std::string &name) {
+    auto &v = m_impl->virtual_terminals;
+    v.erase(std::remove_if(v.begin(), v.end(), [&name](const TerminalData &t) { return t.name == name; }), v.end());
+}
+
 } // namespace smartcard
 } // namespace tsg
@@ -0,0 +1,283 @@
+#include "internal_winscard.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <tsg/smartcard/trace_replay.hpp>
+
+namespace tsg {
+namespace smartcard {
+
+namespace {
+
+bool equal_bytes(const uint8_t *a, size_t a_size, const uint8_t *b, size_t b_size) {
+    return a_size == b_size && memcmp(a, b, a_size) == 0;
+}
+
+// True for the round-trips CardConnection sends on its own after the previous response
+bool is_continuation(const TraceReplaySession::Exchange &previous, const TraceReplaySession::Exchange &exchange) {
+    if (previous.rapdu_size < 2 || exchange.capdu_size < 4) {
+        return false;
+    }
+    uint8_t sw1 = previous.rapdu[previous.rapdu_size - 2];
+    if (sw1 == 0x61) {
+        return exchange.capdu[1] == apdu::ins_get_response;
+    }
+    if (sw1 == 0x6C) {
+        return previous.capdu_size >= 4 && memcmp(previous.capdu, exchange.capdu, 4) == 0;
+    }
+    return false;
+}
+
+} // namespace
+
+uint64_t TraceReplaySession::hash_of(const uint8_t *bytes, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t index = 0; index < size; index++) {
+        hash = (hash ^ bytes[index]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+int32_t TraceReplaySession::load(TraceReader &reader) {
+    m_exchanges.clear();
+    m_commands.clear();
+    m_index.clear();
+    m_atr = ATR();
+    m_protocol = CardConnection::com_protocol_t_none;
+
+    if (!reader.is_open()) {
+        return -1;
+    }
+
+    bool connected = false;
+    TraceRecord record;
+    reader.rewind();
+    while (reader.next(record)) {
+        if (record.type == trace_record_connect && !connected) {
+            m_atr.reset((uint8_t *)record.atr, record.atr_size);
+            m_protocol = record.protocol;
+            connected = true;
+        }
+        if (record.type != trace_record_exchange || (record.flags & trace_flag_transmit_failed) != 0) {
+            continue;
+        }
+
+        Exchange exchange{record.capdu, record.capdu_size, record.rapdu, record.rapdu_size, record.timestamp_ns,
+                          record.latency_ns};
+        if (m_exchanges.empty() || !is_continuation(m_exchanges.back(), exchange)) {
+            m_commands.push_back(m_exchanges.size());
+        }
+        m_index[hash_of(exchange.capdu, exchange.capdu_size)].push_back(m_exchanges.size());
+        m_exchanges.push_back(exchange);
+    }
+
+    if (!connected) {
+        std::cerr << "ERROR - replay: the trace holds no connect record" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int64_t TraceReplaySession::find(const uint8_t *capdu, size_t capdu_size, size_t from) const {
+    auto it = m_index.find(hash_of(capdu, capdu_size));
+    if (it == m_index.end()) {
+        return -1;
+    }
+
+    const std::vector<size_t> &candidates = it->second;
+    size_t start = (size_t)(std::lower_bound(candidates.begin(), candidates.end(), from) - candidates.begin());
+    for (size_t count = 0; count < candidates.size(); count++) {
+        size_t candidate = candidates[(start + count) % candidates.size()];
+        const Exchange &exchange = m_exchanges[candidate];
+        if (equal_bytes(exchange.capdu, exchange.capdu_size, capdu, capdu_size)) {
+            return (int64_t)candidate;
+        }
+    }
+    return -1;
+}
+
+TraceReplayTerminal::TraceReplayTerminal(const TraceReplaySession &session, const ReplayOptions &options)
+    : m_session(session), m_options(options) {}
+
+int32_t TraceReplayTerminal::power_on(CardConnection::ResetType reset_type, ATR &atr,
+                                      CardConnection::CommunicationProtocol &protocol) {
+    // A warm reset recorded mid-session is replayed in place, a cold one starts over
+    if (reset_type != CardConnection::reset_type_warm || m_cursor >= m_session.get_exchanges().size()) {
+        m_cursor = 0;
+    }
+    atr = m_session.get_atr();
+    protocol = m_session.get_protocol();
+    m_powered = true;
+    return 0;
+}
+
+int32_t TraceReplayTerminal::power_off() {
+    m_powered = false;
+    return 0;
+}
+
+int32_t TraceReplayTerminal::transmit(const uint8_t *capdu, size_t capdu_size, uint8_t *response,
+                                      size_t &response_size) {
+    if (!m_powered || capdu_size < 4) {
+        return -1;
+    }
+    m_statistics.commands++;
+
+    const std::vector<TraceReplaySession::Exchange> &exchanges = m_session.get_exchanges();
+    int64_t found = -1;
+    if (m_cursor < exchanges.size() &&
+        equal_bytes(exchanges[m_cursor].capdu, exchanges[m_cursor].capdu_size, capdu, capdu_size)) {
+        found = (int64_t)m_cursor;
+        m_statistics.matched++;
+    } else {
+        size_t end = std::min(exchanges.size(), m_cursor + 1 + m_options.resync_window);
+        for (size_t index = m_cursor + 1; index < end; index++) {
+            if (equal_bytes(exchanges[index].capdu, exchanges[index].capdu_size, capdu, capdu_size)) {
+                found = (int64_t)index;
+                break;
+            }
+        }
+        if (found < 0) {
+            found = m_session.find(capdu, capdu_size, m_cursor);
+        }
+        if (found >= 0) {
+            m_statistics.resynchronized++;
+        }
+    }
+
+    if (found < 0) {
+        m_statistics.unmatched++;
+        if (response_size < 2) {
+            return -1;
+        }
+        response[0] = 0x6F;
+        response[1] = 0x00;
+        response_size = 2;
+        return 0;
+    }
+
+    const TraceReplaySession::Exchange &exchange = exchanges[(size_t)found];
+    m_cursor = (size_t)found + 1;
+    if (exchange.rapdu_size > response_size) {
+        return -1;
+    }
+    memcpy(response, exchange.rapdu, exchange.rapdu_size);
+    response_size = exchange.rapdu_size;
+
+    pace(exchange.latency_ns);
+    return 0;
+}
+
+void TraceReplayTerminal::pace(uint32_t latency_ns) {
+    if (m_options.pacing == replay_pacing_as_fast_as_possible || latency_ns == 0) {
+        return;
+    }
+    double speed = (m_options.pacing == replay_pacing_scaled && m_options.speed > 0) ? m_options.speed : 1.0;
+    std::this_thread::sleep_for(std::chrono::nanoseconds((uint64_t)(latency_ns / speed)));
+}
+
+TraceReplayRunner::TraceReplayRunner(const TraceReplaySession &session, const ReplayRunOptions &options)
+    : m_session(session), m_options(options) {}
+
+int32_t TraceReplayRunner::run() {
+    m_statistics = ReplayRunStatistics();
+    m_replay_metrics.assign(m_options.replay_count, APDUMetricsSnapshot());
+    if (m_options.replay_count == 0 || m_session.get_commands().empty()) {
+        return -1;
+    }
+
+    struct Replay {
+        Replay(const TraceReplaySession &session, const ReplayOptions &options) : terminal(session, options) {}
+
+        TraceReplayTerminal terminal;
+        CardConnection connection;
+        uint64_t transmit_failures{0};
+    };
+
+    // Connections are opened on the replay terminals directly, no resource manager is involved
+    std::vector<Replay> replays;
+    replays.reserve(m_options.replay_count);
+    for (size_t index = 0; index < m_options.replay_count; index++) {
+        replays.emplace_back(m_session, m_options.replay);
+        CardConnectCI ci;
+        ci.context = 0;
+        ci.terminal.id = (uint32_t)index;
+        ci.terminal.name = "Trace Replay " + std::to_string(index);
+        ci.terminal.virtual_terminal = &replays.back().terminal;
+        replays.back().connection.initialize(ci);
+        replays.back().connection.set_apdu_trace_enabled(false);
+    }
+
+    const ReplayOptions &replay_options = m_options.replay;
+    double speed = 1.0;
+    if (replay_options.pacing == replay_pacing_scaled && replay_options.speed > 0) {
+        speed = replay_options.speed;
+    }
+    size_t iterations = m_options.iterations;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    threads.reserve(replays.size());
+    for (auto &replay : replays) {
+        threads.emplace_back([this, &replay, speed, iterations]() {
+            const auto &exchanges = m_session.get_exchanges();
+            const auto &commands = m_session.get_commands();
+            std::vector<uint8_t> response(k_max_extended_ne + 2);
+
+            for (size_t iteration = 0; iteration < iterations; iteration++) {
+                int32_t result = (iteration == 0) ? replay.connection.connect()
+                                                  : replay.connection.reconnect(CardConnection::reset_type_cold);
+                if (result != 0) {
+                    replay.transmit_failures++;
+                    return;
+                }
+
+                uint64_t first_timestamp_ns = exchanges[commands.front()].timestamp_ns;
+                auto pass_start = std::chrono::steady_clock::now();
+                for (size_t command : commands) {
+                    const TraceReplaySession::Exchange &exchange = exchanges[command];
+                    if (m_options.replay.pacing != replay_pacing_as_fast_as_possible) {
+                        uint64_t offset_ns = (uint64_t)((exchange.timestamp_ns - first_timestamp_ns) / speed);
+                        std::this_thread::sleep_until(pass_start + std::chrono::nanoseconds(offset_ns));
+                    }
+
+                    size_t response_size = response.size();
+                    if (replay.connection.transmit(exchange.capdu, exchange.capdu_size, response.data(),
+                                                   response_size) != 0) {
+                        replay.transmit_failures++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    m_statistics.elapsed_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+
+    for (size_t index = 0; index < replays.size(); index++) {
+        Replay &replay = replays[index];
+        ReplayStatistics statistics = replay.terminal.get_statistics();
+        m_statistics.replay.commands += statistics.commands;
+        m_statistics.replay.matched += statistics.matched;
+        m_statistics.replay.resynchronized += statistics.resynchronized;
+        m_statistics.replay.unmatched += statistics.unmatched;
+        m_statistics.transmit_failures += replay.transmit_failures;
+        m_replay_metrics[index] = replay.connection.get_apdu_metrics();
+
+        replay.connection.disconnect();
+        replay.connection.cleanup();
+    }
+
+    return m_statistics.transmit_failures == 0 ? 0 : -1;
+}
+
+} // namespace smartcard
+} // namespace tsg